@@ -7,15 +7,23 @@ f(f32, degrees_per_second, {}) \
 f(f32, test_test, 1) \
 
 DECLARE_COMPONENT(Rotator) {
+	// Only touches its own entity
+	static constexpr bool parallel_safe = true;
+
 	f32 start_pos;
 	void start() {
 		auto &entity = this->entity();
 		start_pos = entity.position.y;
 	}
-	void update() {
-		auto &entity = this->entity();
-		entity.rotation *= quaternion_from_axis_angle(normalize(axis, {1, 0, 0}), degrees_per_second * (pi * app->frame_time / 180));
-		entity.position.y = start_pos + tl::sin(app->time * 10) * test_test;
+	static void update_batch(Rotator *items, u32 count) {
+		f32 radians_per_degree = pi * app->frame_time / 180;
+		f32 offset = tl::sin(app->time * 10);
+		for (u32 i = 0; i < count; ++i) {
+			auto &rotator = items[i];
+			auto &entity = rotator.entity();
+			entity.rotation *= quaternion_from_axis_angle(normalize(rotator.axis, {1, 0, 0}), rotator.degrees_per_second * radians_per_degree);
+			entity.position.y = rotator.start_pos + offset * rotator.test_test;
+		}
 	}
 };
 
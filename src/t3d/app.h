@@ -5,6 +5,13 @@
 #include <t3d/components/camera.h>
 #include <t3d/assets.h>
 #include <t3d/scene.h>
+#include <t3d/jobs.h>
+#include <t3d/light_clusters.h>
+#include <t3d/render_queue.h>
+#include <t3d/uniform_ring.h>
+#include <t3d/shadow_cache.h>
+#include <t3d/occlusion.h>
+#include <t3d/render_graph.h>
 #include <tl/time.h>
 #include <tl/window.h>
 #include <tl/font.h>
@@ -27,21 +34,85 @@ struct EntityConstants {
 	m4 local_to_world_position_matrix;
 	m4 local_to_world_normal_matrix;
 	m4 object_rotation_matrix;
+
+	// Set for instanced draws. Then per-instance matrices come from `InstanceConstants`
+	// and `local_to_camera_matrix` is world to camera.
+	u32 instanced;
 };
 #define ENTITY_CONSTANTS_SLOT 6
 
 
+//
+// Per-instance data of instanced draws, indexed by gl_InstanceID.
+// Renderers that share mesh, material and lightmap are drawn `MAX_INSTANCES` at a time.
+//
+#define MAX_INSTANCES 128
+
+struct InstanceData {
+	m4 local_to_world_position_matrix;
+	m4 local_to_world_normal_matrix;
+};
+
+struct InstanceConstants {
+	InstanceData instances[MAX_INSTANCES];
+};
+#define INSTANCE_CONSTANTS_SLOT 10
+
+static_assert(sizeof(InstanceConstants) <= MAX_UNIFORM_BLOCK_SIZE, "lower MAX_INSTANCES");
+
+
 struct LightConstants {
 	m4 world_to_light_matrix;
 
 	v3f light_position;
 	f32 light_intensity;
 
+	v4f shadow_uv_rect;
+
 	u32 light_index;
 };
 #define LIGHT_CONSTANTS_SLOT 7
 
 
+//
+// Lights of single-pass forward shading. Lights after `MAX_FORWARD_LIGHTS` are ignored.
+// Every light samples its tile of the shadow atlas at `FORWARD_SHADOW_ATLAS_TEXTURE_SLOT`, same as in multi-pass lighting.
+// Masks are separate textures, so only first `MAX_FORWARD_LIGHT_MASKS` lights get a mask slot: their mask is bound at
+// `FORWARD_LIGHT_TEXTURE_SLOT + mask_slot`. The rest use the default mask and are looked up through light clusters, see light_clusters.h.
+//
+#define MAX_FORWARD_LIGHTS      128
+#define MAX_FORWARD_LIGHT_MASKS 6
+
+struct ForwardLight {
+	m4 world_to_light_matrix;
+
+	v3f position;
+	f32 intensity;
+
+	v4f shadow_uv_rect;
+
+	s32 mask_slot; // -1 if light uses the default mask
+	u32 _pad[3];
+};
+
+struct ForwardLightConstants {
+	ForwardLight lights[MAX_FORWARD_LIGHTS];
+	u32 light_count;
+};
+#define FORWARD_LIGHT_CONSTANTS_SLOT 8
+
+static_assert(sizeof(ForwardLightConstants) <= MAX_UNIFORM_BLOCK_SIZE, "lower MAX_FORWARD_LIGHTS");
+
+static_assert(MAX_FORWARD_LIGHTS <= MAX_CLUSTER_LIGHTS);
+
+#define FORWARD_SHADOW_ATLAS_TEXTURE_SLOT       0
+#define FORWARD_LIGHT_TEXTURE_SLOT              1
+#define FORWARD_DEFAULT_LIGHT_MASK_TEXTURE_SLOT 7
+
+// Shaders get slots as literals, so this one is not an expression
+static_assert(FORWARD_DEFAULT_LIGHT_MASK_TEXTURE_SLOT == FORWARD_LIGHT_TEXTURE_SLOT + MAX_FORWARD_LIGHT_MASKS);
+
+
 struct SurfaceConstants {
 	v4f color;
 };
@@ -79,6 +150,10 @@ struct AppData {
 	HashMap<Uid, ComponentInfo> component_infos;
 	HashMap<Span<utf8>, Uid>    component_name_to_uid;
 
+	// Uids of all components sorted by `execution_priority`, then by name. Rebuilt when a component is (re)registered.
+	List<Uid> component_execution_order;
+	bool component_execution_order_is_dirty = true;
+
 	xorshift64 uid_generator;
 
 	List<Scene *> scenes;
@@ -92,11 +167,42 @@ struct AppData {
 	f32 time;
 	u32 frame_index;
 
+	// Components updated and skipped by last `runtime_update`
+	u32 ticked_component_count;
+	u32 skipped_component_count;
+
+	//
+	// Fixed-step simulation. `runtime_simulate` calls `runtime_update` with `frame_time` set to `fixed_time_step`
+	// as many times as needed to catch up with real time, but no more than `max_substeps_per_frame`.
+	// Rendering interpolates between last two simulated states by `interpolation_alpha`.
+	//
+	bool use_fixed_time_step;
+	f32 fixed_time_step = 1 / 60.0f;
+	u32 max_substeps_per_frame = 4;
+	f32 simulation_time_accumulator;
+	f32 interpolation_alpha = 1;
+	u32 substep_count; // During last frame
+
 	Window *window;
 	bool did_resize = true;
 
+	JobSystem jobs;
+
 	tg::State *tg;
 
+	RenderQueue render_queue;
+	RenderStateTracker render_state;
+
+	// Mesh renderers that passed and failed frustum culling during last `runtime_render` and `render_camera` calls, summed over all passes
+	u32 visible_object_count;
+	u32 culled_object_count;
+
+	// Mesh renderers that passed frustum culling but were hidden by occluders, camera passes only
+	u32 occluded_object_count;
+
+	// Bytes of shader constants updated since the start of last `runtime_render`
+	umm uploaded_uniform_bytes;
+
 	tg::Texture2D *white_texture;
 	tg::Texture2D *black_texture;
 	tg::Texture2D *default_light_mask;
@@ -105,10 +211,46 @@ struct AppData {
 	tg::Shader *sky_box_shader;
 
 	tg::TypedShaderConstants<GlobalConstants> global_constants;
-	tg::TypedShaderConstants<EntityConstants> entity_constants;
-	tg::TypedShaderConstants<LightConstants> light_constants;
+	tg::TypedShaderConstants<EntityConstants> entity_constants; // For the editor. Renderer uses `entity_constants_ring`.
+	tg::TypedShaderConstants<ForwardLightConstants> forward_light_constants;
+	tg::TypedShaderConstants<LightClusterConstants> light_cluster_constants;
+
+	// Constants that change between draws. `EntityConstants`, `LightConstants` and `InstanceConstants`.
+	UniformRing entity_constants_ring;
+	UniformRing light_constants_ring;
+	UniformRing instance_constants_ring;
+	InstanceConstants instance_data; // Staging for `instance_constants_ring`, too big for the stack
+	LightClusterBinner light_cluster_binner;
+
+	// Draw every mesh once with all lights, instead of once per light.
+	// Meshes whose material has no `forward_shader` are drawn per light anyway.
+	bool use_single_pass_lighting = true;
+
+	// Lights without a mask slot are shaded only in clusters they reach, instead of everywhere
+	bool use_light_clusters = true;
+
+	// Draw renderers that share mesh, material and lightmap with one instanced draw call
+	bool use_instancing = true;
+
+	// Re-render shadow maps only when their light or casters changed
+	bool use_shadow_cache = true;
+	ShadowCache shadow_cache;
+
+	// Shadow maps of all lights. `shadow_atlas.size` sets memory use and quality of shadows.
+	ShadowAtlas shadow_atlas;
+
+	// Skip renderers hidden behind big nearby ones, tested against a depth buffer rasterized on the CPU
+	bool use_occlusion_culling = true;
+
+	// Draw simplified meshes when their error would be smaller than a pixel
+	bool use_lods = true;
+	OcclusionBuffer occlusion_buffer;
+
+	// Transient render targets of cameras and post effects
+	RenderTargetPool render_target_pool;
 
 	tg::Shader *shadow_map_shader;
+	tg::Shader *copy_depth_shader;
 
 	tg::TypedShaderConstants<HandleConstants> handle_constants;
 	tg::Shader *handle_shader;
@@ -1,5 +1,6 @@
 #include "assets.h"
 #include <t3d/app.h>
+#include <t3d/mesh_optimize.h>
 
 Span<u8> Assets::get_asset_data(Span<utf8> local_path) {
 	if (app->is_editor) {
@@ -128,10 +129,20 @@ TextureCube *Assets::get_texture_cube(Span<utf8> path) {
 	return result;
 }
 
-Mesh *Assets::create_mesh(tl::CommonMesh &mesh) {
+Mesh *Assets::create_mesh(tl::CommonMesh &mesh, Span<utf8> name) {
+	//
+	// Reorder for the GPU. Optimization is deterministic, so levels of detail from `data.bin` match the runtime's vertices.
+	//
+	auto vertices = with(temporary_allocator, copy(mesh.vertices));
+	auto indices = with(temporary_allocator, copy(mesh.indices));
+	auto report = optimize_mesh(vertices, indices);
+	print(Print_info, "Optimized mesh '{}': {}, index bytes {} -> {}.\n",
+		name, report, indices.count * sizeof(u32), indices.count * (vertices.count <= 0x10000 ? sizeof(u16) : sizeof(u32)));
+
 	Mesh result = {};
+	result.name.set(name);
 	result.vertex_buffer = app->tg->create_vertex_buffer(
-		as_bytes(mesh.vertices),
+		as_bytes(vertices),
 		{
 			tg::Element_f32x3, // position
 			tg::Element_f32x3, // normal
@@ -140,16 +151,29 @@ Mesh *Assets::create_mesh(tl::CommonMesh &mesh) {
 		}
 	);
 
-	result.index_buffer = app->tg->create_index_buffer(as_bytes(mesh.indices), sizeof(u32));
+	result.index_buffer = create_index_buffer(indices, (u32)vertices.count);
 
-	result.index_count = mesh.indices.count;
+	result.index_count = indices.count;
 
-	result.positions.reserve(mesh.vertices.count);
-	for (auto &vertex : mesh.vertices) {
+	result.positions.reserve(vertices.count);
+	for (auto &vertex : vertices) {
 		result.positions.add(vertex.position);
 	}
 
-	result.indices = copy(mesh.indices);
+	result.indices = copy(indices);
+
+	update_bounds(result);
+
+	bool has_lods = false;
+	if (auto found = mesh_name_to_lod_data.find(result.name)) {
+		has_lods = deserialize_lods(result, *found);
+		if (!has_lods) {
+			print(Print_warning, "Levels of detail of {} are corrupted, generating them again\n", result.name);
+		}
+	}
+	if (!has_lods) {
+		generate_lods(result);
+	}
 
 	auto added = meshes.add();
 	*added.pointer = result;
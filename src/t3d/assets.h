@@ -16,10 +16,13 @@ struct Assets {
 	HashMap<Span<utf8>, Scene3D *> scenes3d_by_name;
 	HashMap<Scene3D::Node *, Mesh *> meshes_by_node;
 
+	// Levels of detail from `data.bin`, by mesh name. Only used by the runtime, the editor simplifies meshes when they are loaded.
+	HashMap<Span<utf8>, Span<u8>> mesh_name_to_lod_data;
+
 	Span<u8> get_asset_data(Span<utf8> path);
 	Texture2D *get_texture_2d(Span<utf8> path);
 	TextureCube *get_texture_cube(Span<utf8> path);
-	Mesh *create_mesh(tl::CommonMesh &mesh);
+	Mesh *create_mesh(tl::CommonMesh &mesh, Span<utf8> name);
 
 	Mesh *get_mesh(Span<utf8> path) {
 		auto found = meshes_by_name.find(path);
@@ -60,13 +63,7 @@ struct Assets {
 					return mesh;
 				}
 
-				mesh = create_mesh(*node->mesh);
-
-
-				mesh->name.reserve(scene_path.count + 1 + submesh_name.count);
-				mesh->name.add(scene_path);
-				mesh->name.add(':');
-				mesh->name.add(submesh_name);
+				mesh = create_mesh(*node->mesh, path);
 				meshes_by_name.get_or_insert(mesh->name) = mesh;
 				return mesh;
 			} else {
@@ -79,8 +76,8 @@ struct Assets {
 					return 0;
 				}
 
-				auto result = create_mesh(parse_result.meshes[0]);
-				meshes_by_name.get_or_insert(path) = result;
+				auto result = create_mesh(parse_result.meshes[0], path);
+				meshes_by_name.get_or_insert(result->name) = result;
 				return result;
 			}
 		}
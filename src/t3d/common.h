@@ -34,6 +34,9 @@ inline bool operator==(std::source_location a, std::source_location b) {
 using Texture2D   = tg::Texture2D;
 using TextureCube = tg::TextureCube;
 
+// Smallest GL_MAX_UNIFORM_BLOCK_SIZE allowed by GL. Bigger uniform blocks may fail to link on some drivers.
+#define MAX_UNIFORM_BLOCK_SIZE 16384
+
 inline Optional<f32> parse_f32(Span<utf8> string) {
 	if (!string.count)
 		return {};
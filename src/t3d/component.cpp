@@ -4,20 +4,21 @@
 #include <t3d/components/light.h>
 #include <t3d/components/mesh_renderer.h>
 #include <tl/thread.h>
+#include <tl/profiler.h>
+#include <bit>
 
 ComponentStorage::ComponentStorage() {
 	blocks.allocator = allocator;
+	unfull_block_indices.allocator = allocator;
 }
 
 ComponentStorage::Added ComponentStorage::add() {
 	Added result;
 
-	for (u32 block_index = 0; block_index < blocks.count; block_index += 1) {
+	if (unfull_block_indices.count) {
+		auto block_index = unfull_block_indices.back();
 		auto block = blocks[block_index];
-		if (block->unfull_mask_count == 0)
-			continue;
 
-		// Search for free space in current block
 		for (u32 mask_index = 0; mask_index < masks_per_block; mask_index += 1) {
 			auto &mask = block->masks[mask_index];
 
@@ -28,24 +29,35 @@ ComponentStorage::Added ComponentStorage::add() {
 			auto value_index = (mask_index * bits_in_mask) + bit_index;
 
 			mask |= (Mask)1 << bit_index;
+			block->value_count += 1;
+			block->generations[value_index] = next_generation++;
 
-			if (mask == ~0)
+			if (mask == ~0) {
 				block->unfull_mask_count -= 1;
+				if (block->unfull_mask_count == 0) {
+					unfull_block_indices.pop();
+				}
+			}
 
 			result.pointer = (u8 *)block->values + value_index * bytes_per_entry;
 			result.index = block_index * values_per_block + value_index;
 			return result;
 		}
+
+		invalid_code_path("block in `unfull_block_indices` has no free space");
 	}
 
 	auto block = allocator.allocate<Block>();
 	block->values = allocator.allocate_uninitialized(bytes_per_entry * values_per_block, entry_alignment);
 
 	block->masks[0] = 1;
+	block->value_count = 1;
+	block->generations[0] = next_generation++;
 
 	result.index = blocks.count * values_per_block;
 	result.pointer = block->values;
 
+	unfull_block_indices.add((u32)blocks.count);
 	blocks.add(block);
 
 	return result;
@@ -63,10 +75,20 @@ void ComponentStorage::remove_at(umm index) {
 	auto mask = block->masks[mask_index];
 	bounds_check(mask & ((Mask)1 << bit_index), "attempt to remove non-existant component");
 	if (mask == ~0) {
+		if (block->unfull_mask_count == 0) {
+			unfull_block_indices.add((u32)block_index);
+		}
 		block->unfull_mask_count += 1;
 	}
 	mask &= ~((Mask)1 << bit_index);
 	block->masks[mask_index] = mask;
+	block->value_count -= 1;
+
+	auto &sleeping_mask = block->sleeping_masks[mask_index];
+	if (sleeping_mask & ((Mask)1 << bit_index)) {
+		sleeping_mask &= ~((Mask)1 << bit_index);
+		block->sleeping_count -= 1;
+	}
 }
 
 void *ComponentStorage::get(umm index) {
@@ -93,12 +115,153 @@ void ComponentStorage::reallocate(u32 new_size, u32 new_alignment) {
 	}
 }
 
+void ComponentStorage::set_sleeping(umm index, bool sleeping) {
+	auto block_index = index / values_per_block;
+	auto value_index = index % values_per_block;
+
+	auto mask_index = value_index / bits_in_mask;
+	auto bit = (Mask)1 << (value_index % bits_in_mask);
+
+	auto &block = blocks[block_index];
+	bounds_check(block->masks[mask_index] & bit, "attempt to put non-existant component to sleep");
+
+	auto &sleeping_mask = block->sleeping_masks[mask_index];
+	if (sleeping == ((sleeping_mask & bit) != 0))
+		return;
+
+	if (sleeping) {
+		sleeping_mask |= bit;
+		block->sleeping_count += 1;
+	} else {
+		sleeping_mask &= ~bit;
+		block->sleeping_count -= 1;
+	}
+}
+
+bool ComponentStorage::is_sleeping(umm index) {
+	auto block_index = index / values_per_block;
+	auto value_index = index % values_per_block;
+
+	auto &block = blocks[block_index];
+	return (block->sleeping_masks[value_index / bits_in_mask] >> (value_index % bits_in_mask)) & 1;
+}
+
+ComponentStorage::Stats ComponentStorage::get_stats() {
+	Stats result = {};
+	result.block_count = (u32)blocks.count;
+	for (auto block : blocks) {
+		result.value_count += block->value_count;
+		if (block->value_count == 0) {
+			result.empty_block_count += 1;
+		}
+	}
+
+	result.minimal_block_count = (result.value_count + values_per_block - 1) / values_per_block;
+	result.allocated_bytes = blocks.count * (sizeof(Block) + bytes_per_entry * values_per_block);
+
+	if (result.block_count) {
+		result.occupancy = (f32)result.value_count / (result.block_count * values_per_block);
+		result.fragmentation = 1 - (f32)result.minimal_block_count / result.block_count;
+	} else {
+		result.occupancy = 1;
+		result.fragmentation = 0;
+	}
+	return result;
+}
+
+List<ComponentStorage::Move> ComponentStorage::compact() {
+	List<Move> moves;
+
+	u32 value_count = 0;
+	for (auto block : blocks) {
+		value_count += block->value_count;
+	}
+
+	auto is_set = [&](u32 index) {
+		auto block = blocks[index / values_per_block];
+		auto value_index = index % values_per_block;
+		return (block->masks[value_index / bits_in_mask] >> (value_index % bits_in_mask)) & 1;
+	};
+	auto set_bit = [&](Mask Block::*masks, u32 index, bool value) {
+		auto block = blocks[index / values_per_block];
+		auto value_index = index % values_per_block;
+		auto &mask = (block->*masks)[value_index / bits_in_mask];
+		auto bit = (Mask)1 << (value_index % bits_in_mask);
+		if (value) mask |= bit;
+		else       mask &= ~bit;
+	};
+
+	//
+	// After compaction values occupy slots [0, value_count).
+	// Every value at or past `value_count` fills the lowest free slot before it.
+	// Their amounts match, so the two cursors meet at `value_count`.
+	//
+	u32 hole = 0;
+	u32 source = value_count;
+	u32 end = (u32)blocks.count * values_per_block;
+	while (1) {
+		while (hole < value_count && is_set(hole))
+			hole += 1;
+		while (source < end && !is_set(source))
+			source += 1;
+
+		if (hole == value_count || source == end) {
+			assert(hole == value_count && source == end);
+			break;
+		}
+
+		memcpy(
+			(u8 *)blocks[hole   / values_per_block]->values + (hole   % values_per_block) * bytes_per_entry,
+			(u8 *)blocks[source / values_per_block]->values + (source % values_per_block) * bytes_per_entry,
+			bytes_per_entry
+		);
+		blocks[hole / values_per_block]->generations[hole % values_per_block] = blocks[source / values_per_block]->generations[source % values_per_block];
+		set_bit(&Block::masks, hole, true);
+		set_bit(&Block::masks, source, false);
+
+		// Sleeping state moves with the value
+		set_bit(&Block::sleeping_masks, hole, is_sleeping(source));
+		set_bit(&Block::sleeping_masks, source, false);
+
+		moves.add({source, hole});
+	}
+
+	// Free blocks that are empty now
+	u32 new_block_count = (value_count + values_per_block - 1) / values_per_block;
+	while (blocks.count > new_block_count) {
+		auto block = blocks.pop();
+		allocator.free(block->values);
+		allocator.free(block);
+	}
+
+	// Rebuild bookkeeping
+	unfull_block_indices.clear();
+	for (u32 block_index = 0; block_index < blocks.count; block_index += 1) {
+		auto block = blocks[block_index];
+		block->value_count = min(values_per_block, value_count - block_index * values_per_block);
+		block->unfull_mask_count = 0;
+		block->sleeping_count = 0;
+		for (u32 mask_index = 0; mask_index < masks_per_block; mask_index += 1) {
+			if (block->masks[mask_index] != ~0) {
+				block->unfull_mask_count += 1;
+			}
+			block->sleeping_count += (u32)std::popcount(block->sleeping_masks[mask_index]);
+		}
+		if (block->unfull_mask_count) {
+			unfull_block_indices.add(block_index);
+		}
+	}
+
+	return moves;
+}
+
 void free(ComponentStorage &storage) {
 	for (auto &block : storage.blocks) {
 		storage.allocator.free(block->values);
 		storage.allocator.free(block);
 	}
 	free(storage.blocks);
+	free(storage.unfull_block_indices);
 }
 
 ComponentInfo &get_component_info(Uid uid) {
@@ -112,3 +275,119 @@ ComponentInfo &component_infos_get_or_insert(Uid uid) {
 Uid component_name_to_uid(Span<utf8> name) {
 	return app->component_name_to_uid.find(name).get();
 }
+
+void set_fields(ComponentInfo &info, Span<ComponentField> fields) {
+	umm string_count = 0;
+	for (auto field : fields) {
+		string_count += field.name.count + field.type.count;
+	}
+
+	// Reserve everything upfront so spans into `field_strings` are not invalidated
+	info.field_strings.clear();
+	info.field_strings.reserve(string_count);
+
+	auto copy_string = [&](Span<utf8> string) {
+		auto result = Span(info.field_strings.data + info.field_strings.count, string.count);
+		for (auto c : string) {
+			info.field_strings.add(c);
+		}
+		return result;
+	};
+
+	info.fields.clear();
+	for (auto field : fields) {
+		info.fields.add({
+			.name = copy_string(field.name),
+			.type = copy_string(field.type),
+			.offset = field.offset,
+			.size = field.size,
+		});
+	}
+}
+
+bool layout_is_same(ComponentInfo &info, ComponentDesc const &desc) {
+	// Members that are not in FIELDS are not described, so there is no telling if their types changed
+	if (desc.described_size != desc.size)
+		return false;
+
+	if (info.size != desc.size || info.alignment != desc.alignment || info.fields.count != desc.fields.count)
+		return false;
+
+	for (umm i = 0; i < info.fields.count; ++i) {
+		auto &a = info.fields[i];
+		auto &b = desc.fields[i];
+		if (a.name != b.name || a.type != b.type || a.offset != b.offset || a.size != b.size)
+			return false;
+	}
+	return true;
+}
+
+void migrate(ComponentStorage &storage, ComponentInfo const &old_info, ComponentDesc const &new_desc) {
+	timed_function();
+
+	struct FieldCopy {
+		u32 from;
+		u32 to;
+		u32 size;
+	};
+
+	List<FieldCopy> copies;
+	copies.allocator = temporary_allocator;
+
+	for (auto new_field : new_desc.fields) {
+		for (auto old_field : old_info.fields) {
+			if (old_field.name != new_field.name)
+				continue;
+
+			if (old_field.type == new_field.type && old_field.size == new_field.size) {
+				copies.add({old_field.offset, new_field.offset, new_field.size});
+			} else {
+				print(Print_warning, "Type of {}.{} changed from '{}' to '{}', resetting it to default\n", new_desc.name, new_field.name, old_field.type, new_field.type);
+			}
+			break;
+		}
+	}
+
+	auto old_size = storage.bytes_per_entry;
+
+	// Copied fields are moved to the new value. Old value gets defaults in their place, so `free` releases only the rest.
+	u8 *old_defaults = 0;
+	if (old_info.free) {
+		old_defaults = (u8 *)temporary_allocator.allocate_uninitialized(old_size, storage.entry_alignment);
+		old_info.construct(old_defaults);
+	}
+
+	for (auto block : storage.blocks) {
+		auto old_values = (u8 *)block->values;
+		auto new_values = (u8 *)storage.allocator.allocate_uninitialized(new_desc.size * ComponentStorage::values_per_block, new_desc.alignment);
+
+		storage.for_each_in_block(block, [&](void *old_value) {
+			auto value_index = ((u8 *)old_value - old_values) / old_size;
+			auto new_value = new_values + value_index * new_desc.size;
+
+			new_desc.construct(new_value);
+
+			// Scene and entity links
+			memcpy(new_value, old_value, sizeof(Component));
+
+			for (auto copy : copies) {
+				memcpy(new_value + copy.to, (u8 *)old_value + copy.from, copy.size);
+			}
+			if (old_defaults) {
+				for (auto copy : copies) {
+					memcpy((u8 *)old_value + copy.from, old_defaults + copy.from, copy.size);
+				}
+				old_info.free(old_value);
+			}
+			if (new_desc.init) {
+				new_desc.init(new_value);
+			}
+		});
+
+		storage.allocator.free(old_values);
+		block->values = new_values;
+	}
+
+	storage.bytes_per_entry = new_desc.size;
+	storage.entry_alignment = new_desc.alignment;
+}
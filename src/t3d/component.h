@@ -8,22 +8,46 @@
 
 using namespace tl;
 
+//
+// Stable reference to an entity.
+// `generation` is bumped every time the slot is freed, so handles to destroyed entities can be detected.
+// Generation 0 is never used, so zero-initialized handle is invalid.
+//
+struct EntityHandle {
+	u32 index;
+	u32 generation;
+};
+
+inline bool operator==(EntityHandle const &a, EntityHandle const &b) { return a.index == b.index && a.generation == b.generation; }
+inline bool operator!=(EntityHandle const &a, EntityHandle const &b) { return !(a == b); }
+
+// For hash map keys
+inline u64 to_u64(EntityHandle handle) { return ((u64)handle.index << 32) | handle.generation; }
+
+inline umm append(StringBuilder &builder, EntityHandle handle) {
+	return append_format(builder, "{}:{}", handle.index, handle.generation);
+}
+
 struct ComponentIndex {
 	Uid type_uid;
 	struct Scene *scene;
 	u32 storage_index;
-	u32 entity_index;
+	EntityHandle entity;
 
+	// Not memcmp, padding at the end is not initialized
 	bool operator==(ComponentIndex const &that) const {
-		return memcmp(this, &that, sizeof(*this)) == 0;
+		return type_uid.value == that.type_uid.value && scene == that.scene && storage_index == that.storage_index && entity == that.entity;
 	}
 };
 
 struct Entity;
 
 struct Component {
-	Entity *_entity;
-	Entity &entity() { return *_entity; }
+	struct Scene *_scene;
+	EntityHandle _entity;
+
+	// Defined in scene.h
+	Entity &entity();
 
 	//
 	// These functions are not called and only needed to check if derived component overrides them
@@ -43,57 +67,149 @@ struct ComponentStorage {
 
 	struct Block {
 		umm unfull_mask_count = masks_per_block;
+		u32 value_count = 0;
+		u32 sleeping_count = 0;
 		void *values;
 		Mask masks[masks_per_block];
+
+		// Sleeping values are skipped by update, see tick_scheduler.h
+		Mask sleeping_masks[masks_per_block] = {};
+
+		// Taken from `next_generation` when a value is added and moved with it by `compact`.
+		// Tells a value apart from one that was removed and added again in the same slot.
+		u32 generations[values_per_block];
 	};
 
 	Allocator allocator = default_allocator;
 	u32 bytes_per_entry = 0;
 	u32 entry_alignment = 0;
+	u32 next_generation = 1;
 	List<Block *> blocks;
 
+	// Indices of blocks that have at least one free slot. Lets `add` skip full blocks without scanning.
+	List<u32> unfull_block_indices;
+
 	struct Added {
 		void *pointer;
 		u32 index;
 	};
 
+	struct Stats {
+		u32 value_count;
+		u32 block_count;
+		u32 empty_block_count;
+		u32 minimal_block_count; // If all values were packed together
+		umm allocated_bytes;
+		f32 occupancy;     // Fraction of allocated slots that are in use
+		f32 fragmentation; // Fraction of blocks that `compact` would free
+	};
+
+	struct Move {
+		u32 from;
+		u32 to;
+	};
+
 	ComponentStorage();
 	Added add();
 	void remove_at(umm index);
 	void *get(umm index);
 	void reallocate(u32 new_size, u32 new_alignment);
 
+	void set_sleeping(umm index, bool sleeping);
+	bool is_sleeping(umm index);
+
+	Stats get_stats();
+
+	//
+	// Moves values from the end into free slots at the start and frees blocks that become empty.
+	// Values are relocated with memcpy, same as in `reallocate`.
+	// Returned list is allocated with `current_allocator`, owners should use it to fix up their indices.
+	//
+	List<Move> compact();
+
+	// Returns false if iteration was stopped by `fn`
 	template <class Fn>
-	void for_each(Fn &&fn) {
+	bool for_each_in_block(Block *block, Fn &&fn, bool awake_only = false) {
 		using FnRet = decltype(fn((void*)0));
 
-		for (auto block : blocks) {
-			if (block->unfull_mask_count == 0)
-				continue;
+		for (u32 mask_index = 0; mask_index < masks_per_block; mask_index += 1) {
+			auto mask = block->masks[mask_index];
+			if (awake_only) {
+				mask &= ~block->sleeping_masks[mask_index];
+			}
 
-			u32 mask_index = 0;
-			for (u32 mask_index = 0; mask_index < masks_per_block; mask_index += 1) {
-				auto &mask = block->masks[mask_index];
-				if (mask == 0)
-					continue;
-				for (u32 bit_index = 0; bit_index != bits_in_mask; bit_index += 1) {
-					if (mask & ((Mask)1 << bit_index)) {
-						auto value = (u8 *)block->values + bytes_per_entry * (mask_index * bits_in_mask + bit_index);
-
-						if constexpr (is_same<FnRet, void>) {
-							fn(value);
-						} else if constexpr (is_same<FnRet, ForEachDirective>) {
-							if (fn(value) == ForEach_break) {
-								return;
-							}
-						} else {
-							static_assert(false, "iteration function must return either void or ForEachDirective (use for_each_continue/for_each_break macros for that)");
-						}
+			// Jump straight to set bits instead of testing each of them
+			while (mask) {
+				auto bit_index = find_lowest_one_bit(mask);
+				mask &= mask - 1;
+
+				auto value = (u8 *)block->values + bytes_per_entry * (mask_index * bits_in_mask + bit_index);
+
+				if constexpr (is_same<FnRet, void>) {
+					fn(value);
+				} else if constexpr (is_same<FnRet, ForEachDirective>) {
+					if (fn(value) == ForEach_break) {
+						return false;
 					}
+				} else {
+					static_assert(false, "iteration function must return either void or ForEachDirective (use for_each_continue/for_each_break macros for that)");
 				}
-				++mask_index;
 			}
 		}
+		return true;
+	}
+
+	// Calls `fn(first, count)` for every run of consecutive values in the block
+	template <class Fn>
+	void for_each_run_in_block(Block *block, Fn &&fn, bool awake_only = false) {
+		u32 run_start = 0;
+		u32 run_count = 0;
+
+		for (u32 mask_index = 0; mask_index < masks_per_block; mask_index += 1) {
+			auto mask = block->masks[mask_index];
+			if (awake_only) {
+				mask &= ~block->sleeping_masks[mask_index];
+			}
+
+			while (mask) {
+				u32 bit_index = find_lowest_one_bit(mask);
+				auto shifted = mask >> bit_index;
+
+				u32 length = ~shifted == 0 ? bits_in_mask - bit_index : find_lowest_zero_bit(shifted);
+				if (bit_index + length == bits_in_mask) {
+					mask = 0;
+				} else {
+					mask &= ~(Mask)0 << (bit_index + length);
+				}
+
+				u32 value_index = mask_index * bits_in_mask + bit_index;
+				if (run_count && run_start + run_count == value_index) {
+					// Run continues from previous mask
+					run_count += length;
+				} else {
+					if (run_count) {
+						fn((u8 *)block->values + bytes_per_entry * run_start, run_count);
+					}
+					run_start = value_index;
+					run_count = length;
+				}
+			}
+		}
+
+		if (run_count) {
+			fn((u8 *)block->values + bytes_per_entry * run_start, run_count);
+		}
+	}
+
+	template <class Fn>
+	void for_each(Fn &&fn) {
+		for (auto block : blocks) {
+			if (block->value_count == 0)
+				continue;
+
+			if (!for_each_in_block(block, fn))
+				return;
+		}
 	}
 };
 
@@ -107,8 +223,17 @@ using ComponentConstruct         = void(*)(void *component);
 using ComponentInit              = void(*)(void *component);
 using ComponentStart             = void(*)(void *component);
 using ComponentUpdate            = void(*)(void *component);
+using ComponentUpdateBatch       = void(*)(void *components, u32 count);
 using ComponentFree              = void(*)(void *component);
 
+// Describes a field declared with `FIELDS`. Used to carry values over when layout of a component changes.
+struct ComponentField {
+	Span<utf8> name;
+	Span<utf8> type;
+	u32 offset;
+	u32 size;
+};
+
 struct ComponentDesc {
 	ComponentSerialize serialize;
 	ComponentDeserializeText deserialize_text;
@@ -118,10 +243,24 @@ struct ComponentDesc {
 	ComponentInit init;
 	ComponentStart start;
 	ComponentUpdate update;
+	ComponentUpdateBatch update_batch;
 	ComponentFree free;
 	Span<utf8> name;
 	u32 size;
 	u32 alignment;
+	Span<ComponentField> fields;
+
+	// Size of `Component` and fields. Less than `size` if the type has members that are not in FIELDS.
+	u32 described_size;
+
+	// `update` does not touch other components or entities, so storage blocks can be updated on different threads
+	bool parallel_safe;
+
+	// Seconds between updates. 0 means every frame.
+	f32 tick_interval;
+
+	// Components with lower priority are updated first. Ties are broken by name.
+	s32 execution_priority;
 };
 
 struct ComponentInfo {
@@ -133,16 +272,51 @@ struct ComponentInfo {
 	ComponentInit init;
 	ComponentStart start;
 	ComponentUpdate update;
+	ComponentUpdateBatch update_batch;
 	ComponentFree free;
 	List<utf8> name;
 	u32 size;
 	u32 alignment;
+	bool parallel_safe;
+
+	// Copy of `ComponentDesc::fields`. Strings point into `field_strings`, so they stay valid after the scripts dll is unloaded.
+	List<ComponentField> fields;
+	List<utf8> field_strings;
+
+	f32 tick_interval;
+	s32 execution_priority;
+
+	// Stats of last `runtime_update`
+	f32 update_time; // In seconds
+	u32 ticked_count;
+	u32 skipped_count; // Sleeping components
 };
 
 ComponentInfo &get_component_info(Uid uid);
+
+void set_fields(ComponentInfo &info, Span<ComponentField> fields);
+
+// True if values laid out as `info` can be used as is by code that was compiled with `desc`.
+// Only types whose every member is in FIELDS can be compared, others are never the same.
+bool layout_is_same(ComponentInfo &info, ComponentDesc const &desc);
+
+//
+// Moves values of `storage` to the layout of `new_desc`. Values are constructed with `new_desc.construct`,
+// then base `Component` and every field with the same name, type and size is moved from the old value.
+// Old values are freed with `old_info.free`, so code of the old type must still be loaded.
+// `new_desc.init` is called after copying to recreate resources that are not fields.
+//
+void migrate(ComponentStorage &storage, ComponentInfo const &old_info, ComponentDesc const &new_desc);
 ComponentInfo &component_infos_get_or_insert(Uid uid);
 Uid component_name_to_uid(Span<utf8> name);
 
+// Uids of registered components don't change, so they are looked up once per type
+template <class T>
+Uid get_component_uid() {
+	static Uid uid = component_name_to_uid(T::_t3d_component_name);
+	return uid;
+}
+
 template <class Component>
 void adapt_component_serializer(StringBuilder &builder, void *component, bool binary) {
 	return ((Component *)component)->serialize(builder, binary);
@@ -206,6 +380,10 @@ if (binary) { \
 }
 
 
+#define DESCRIBE_FIELD(type, name, default) \
+{u8#name##s, u8#type##s, (u32)offsetof(_t3d_self, name), (u32)sizeof(type)},
+
+
 #define DRAW_FIELD(type, name, default) \
 draw_property(u8#name##s, name); \
 
@@ -264,7 +442,13 @@ struct ComponentT; \
 template <> \
 struct ComponentBase<ComponentT> : Component { \
 	inline static Span<utf8> _t3d_component_name = u8#ComponentT##s; \
+	using _t3d_self = ComponentBase<ComponentT>; \
 	FIELDS(DECLARE_FIELD) \
+	static Span<ComponentField> _t3d_fields() { \
+		/* Last element is there so the array is not empty */ \
+		static ComponentField fields[] = { FIELDS(DESCRIBE_FIELD) {} }; \
+		return Span(fields, count_of(fields) - 1); \
+	} \
 	void serialize(StringBuilder &builder, bool binary) { \
 		FIELDS(SERIALIZE_FIELD) \
 	} \
@@ -300,11 +484,22 @@ extern "C" __declspec(dllexport) ComponentDesc t3dcd##ComponentT() { \
 	desc.name = u8#ComponentT##s; \
 	desc.size      = sizeof(ComponentT); \
 	desc.alignment = alignof(ComponentT); \
+	desc.fields    = ComponentT::_t3d_fields(); \
+	desc.described_size = sizeof(ComponentBase<ComponentT>); \
 	desc.serialize          = adapt_component_serializer<ComponentT>; \
 	desc.deserialize_text   = adapt_component_deserializer_text<ComponentT>; \
 	desc.deserialize_binary = adapt_component_deserializer_binary<ComponentT>; \
 	desc.draw_properties    = adapt_component_property_drawer<ComponentT>; \
 	desc.construct          = adapt_component_construct<ComponentT>; \
+	if constexpr (requires { ComponentT::parallel_safe; }) { \
+		desc.parallel_safe = ComponentT::parallel_safe; \
+	} \
+	if constexpr (requires { ComponentT::tick_interval; }) { \
+		desc.tick_interval = ComponentT::tick_interval; \
+	} \
+	if constexpr (requires { ComponentT::execution_priority; }) { \
+		desc.execution_priority = ComponentT::execution_priority; \
+	} \
 	if constexpr (is_statically_overridden(init, ComponentT, ::Component)) { \
 		desc.init = [](void *component) { ((ComponentT *)component)->init(); }; \
 	} \
@@ -314,6 +509,9 @@ extern "C" __declspec(dllexport) ComponentDesc t3dcd##ComponentT() { \
 	if constexpr (is_statically_overridden(update, ComponentT, ::Component)) { \
 		desc.update = [](void *component) { ((ComponentT *)component)->update(); }; \
 	} \
+	if constexpr (requires (ComponentT *items, u32 count) { ComponentT::update_batch(items, count); }) { \
+		desc.update_batch = [](void *components, u32 count) { ComponentT::update_batch((ComponentT *)components, count); }; \
+	} \
 	if constexpr (is_statically_overridden(free, ComponentT, ::Component)) { \
 		desc.free = [](void *component) { ((ComponentT *)component)->free(); }; \
 	} \
@@ -10,8 +10,8 @@ F(f32, far_plane,  100.0f) \
 DECLARE_COMPONENT(Camera) {
 	m4 world_to_camera_matrix;
 
-	tg::RenderTarget *source_target;
-	tg::RenderTarget *destination_target;
+	// Final image. Scene and post effects in between draw into transient targets, see render_graph.h
+	tg::RenderTarget *output_target;
 	List<PostEffect> post_effects;
 
 	template <class Effect>
@@ -21,8 +21,7 @@ DECLARE_COMPONENT(Camera) {
 		effect.data = effect.allocator.allocate<Effect>();
 		effect._init   = post_effect_init<Effect>;
 		effect._free   = post_effect_free<Effect>;
-		effect._render = post_effect_render<Effect>;
-		effect._resize = post_effect_resize<Effect>;
+		effect._add_passes = post_effect_add_passes<Effect>;
 		effect.init();
 		post_effects.add(effect);
 		return *(Effect *)effect.data;
@@ -1,7 +1,11 @@
 #pragma once
 #include <t3d/app.h>
 
-u32 const shadow_map_resolution = 256;
+f32 const light_near_plane = 0.1f;
+f32 const light_far_plane = 100.0f;
+
+// Attenuation below which light is considered to have no effect
+f32 const min_light_attenuation = 0.01f;
 
 #define FIELDS(F) \
 F(f32,             intensity, 100) \
@@ -9,17 +13,14 @@ F(f32,             fov,       pi/2) \
 F(tg::Texture2D *, mask,      0)
 
 DECLARE_COMPONENT(Light) {
-	tg::RenderTarget *shadow_map;
-
+	// Set by `runtime_render` every frame
 	m4 world_to_light_matrix;
-
-	void init() {
-		auto depth = app->tg->create_texture_2d(shadow_map_resolution, shadow_map_resolution, 0, tg::Format_depth);
-		shadow_map = app->tg->create_render_target(0, depth);
-	}
-	void free() {
-		//app->tg->free(shadow_map);
-	}
+	v4f shadow_uv_rect; // Tile of this light in `app->shadow_atlas`, see `get_uv_rect`. Zero size if light has no shadow map.
 };
 
+// Distance at which attenuation `intensity / (distance + 1)^2` drops below `min_light_attenuation`. Shadow frustum ends at `light_far_plane` anyway.
+inline f32 get_light_range(Light &light) {
+	return clamp(sqrtf(max(light.intensity, 0.0f) / min_light_attenuation) - 1, 0.0f, light_far_plane);
+}
+
 #undef FIELDS
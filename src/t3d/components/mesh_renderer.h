@@ -10,6 +10,9 @@ f(tg::Texture2D *, lightmap, 0) \
 
 DECLARE_COMPONENT(MeshRenderer) {
 	Material *material = 0;
+
+	// Index into `mesh->lods`, picked by the last camera that saw this renderer
+	u32 lod = 0;
 };
 
 #undef FIELDS
@@ -0,0 +1,164 @@
+#include "culling.h"
+#include <t3d/scene.h>
+#include <t3d/app.h>
+#include <t3d/components/mesh_renderer.h>
+#include <tl/profiler.h>
+#include <immintrin.h>
+
+void free(SceneBounds &bounds) {
+	free(bounds.renderers);
+	free(bounds.meshes);
+	free(bounds.entity_indices);
+	free(bounds.changed);
+	free(bounds.center_x);
+	free(bounds.center_y);
+	free(bounds.center_z);
+	free(bounds.extent_x);
+	free(bounds.extent_y);
+	free(bounds.extent_z);
+}
+
+Frustum get_frustum(m4 const &world_to_clip) {
+	// Matrices are column-major
+	auto m = (f32 const *)&world_to_clip;
+	auto row = [&](u32 i) { return v4f{m[i], m[4 + i], m[8 + i], m[12 + i]}; };
+
+	auto x = row(0);
+	auto y = row(1);
+	auto z = row(2);
+	auto w = row(3);
+
+	// -w <= z is also right for [0, w] depth range, just a bit conservative
+	Frustum result;
+	result.planes[0] = w + x;
+	result.planes[1] = w - x;
+	result.planes[2] = w + y;
+	result.planes[3] = w - y;
+	result.planes[4] = w + z;
+	result.planes[5] = w - z;
+	return result;
+}
+
+// Box that contains transformed `box`
+static void transform_box(m4 const &local_to_world, aabb<v3f> box, SceneBounds &bounds, u32 index) {
+	auto m = (f32 const *)&local_to_world;
+	auto c = (box.min + box.max) * 0.5f;
+	auto e = (box.max - box.min) * 0.5f;
+
+	bounds.center_x[index] = m[0] * c.x + m[4] * c.y + m[ 8] * c.z + m[12];
+	bounds.center_y[index] = m[1] * c.x + m[5] * c.y + m[ 9] * c.z + m[13];
+	bounds.center_z[index] = m[2] * c.x + m[6] * c.y + m[10] * c.z + m[14];
+
+	bounds.extent_x[index] = fabsf(m[0]) * e.x + fabsf(m[4]) * e.y + fabsf(m[ 8]) * e.z;
+	bounds.extent_y[index] = fabsf(m[1]) * e.x + fabsf(m[5]) * e.y + fabsf(m[ 9]) * e.z;
+	bounds.extent_z[index] = fabsf(m[2]) * e.x + fabsf(m[6]) * e.y + fabsf(m[10]) * e.z;
+}
+
+void update_world_bounds(Scene &scene) {
+	timed_function();
+
+	auto &bounds = scene.bounds;
+	auto &transforms = scene.transforms;
+
+	auto previous_count = (u32)bounds.renderers.count;
+	u32 count = 0;
+
+	scene.for_each_component<MeshRenderer>([&](MeshRenderer &renderer) {
+		if (!renderer.mesh)
+			return;
+
+		auto entity_index = renderer.entity().handle.index;
+		auto index = count++;
+
+		if (index < previous_count) {
+			if (bounds.renderers[index] == &renderer && bounds.meshes[index] == renderer.mesh && bounds.entity_indices[index] == entity_index && !transforms.changed[entity_index]) {
+				bounds.changed[index] = false;
+				return;
+			}
+
+			bounds.renderers[index] = &renderer;
+			bounds.meshes[index] = renderer.mesh;
+			bounds.entity_indices[index] = entity_index;
+			bounds.changed[index] = true;
+		} else {
+			bounds.renderers.add(&renderer);
+			bounds.meshes.add(renderer.mesh);
+			bounds.entity_indices.add(entity_index);
+			bounds.changed.add(true);
+		}
+
+		auto padded_count = (index + 4) & ~3u;
+		if (bounds.center_x.count < padded_count) {
+			bounds.center_x.resize(padded_count);
+			bounds.center_y.resize(padded_count);
+			bounds.center_z.resize(padded_count);
+			bounds.extent_x.resize(padded_count);
+			bounds.extent_y.resize(padded_count);
+			bounds.extent_z.resize(padded_count);
+		}
+
+		transform_box(transforms.local_to_world[entity_index], renderer.mesh->bounds, bounds, index);
+	});
+
+	bounds.renderers.resize(count);
+	bounds.meshes.resize(count);
+	bounds.entity_indices.resize(count);
+	bounds.changed.resize(count);
+}
+
+void cull(SceneBounds &bounds, Frustum const &frustum, List<u32> &visible) {
+	timed_function();
+
+	struct Plane {
+		__m128 x, y, z, w;
+		__m128 abs_x, abs_y, abs_z;
+	};
+
+	Plane planes[Frustum::plane_count];
+	for (u32 i = 0; i < Frustum::plane_count; ++i) {
+		auto p = frustum.planes[i];
+		planes[i] = {
+			.x = _mm_set1_ps(p.x),
+			.y = _mm_set1_ps(p.y),
+			.z = _mm_set1_ps(p.z),
+			.w = _mm_set1_ps(p.w),
+			.abs_x = _mm_set1_ps(fabsf(p.x)),
+			.abs_y = _mm_set1_ps(fabsf(p.y)),
+			.abs_z = _mm_set1_ps(fabsf(p.z)),
+		};
+	}
+
+	auto count = (u32)bounds.renderers.count;
+	auto first_visible = visible.count;
+	auto zero = _mm_setzero_ps();
+
+	for (u32 i = 0; i < count; i += 4) {
+		auto cx = _mm_loadu_ps(bounds.center_x.data + i);
+		auto cy = _mm_loadu_ps(bounds.center_y.data + i);
+		auto cz = _mm_loadu_ps(bounds.center_z.data + i);
+		auto ex = _mm_loadu_ps(bounds.extent_x.data + i);
+		auto ey = _mm_loadu_ps(bounds.extent_y.data + i);
+		auto ez = _mm_loadu_ps(bounds.extent_z.data + i);
+
+		// Box is outside if it is fully behind any plane
+		auto outside = zero;
+		for (auto &plane : planes) {
+			auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane.x, cx), _mm_mul_ps(plane.y, cy)), _mm_add_ps(_mm_mul_ps(plane.z, cz), plane.w));
+			auto radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane.abs_x, ex), _mm_mul_ps(plane.abs_y, ey)), _mm_mul_ps(plane.abs_z, ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		u32 inside_mask = ~(u32)_mm_movemask_ps(outside) & 0xf;
+		while (inside_mask) {
+			auto bit_index = find_lowest_one_bit(inside_mask);
+			inside_mask &= inside_mask - 1;
+			if (i + bit_index < count) {
+				visible.add(i + bit_index);
+			}
+		}
+	}
+
+	auto visible_count = (u32)(visible.count - first_visible);
+	app->visible_object_count += visible_count;
+	app->culled_object_count += count - visible_count;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <t3d/common.h>
+
+struct Scene;
+struct Mesh;
+struct MeshRenderer;
+
+//
+// Frustum culling of mesh renderers.
+//
+// `update_world_bounds` keeps a world space box of every MeshRenderer that has a mesh. Boxes are stored as separate
+// arrays of components, so `cull` tests four of them against a plane at once. Boxes of renderers whose entity
+// did not move since last frame are reused.
+//
+
+struct SceneBounds {
+	// Renderer, its mesh and entity slot the box was computed for. Used to tell if the box is still valid.
+	List<MeshRenderer *> renderers;
+	List<Mesh *> meshes;
+	List<u32> entity_indices;
+
+	// Non-zero for boxes that were recomputed during last `update_world_bounds`, i.e. renderer moved or was replaced
+	List<u8> changed;
+
+	// Padded to a multiple of 4
+	List<f32> center_x;
+	List<f32> center_y;
+	List<f32> center_z;
+	List<f32> extent_x;
+	List<f32> extent_y;
+	List<f32> extent_z;
+
+	SceneBounds() {
+		renderers     .allocator = default_allocator;
+		meshes        .allocator = default_allocator;
+		entity_indices.allocator = default_allocator;
+		changed       .allocator = default_allocator;
+		center_x      .allocator = default_allocator;
+		center_y      .allocator = default_allocator;
+		center_z      .allocator = default_allocator;
+		extent_x      .allocator = default_allocator;
+		extent_y      .allocator = default_allocator;
+		extent_z      .allocator = default_allocator;
+	}
+};
+
+void free(SceneBounds &bounds);
+
+// A point is inside if `dot(plane.xyz, point) + plane.w >= 0` for every plane. Planes are not normalized.
+struct Frustum {
+	static constexpr u32 plane_count = 6;
+	v4f planes[plane_count];
+};
+
+// Works with any matrix that maps world space to clip space, e.g. camera's or light's
+Frustum get_frustum(m4 const &world_to_clip);
+
+// Called once per frame after `update_transforms`
+void update_world_bounds(Scene &scene);
+
+// Adds indices into `bounds.renderers` of boxes that intersect `frustum` to `visible`. Counts visible and culled renderers in `app`.
+void cull(SceneBounds &bounds, Frustum const &frustum, List<u32> &visible);
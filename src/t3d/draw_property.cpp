@@ -1,6 +1,32 @@
 #include "draw_property.h"
 #include "gui.h"
 
+void draw_property(Span<utf8> name, bool &value, std::source_location location) {
+	tg::Rect line_viewport = editor->current_viewport;
+	line_viewport.min.y = editor->current_viewport.max.y - line_height - editor->current_property_y;
+	line_viewport.max.y = line_viewport.min.y + line_height;
+
+	push_viewport(line_viewport) {
+		s32 text_width = 0;
+
+		auto font = get_font_at_size(app->font_collection, font_size);
+		ensure_all_chars_present(name, font);
+		auto placed_text = with(temporary_allocator, get_text_info(name, font, {.place_chars=true}).placed_chars);
+		text_width = placed_text.back().position.max.x;
+		label({}, placed_text, font, V4f(1));
+
+		auto value_viewport = line_viewport;
+		value_viewport.min.x += text_width + 2;
+
+		push_viewport(value_viewport) {
+			if (button(value ? u8"yes"s : u8"no"s, 0, location)) {
+				value = !value;
+			}
+		}
+	}
+
+	editor->current_property_y += line_height + 2;
+}
 void draw_property(Span<utf8> name, f32 &value, std::source_location location) {
 	tg::Rect line_viewport = editor->current_viewport;
 	line_viewport.min.y = editor->current_viewport.max.y - line_height - editor->current_property_y;
@@ -4,6 +4,7 @@
 #include <t3d/editor/window.h>
 #include <t3d/editor/input.h>
 #include <t3d/scene.h>
+#include <t3d/snapshot.h>
 #include <tl/font.h>
 
 struct GuiKey {
@@ -162,6 +163,9 @@ struct EditorData {
 
 	Scene *scene;
 
+	bool playing;
+	SceneSnapshot play_snapshot;
+
 	v2s get_mouse_position_in_current_viewport();
 };
 
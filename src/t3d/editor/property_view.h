@@ -57,6 +57,10 @@ struct PropertyView : EditorWindow {
 						draw_property(u8"Position"s, selection.entity->position);
 						draw_property(u8"Rotation"s, selection.entity->rotation);
 						draw_property(u8"Scale"s,    selection.entity->scale);
+
+						bool is_static = selection.entity->flags & Entity_static;
+						draw_property(u8"Static"s,   is_static);
+						selection.entity->flags = is_static ? (selection.entity->flags | Entity_static) : (selection.entity->flags & ~Entity_static);
 						property_separator();
 
 						u32 component_index_in_entity = 0;
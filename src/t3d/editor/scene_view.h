@@ -15,6 +15,7 @@ tg::Texture2D *scale_icon;
 void recompile_all_scripts();
 void reload_all_scripts(bool recompile);
 void build_executable();
+void toggle_play_mode();
 
 struct SceneView : EditorWindow {
 	enum MovementState : u8 {
@@ -35,9 +36,6 @@ struct SceneView : EditorWindow {
 	}
 	void resize(tg::Rect viewport) {
 		this->viewport = viewport;
-		for (auto &effect : camera->post_effects) {
-			effect.resize((v2u)viewport.size());
-		}
 		camera->resize_targets((v2u)viewport.size());
 	}
 	void render() {
@@ -184,6 +182,11 @@ struct SceneView : EditorWindow {
 				build_executable();
 			}
 		}
+		translate_viewport.min.x += button_size + 2;
+		translate_viewport.max.x += button_size + 2;
+		push_viewport(translate_viewport) if (button(editor->playing ? u8"Stop"s : u8"Play"s, (umm)this)) {
+			toggle_play_mode();
+		}
 	}
 	void select_entity() {
 		//for_each_component_of_type(MeshRenderer, renderer) {
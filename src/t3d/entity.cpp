@@ -4,6 +4,8 @@
 
 
 void destroy_entity(Entity &entity) {
+	entity.scene->on_entity_destroyed(entity);
+
 	for (auto &component_index : entity.components) {
 
 		auto &info = app->component_infos.find(component_index.type_uid).get();
@@ -16,30 +18,32 @@ void destroy_entity(Entity &entity) {
 		storage.remove_at(component_index.storage_index);
 	}
 	free(entity.name);
-	entity.scene->entities.remove(&entity);
-}
 
-Entity &get_entity_from_index(Scene *scene, u32 index) {
-	return scene->entities.at(index);
-}
-u32 get_entity_index(Entity &entity) {
-	return index_of(entity.scene->entities, &entity).value();
+	// Invalidate all handles to this entity
+	entity.scene->entity_generations[entity.handle.index] += 1;
+	entity.scene->transforms.order_is_dirty = true;
+
+	entity.scene->entities.remove(&entity);
 }
 
-void remove_component(Entity &entity, ComponentIndex *component) {
-	erase(entity.components, component);
+void remove_component(Entity &entity, ComponentIndex *component_pointer) {
+	// `erase` shifts the list, so copy first
+	auto component = *component_pointer;
+	erase(entity.components, component_pointer);
 
-	auto &info = app->component_infos.find(component->type_uid).get();
-	auto &storage = entity.scene->component_storages.find(component->type_uid).get();
+	auto &info = app->component_infos.find(component.type_uid).get();
+	auto &storage = entity.scene->component_storages.find(component.type_uid).get();
 
 	if (info.free) {
-		info.free(storage.get(component->storage_index));
+		info.free(storage.get(component.storage_index));
 	}
 
-	storage.remove_at(component->storage_index);
+	storage.remove_at(component.storage_index);
+
+	entity.scene->on_component_removed(entity, component.type_uid);
 }
 
-void *add_component(Entity &entity, u32 entity_index, Uid component_type_uid) {
+void *add_component(Entity &entity, Uid component_type_uid) {
 	auto &info = app->component_infos.find(component_type_uid).get();
 	auto &storage = entity.scene->find_or_create_component_storage(component_type_uid, info);
 
@@ -48,7 +52,7 @@ void *add_component(Entity &entity, u32 entity_index, Uid component_type_uid) {
 	ComponentIndex component_index = {
 		.type_uid = component_type_uid,
 		.storage_index = added.index,
-		.entity_index = entity_index,
+		.entity = entity.handle,
 	};
 	entity.components.add(component_index);
 
@@ -57,7 +61,9 @@ void *add_component(Entity &entity, u32 entity_index, Uid component_type_uid) {
 	if (info.init)
 		info.init(added.pointer);
 
-	((Component *)added.pointer)->_entity = &entity;
+	link_component(added.pointer, entity);
+
+	entity.scene->on_component_added(entity, component_type_uid);
 
 	return added.pointer;
 }
@@ -8,10 +8,17 @@ using EntityFlags = u32;
 enum : EntityFlags {
 	Entity_editor_camera = 0x1,
 	Entity_editor_mask   = 0x2 - 1,
+
+	// Not expected to move. Shadows of static entities are cached, see shadow_cache.h.
+	Entity_static        = 0x2,
 };
 
 struct Entity {
 	struct Scene *scene;
+	EntityHandle handle;
+	EntityHandle parent;
+
+	// Local transform, relative to the parent. Use `get_world_position` and friends from transform.h for world space.
 	v3f position = {};
 	quaternion rotation = quaternion::identity();
 	v3f scale = {1, 1, 1};
@@ -33,41 +40,33 @@ inline bool is_editor_entity(Entity &entity) {
 
 void destroy_entity(Entity &entity);
 
-u32 get_entity_index(Entity &entity);
+inline ComponentIndex *find_component(Entity &entity, Uid type_uid) {
+	for (auto &component : entity.components) {
+		if (component.type_uid == type_uid) {
+			return &component;
+		}
+	}
+	return 0;
+}
+
+inline u32 get_entity_index(Entity &entity) {
+	return entity.handle.index;
+}
 
+inline void link_component(void *component, Entity &entity) {
+	((Component *)component)->_scene  = entity.scene;
+	((Component *)component)->_entity = entity.handle;
+}
 
-void *add_component(Entity &entity, u32 entity_index, Uid component_type_uid);
+void *add_component(Entity &entity, Uid component_type_uid);
 void remove_component(Entity &entity, ComponentIndex *component);
 
 inline void remove_component(Entity &entity, ComponentIndex component) {
 	remove_component(entity, find(entity.components, component));
 }
 
-inline void *add_component(Entity &entity, Uid component_uid) {
-	return add_component(entity, get_entity_index(entity), component_uid);
-}
-
-
-template <class T>
-T &add_component(Entity &entity, u32 entity_index) {
-	return *(T *)add_component(entity, entity_index, component_name_to_uid(T::_t3d_component_name));
-}
 template <class T>
 T &add_component(Entity &entity) {
-	return add_component<T>(entity, get_entity_index(entity));
+	return *(T *)add_component(entity, get_component_uid<T>());
 }
 
-
-template <class T>
-T *get_component(Entity &entity, u32 nth = 0) {
-	static constexpr u32 component_type = get_component_type_index<T>();
-	for (auto component : entity.components) {
-		if (component.type == component_type) {
-			if (nth == 0) {
-				return get_component_info(component_type).storage.get(component.index);
-			}
-			--nth;
-		}
-	}
-	return 0;
-}
@@ -0,0 +1,183 @@
+#include "jobs.h"
+#include <tl/cpu.h>
+
+static thread_local u32 current_worker_index = 0;
+
+static bool pop_job(JobWorker &worker, Job &job) {
+	std::lock_guard lock(worker.queue_mutex);
+	if (worker.queue_head == worker.queue.count)
+		return false;
+
+	job = worker.queue.pop();
+	if (worker.queue_head == worker.queue.count) {
+		worker.queue.clear();
+		worker.queue_head = 0;
+	}
+	return true;
+}
+
+static bool steal_job(JobWorker &victim, Job &job) {
+	std::lock_guard lock(victim.queue_mutex);
+	if (victim.queue_head == victim.queue.count)
+		return false;
+
+	job = victim.queue[victim.queue_head++];
+	if (victim.queue_head == victim.queue.count) {
+		victim.queue.clear();
+		victim.queue_head = 0;
+	}
+	return true;
+}
+
+static bool find_job(JobSystem &jobs, u32 worker_index, Job &job) {
+	auto &worker = *jobs.workers[worker_index];
+	if (pop_job(worker, job))
+		return true;
+
+	for (u32 offset = 1; offset < jobs.workers.count; offset += 1) {
+		auto &victim = *jobs.workers[(worker_index + offset) % jobs.workers.count];
+		if (steal_job(victim, job)) {
+			worker.stolen_job_count.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void execute(JobSystem &jobs, u32 worker_index, Job job) {
+	jobs.queued_job_count -= 1;
+
+	auto &worker = *jobs.workers[worker_index];
+	auto timer = create_precise_timer();
+
+	job.function(job.data);
+
+	worker.busy_nanoseconds.fetch_add((u64)(get_time(timer) * 1e9), std::memory_order_relaxed);
+	worker.executed_job_count.fetch_add(1, std::memory_order_relaxed);
+
+	if (job.counter) {
+		job.counter->remaining -= 1;
+	}
+}
+
+static void worker_loop(JobSystem *jobs, u32 worker_index) {
+	initialize_thread();
+	current_worker_index = worker_index;
+
+	while (!jobs->stopping) {
+		Job job;
+		if (find_job(*jobs, worker_index, job)) {
+			execute(*jobs, worker_index, job);
+			continue;
+		}
+
+		std::unique_lock lock(jobs->sleep_mutex);
+		jobs->wake_up.wait(lock, [&] { return jobs->queued_job_count != 0 || jobs->stopping; });
+	}
+}
+
+void init(JobSystem &jobs, u32 thread_count) {
+	if (thread_count == 0) {
+		thread_count = max(1u, (u32)get_cpu_info().logical_processor_count);
+	}
+
+	jobs.workers.allocator = default_allocator;
+	for (u32 worker_index = 0; worker_index < thread_count; worker_index += 1) {
+		// Has a thread and a mutex, so it needs its constructor and destructor to run
+		jobs.workers.add(new (default_allocator.allocate(sizeof(JobWorker), alignof(JobWorker))) JobWorker());
+	}
+
+	// Worker 0 is the thread that called `init`. It runs jobs only while waiting.
+	for (u32 worker_index = 1; worker_index < thread_count; worker_index += 1) {
+		jobs.workers[worker_index]->thread = std::thread(worker_loop, &jobs, worker_index);
+	}
+
+	jobs.stats_timer = create_precise_timer();
+}
+
+void free(JobSystem &jobs) {
+	jobs.stopping = true;
+	{
+		std::lock_guard lock(jobs.sleep_mutex);
+		jobs.wake_up.notify_all();
+	}
+	for (auto worker : jobs.workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+		free(worker->queue);
+		worker->~JobWorker();
+		default_allocator.free(worker);
+	}
+	free(jobs.workers);
+}
+
+void push(JobSystem &jobs, Job job) {
+	if (job.counter) {
+		job.counter->remaining += 1;
+	}
+
+	// Distribute jobs across queues so workers don't all have to steal from one
+	auto &worker = *jobs.workers[jobs.next_worker_index.fetch_add(1, std::memory_order_relaxed) % jobs.workers.count];
+
+	{
+		std::lock_guard lock(worker.queue_mutex);
+		worker.queue.add(job);
+	}
+
+	jobs.queued_job_count += 1;
+	{
+		std::lock_guard lock(jobs.sleep_mutex);
+		jobs.wake_up.notify_one();
+	}
+}
+
+void wait(JobSystem &jobs, JobCounter &counter) {
+	while (counter.remaining) {
+		Job job;
+		if (find_job(jobs, current_worker_index, job)) {
+			execute(jobs, current_worker_index, job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+u32 get_current_worker_index(JobSystem &jobs) {
+	auto thread_id = std::this_thread::get_id();
+	for (u32 worker_index = 1; worker_index < jobs.workers.count; worker_index += 1) {
+		if (jobs.workers[worker_index]->thread.get_id() == thread_id) {
+			return worker_index;
+		}
+	}
+	return 0;
+}
+
+void reset_stats(JobSystem &jobs) {
+	reset(jobs.stats_timer);
+	for (auto worker : jobs.workers) {
+		worker->busy_nanoseconds.store(0, std::memory_order_relaxed);
+		worker->executed_job_count.store(0, std::memory_order_relaxed);
+		worker->stolen_job_count.store(0, std::memory_order_relaxed);
+	}
+}
+
+JobWorkerStats get_stats(JobWorker &worker) {
+	return {
+		.busy_time = (f32)(worker.busy_nanoseconds.load(std::memory_order_relaxed) * 1e-9),
+		.executed_job_count = worker.executed_job_count.load(std::memory_order_relaxed),
+		.stolen_job_count = worker.stolen_job_count.load(std::memory_order_relaxed),
+	};
+}
+
+f32 get_utilization(JobSystem &jobs) {
+	auto wall_time = get_time(jobs.stats_timer);
+	if (wall_time == 0 || jobs.workers.count < 2)
+		return 0;
+
+	f32 busy_time = 0;
+	for (u32 worker_index = 1; worker_index < jobs.workers.count; worker_index += 1) {
+		busy_time += get_stats(*jobs.workers[worker_index]).busy_time;
+	}
+	return busy_time / (wall_time * (jobs.workers.count - 1));
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <t3d/common.h>
+#include <tl/time.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+//
+// Work-stealing job scheduler.
+//
+// Every worker owns a queue. Owner pops from the back, other workers steal from the front.
+// Thread that calls `wait` is worker 0 and executes jobs too instead of sleeping.
+//
+
+struct JobCounter {
+	std::atomic<u32> remaining = 0;
+};
+
+struct Job {
+	void (*function)(void *data);
+	void *data;
+	JobCounter *counter;
+};
+
+struct JobWorker {
+	std::thread thread;
+
+	std::mutex queue_mutex;
+	List<Job> queue;
+	umm queue_head = 0;
+
+	// Accumulated since last `reset_stats`. Written by the worker while the main thread may read or reset them,
+	// read them with `get_stats`.
+	std::atomic<u64> busy_nanoseconds = 0;
+	std::atomic<u32> executed_job_count = 0;
+	std::atomic<u32> stolen_job_count = 0;
+};
+
+struct JobWorkerStats {
+	f32 busy_time;
+	u32 executed_job_count;
+	u32 stolen_job_count;
+};
+
+struct JobSystem {
+	List<JobWorker *> workers;
+	std::atomic<u32> next_worker_index = 0; // Jobs can be pushed from jobs running on other workers
+
+	std::atomic<u32> queued_job_count = 0;
+	std::atomic<bool> stopping = false;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;
+
+	PreciseTimer stats_timer;
+};
+
+// `thread_count` includes calling thread. 0 means use all logical processors.
+void init(JobSystem &jobs, u32 thread_count = 0);
+void free(JobSystem &jobs);
+
+void push(JobSystem &jobs, Job job);
+void wait(JobSystem &jobs, JobCounter &counter);
+
+// Index of the worker running on the calling thread. Threads that are not workers get 0.
+// Doesn't rely on thread locals, so it works across the script dll boundary.
+u32 get_current_worker_index(JobSystem &jobs);
+
+template <class Fn>
+void push(JobSystem &jobs, JobCounter &counter, Fn *fn) {
+	push(jobs, Job{
+		.function = [](void *data) { (*(Fn *)data)(); },
+		.data = fn,
+		.counter = &counter,
+	});
+}
+
+void reset_stats(JobSystem &jobs);
+
+JobWorkerStats get_stats(JobWorker &worker);
+
+// Fraction of time worker threads spent executing jobs since last `reset_stats`, in [0, 1].
+// Worker 0 is left out: it is the main thread, which runs jobs only while waiting.
+f32 get_utilization(JobSystem &jobs);
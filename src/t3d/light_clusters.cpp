@@ -0,0 +1,151 @@
+#include "light_clusters.h"
+#include <t3d/jobs.h>
+#include <tl/profiler.h>
+
+void free(LightClusterBinner &binner) {
+	free(binner.bounds);
+	for (auto &slice : binner.slices) {
+		free(slice.indices);
+	}
+}
+
+static constexpr u32 tile_count = CLUSTER_COUNT_X * CLUSTER_COUNT_Y;
+
+static void bin_slice(LightClusterBinner &binner, u32 z) {
+	auto &slice = binner.slices[z];
+
+	for (auto &count : slice.counts) {
+		count = 0;
+	}
+
+	for (auto &bounds : binner.bounds) {
+		if (z < bounds.min_z || z > bounds.max_z)
+			continue;
+
+		for (u32 y = bounds.min_y; y <= bounds.max_y; ++y) {
+			for (u32 x = bounds.min_x; x <= bounds.max_x; ++x) {
+				slice.counts[y * CLUSTER_COUNT_X + x] += 1;
+			}
+		}
+	}
+
+	u32 total = 0;
+	for (u32 tile = 0; tile < tile_count; ++tile) {
+		slice.offsets[tile] = total;
+		total += slice.counts[tile];
+	}
+	slice.indices.resize(total);
+
+	u32 cursors[tile_count];
+	memcpy(cursors, slice.offsets, sizeof(cursors));
+
+	for (auto &bounds : binner.bounds) {
+		if (z < bounds.min_z || z > bounds.max_z)
+			continue;
+
+		for (u32 y = bounds.min_y; y <= bounds.max_y; ++y) {
+			for (u32 x = bounds.min_x; x <= bounds.max_x; ++x) {
+				slice.indices[cursors[y * CLUSTER_COUNT_X + x]++] = (u8)bounds.index;
+			}
+		}
+	}
+}
+
+bool bin_lights(LightClusterConstants &result, LightClusterBinner &binner, Span<ClusterLight> lights, LightClusterView const &view, JobSystem &jobs) {
+	timed_function();
+
+	result.near_plane = view.near_plane;
+	result.far_plane = view.far_plane;
+	result.log_depth_scale = CLUSTER_COUNT_Z / logf(view.far_plane / view.near_plane);
+	result.enabled = 1;
+
+	auto get_slice = [&](f32 depth) {
+		if (depth <= view.near_plane)
+			return 0;
+		return clamp((s32)(logf(depth / view.near_plane) * result.log_depth_scale), 0, CLUSTER_COUNT_Z - 1);
+	};
+	auto get_tile = [](f32 ndc, s32 count) {
+		return clamp((s32)floorf((ndc * 0.5f + 0.5f) * count), 0, count - 1);
+	};
+
+	//
+	// Cluster ranges of every light. Screen rectangle is of the view space box around the sphere,
+	// clipped to near plane, so it is conservative.
+	//
+	binner.bounds.clear();
+	for (auto &light : lights) {
+		assert(light.index < MAX_CLUSTER_LIGHTS);
+
+		auto center = (view.world_to_view * V4f(light.position, 1)).xyz;
+		auto depth = -center.z;
+		auto r = light.range;
+
+		if (depth + r <= view.near_plane || depth - r >= view.far_plane)
+			continue;
+
+		auto min_depth = max(depth - r, view.near_plane);
+		auto max_depth = depth + r;
+
+		auto min_x = min((center.x - r) / min_depth, (center.x - r) / max_depth) * view.projection_scale_x;
+		auto max_x = max((center.x + r) / min_depth, (center.x + r) / max_depth) * view.projection_scale_x;
+		auto min_y = min((center.y - r) / min_depth, (center.y - r) / max_depth) * view.projection_scale_y;
+		auto max_y = max((center.y + r) / min_depth, (center.y + r) / max_depth) * view.projection_scale_y;
+
+		if (max_x < -1 || min_x > 1 || max_y < -1 || min_y > 1)
+			continue;
+
+		binner.bounds.add({
+			.index = light.index,
+			.min_x = (u8)get_tile(min_x, CLUSTER_COUNT_X),
+			.max_x = (u8)get_tile(max_x, CLUSTER_COUNT_X),
+			.min_y = (u8)get_tile(min_y, CLUSTER_COUNT_Y),
+			.max_y = (u8)get_tile(max_y, CLUSTER_COUNT_Y),
+			.min_z = (u8)get_slice(depth - r),
+			.max_z = (u8)get_slice(max_depth),
+		});
+	}
+
+	//
+	// Every slice is a job
+	//
+	struct SliceJob {
+		LightClusterBinner *binner;
+		u32 z;
+	};
+	SliceJob slice_jobs[CLUSTER_COUNT_Z];
+
+	JobCounter counter;
+	for (u32 z = 0; z < CLUSTER_COUNT_Z; ++z) {
+		slice_jobs[z] = {&binner, z};
+		push(jobs, {
+			.function = [](void *data) {
+				auto &job = *(SliceJob *)data;
+				bin_slice(*job.binner, job.z);
+			},
+			.data = &slice_jobs[z],
+			.counter = &counter,
+		});
+	}
+	wait(jobs, counter);
+
+	//
+	// Concatenate slices
+	//
+	u32 total = 0;
+	bool all_fit = true;
+	for (u32 z = 0; z < CLUSTER_COUNT_Z; ++z) {
+		auto &slice = binner.slices[z];
+		for (u32 tile = 0; tile < tile_count; ++tile) {
+			auto count = slice.counts[tile];
+			if (total + count > MAX_CLUSTER_LIGHT_INDICES) {
+				count = MAX_CLUSTER_LIGHT_INDICES - total;
+				all_fit = false;
+			}
+
+			result.cluster_ranges[z * tile_count + tile] = total | (count << 16);
+			memcpy(result.light_indices + total, slice.indices.data + slice.offsets[tile], count);
+			total += count;
+		}
+	}
+	return all_fit;
+}
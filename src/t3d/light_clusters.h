@@ -0,0 +1,88 @@
+#pragma once
+#include <t3d/common.h>
+
+//
+// Clustered light binning.
+//
+// Camera frustum is split into `CLUSTER_COUNT_X * CLUSTER_COUNT_Y` screen tiles and `CLUSTER_COUNT_Z` depth slices,
+// spaced exponentially between near and far planes. Every light is a sphere that is added to all clusters
+// its screen space rectangle and depth range cover. Slices are binned in parallel on the job system.
+//
+// Binning does not depend on rendering, so it can be run on synthetic lights without a window.
+//
+
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 8
+#define CLUSTER_COUNT_Z 16
+#define CLUSTER_COUNT (CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+
+// Light indices are stored in a byte
+#define MAX_CLUSTER_LIGHTS 256
+
+// Indices that don't fit are dropped. Whatever is left of the uniform block after the header and cluster ranges.
+#define MAX_CLUSTER_LIGHT_INDICES (MAX_UNIFORM_BLOCK_SIZE - 16 - CLUSTER_COUNT * 4)
+static_assert(MAX_CLUSTER_LIGHT_INDICES % 16 == 0, "indices are read as uvec4");
+static_assert(MAX_CLUSTER_LIGHT_INDICES <= 0xffff, "offsets are stored in 16 bits");
+
+//
+// Matches std140 layout of `light_cluster_uniforms` in shaders, where arrays are read as uvec4.
+// Cluster index is `(z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x`.
+//
+struct LightClusterConstants {
+	f32 near_plane;
+	f32 far_plane;
+	f32 log_depth_scale; // Slice of view depth `d` is `log(d / near_plane) * log_depth_scale`
+	u32 enabled;
+
+	// Offset into `light_indices` in low 16 bits, count in high 16 bits
+	u32 cluster_ranges[CLUSTER_COUNT];
+
+	u8 light_indices[MAX_CLUSTER_LIGHT_INDICES];
+};
+static_assert(sizeof(LightClusterConstants) <= MAX_UNIFORM_BLOCK_SIZE);
+#define LIGHT_CLUSTER_CONSTANTS_SLOT 9
+
+struct ClusterLight {
+	v3f position;
+	f32 range;
+	u32 index; // Stored in clusters, must be less than `MAX_CLUSTER_LIGHTS`
+};
+
+struct LightClusterView {
+	m4 world_to_view; // Camera looks along -z
+	f32 projection_scale_x; // Elements [0][0] and [1][1] of projection matrix
+	f32 projection_scale_y;
+	f32 near_plane;
+	f32 far_plane;
+};
+
+// Scratch memory, reused between frames
+struct LightClusterBinner {
+	struct LightBounds {
+		u32 index;
+		u8 min_x, max_x;
+		u8 min_y, max_y;
+		u8 min_z, max_z;
+	};
+
+	struct Slice {
+		u32 counts[CLUSTER_COUNT_X * CLUSTER_COUNT_Y];
+		u32 offsets[CLUSTER_COUNT_X * CLUSTER_COUNT_Y];
+		List<u8> indices;
+	};
+
+	List<LightBounds> bounds;
+	Slice slices[CLUSTER_COUNT_Z];
+
+	LightClusterBinner() {
+		bounds.allocator = default_allocator;
+		for (auto &slice : slices) {
+			slice.indices.allocator = default_allocator;
+		}
+	}
+};
+
+void free(LightClusterBinner &binner);
+
+// Fills `result` with clusters of `lights`. Returns false if some light indices did not fit.
+bool bin_lights(LightClusterConstants &result, LightClusterBinner &binner, Span<ClusterLight> lights, LightClusterView const &view, struct JobSystem &jobs);
@@ -88,6 +88,11 @@ ListList<utf8> all_component_names;
 HMODULE scripts_dll;
 void (*scripts_dll_initialize_thread)();
 
+struct {
+	u32 kept_type_count;
+	u32 migrated_type_count;
+} reload_stats;
+
 void update_component_info(ComponentDesc const &desc) {
 	scoped_allocator(default_allocator);
 
@@ -107,10 +112,16 @@ void update_component_info(ComponentDesc const &desc) {
 
 		assert(info->name == desc.name);
 
-		if (desc.size != info->size || desc.alignment != info->alignment) {
+		// Values of unchanged types stay where they are
+		if (layout_is_same(*info, desc)) {
+			reload_stats.kept_type_count += 1;
+		} else {
 			for (auto scene : app->scenes) {
-				scene->component_storages.find(uid).get().reallocate(desc.size, desc.alignment);
+				if (auto storage = scene->component_storages.find(uid)) {
+					migrate(storage.get(), *info, desc);
+				}
 			}
+			reload_stats.migrated_type_count += 1;
 		}
 	} else {
 		uid = create_uid();
@@ -125,6 +136,7 @@ void update_component_info(ComponentDesc const &desc) {
 
 	info->size = desc.size;
 	info->alignment = desc.alignment;
+	set_fields(*info, desc.fields);
 	info->serialize          = desc.serialize         ;
 	info->construct          = desc.construct         ;
 	info->deserialize_binary = desc.deserialize_binary;
@@ -134,6 +146,12 @@ void update_component_info(ComponentDesc const &desc) {
 	info->init               = desc.init              ;
 	info->start              = desc.start             ;
 	info->update             = desc.update            ;
+	info->update_batch       = desc.update_batch      ;
+	info->parallel_safe      = desc.parallel_safe     ;
+	info->tick_interval      = desc.tick_interval     ;
+	info->execution_priority = desc.execution_priority;
+
+	app->component_execution_order_is_dirty = true;
 }
 
 m4 local_to_world_position(v3f position, quaternion rotation, v3f scale) {
@@ -152,8 +170,11 @@ void render_scene(SceneView *view) {
 
 	render_camera(camera, camera_entity);
 
-	app->tg->set_render_target(camera.source_target);
-	app->tg->clear(camera.source_target, tg::ClearFlags_depth, {}, 1);
+	// Renderer leaves its ring buffers bound
+	app->tg->set_shader_constants(app->entity_constants, ENTITY_CONSTANTS_SLOT);
+
+	app->tg->set_render_target(camera.output_target);
+	app->tg->clear(camera.output_target, tg::ClearFlags_depth, {}, 1);
 	app->tg->set_rasterizer({
 		.depth_test = true,
 		.depth_write = true,
@@ -327,7 +348,7 @@ void render_scene(SceneView *view) {
 		}
 	});
 
-	gui_image(camera.source_target->color);
+	gui_image(camera.output_target->color);
 
 	debug_draw_lines();
 }
@@ -550,6 +571,24 @@ void build_executable() {
 		header.asset_size = asset_data.count;
 		write(data_file, asset_data);
 
+		// Levels of detail of loaded meshes, so the runtime doesn't have to simplify them
+		StringBuilder lod_builder;
+		for_each(app->assets.meshes_by_name, [&](Span<utf8> name, Mesh *mesh) {
+			append_bytes(lod_builder, (u32)name.count);
+			append_bytes(lod_builder, name);
+
+			StringBuilder mesh_builder;
+			serialize_lods(mesh_builder, *mesh);
+			auto mesh_data = as_bytes(to_string(mesh_builder));
+			append_bytes(lod_builder, (u32)mesh_data.count);
+			append_bytes(lod_builder, mesh_data);
+		});
+
+		auto lod_data = as_bytes(to_string(lod_builder));
+		header.mesh_lod_offset = get_cursor(data_file);
+		header.mesh_lod_size = lod_data.count;
+		write(data_file, lod_data);
+
 
 		HashMap<Uid, Uid> uid_remap;
 		u64 uid_counter = 0;
@@ -599,6 +638,7 @@ void update_component_info(ComponentDesc const &desc) {
 
 	info.size      = desc.size;
 	info.alignment = desc.alignment;
+	set_fields(info, desc.fields);
 	info.serialize          = desc.serialize;
 	info.construct          = desc.construct;
 	info.deserialize_binary = desc.deserialize_binary;
@@ -608,6 +648,12 @@ void update_component_info(ComponentDesc const &desc) {
 	info.init               = desc.init;
 	info.start              = desc.start;
 	info.update             = desc.update;
+	info.update_batch       = desc.update_batch;
+	info.parallel_safe      = desc.parallel_safe;
+	info.tick_interval      = desc.tick_interval;
+	info.execution_priority = desc.execution_priority;
+
+	app->component_execution_order_is_dirty = true;
 }
 
 )"s);
@@ -693,41 +739,22 @@ void recompile_all_scripts() {
 void reload_all_scripts(bool recompile) {
 	scoped_allocator(temporary_allocator);
 
-
-	//
-	// Serialize components that are about to be rebuilt
-	//
-	// `app->current_scene` will be null on first call because scene is not loaded yet, so do nothing
-	//
-	List<ComponentIndex> components_to_update;
-	StringBuilder builder;
-	if (app->current_scene) {
-		components_to_update.allocator = temporary_allocator;
-		for_each(app->current_scene->entities, [&](Entity &entity) {
-			for (auto &component : entity.components) {
-				auto found_info = app->component_infos.find(component.type_uid);
-				assert(found_info);
-				auto &info = *found_info;
-				info.serialize(builder, app->current_scene->get_component_data(component), false);
-
-				append(builder, '}'); // deserialier need this to finish parsing
-
-				components_to_update.add(component);
-			}
-		});
-	}
-
 	//
 	// Reload dll
 	//
-	if (scripts_dll) {
-		FreeLibrary(scripts_dll);
-	}
-
+	// Component values stay in their storages meanwhile. Types with unchanged layout keep them as is,
+	// others are migrated field by field in `update_component_info`. Migration frees old values with old code,
+	// so the old dll is unloaded only after that.
+	//
 	if (recompile) {
 		recompile_all_scripts();
 	}
 
+	auto timer = create_precise_timer();
+	reload_stats = {};
+
+	auto old_scripts_dll = scripts_dll;
+
 	scripts_dll = LoadLibraryW(with(temporary_allocator, (wchar *)to_pathchars(scripts_dll_path, true).data));
 	scripts_dll_initialize_thread = ((void (*)())GetProcAddress(scripts_dll, "initialize_thread"));
 	scripts_dll_initialize_thread();
@@ -757,22 +784,237 @@ void reload_all_scripts(bool recompile) {
 		update_component_info(desc);
 	}
 
-	if (app->current_scene) {
-		//
-		// Deserialize components that were rebuilt
-		//
+	if (old_scripts_dll) {
+		FreeLibrary(old_scripts_dll);
+	}
+
+	print("Reloaded {} component types in {} ms: {} kept in place, {} migrated\n", descs.count, FormatFloat{.value = get_time(timer) * 1000, .precision = 3}, reload_stats.kept_type_count, reload_stats.migrated_type_count);
+}
+
+//
+// Play mode runs the scene in the editor. Stopping restores the scene from a snapshot taken on start.
+//
+void toggle_play_mode() {
+	auto &scene = *app->current_scene;
+
+	auto timer = create_precise_timer();
+	if (!editor->playing) {
+		take_snapshot(editor->play_snapshot, scene);
+		print("Play mode: took {} KB snapshot in {} ms\n", get_size(editor->play_snapshot) / 1024, FormatFloat{.value = get_time(timer) * 1000, .precision = 3});
+
+		editor->playing = true;
+		runtime_start();
+	} else {
+		EntityHandle selected_entity = {};
+		if (selection.kind == Selection_entity) {
+			selected_entity = selection.entity->handle;
+		}
+
+		restore_snapshot(editor->play_snapshot, scene);
+		print("Play mode: restored snapshot in {} ms\n", FormatFloat{.value = get_time(timer) * 1000, .precision = 3});
+
+		editor->playing = false;
+
+		if (selection.kind == Selection_entity) {
+			if (auto entity = scene.get_entity(selected_entity)) {
+				selection.set(entity);
+			} else {
+				selection.unset();
+			}
+		}
+	}
+}
+
+//
+// Compares single pass and multi pass lighting on the current scene. Started with Ctrl+F7.
+// For every light count, spotlights are spawned on a ring around the origin looking at it, then frame time is averaged
+// with each lighting path after a few warmup frames. Vsync is off while it runs. Prints a table at the end.
+//
+struct LightBenchmark {
+	static constexpr u32 light_counts[] = {1, 4, 16, 64};
+	static constexpr u32 warmup_frame_count = 30;
+	static constexpr u32 frame_count = 120;
+	static constexpr u32 step_count = count_of(light_counts) * 2;
+
+	bool running;
+	u32 step; // Light count index * 2, plus one for multi pass
+	u32 frame;
+	f64 total_time;
+	f64 average_times[count_of(light_counts)][2];
+	bool was_single_pass;
+	List<EntityHandle> lights;
+};
+static LightBenchmark light_benchmark;
+
+static void destroy_benchmark_lights() {
+	for (auto handle : light_benchmark.lights) {
+		if (auto entity = app->current_scene->get_entity(handle)) {
+			destroy_entity(*entity);
+		}
+	}
+	light_benchmark.lights.clear();
+}
+
+static void begin_light_benchmark_step() {
+	auto &benchmark = light_benchmark;
+	auto light_count = LightBenchmark::light_counts[benchmark.step / 2];
+
+	if (benchmark.step % 2 == 0) {
+		destroy_benchmark_lights();
+		for (u32 i = 0; i < light_count; ++i) {
+			auto angle = 2 * pi * i / light_count;
+			auto &entity = app->current_scene->create_entity(tformat(u8"benchmark light {}", i));
+			entity.position = {sinf(angle) * 6, 3, cosf(angle) * 6};
+			entity.rotation = quaternion_from_euler(-pi / 8, angle, 0);
+			add_component<Light>(entity);
+			benchmark.lights.add(entity.handle);
+		}
+	}
+	app->use_single_pass_lighting = benchmark.step % 2 == 0;
+
+	benchmark.frame = 0;
+	benchmark.total_time = 0;
+}
+
+static void start_light_benchmark() {
+	auto &benchmark = light_benchmark;
+	if (benchmark.running)
+		return;
+
+	benchmark.running = true;
+	benchmark.step = 0;
+	benchmark.was_single_pass = app->use_single_pass_lighting;
+	benchmark.lights.allocator = default_allocator;
+	app->tg->set_vsync(false);
+	print("Light benchmark: {} frames per step\n", LightBenchmark::frame_count);
+
+	begin_light_benchmark_step();
+}
+
+// Call once per frame, before rendering
+static void update_light_benchmark() {
+	auto &benchmark = light_benchmark;
+	if (!benchmark.running)
+		return;
+
+	// `frame_time` is of the previous frame, which was drawn with the current step
+	benchmark.frame += 1;
+	if (benchmark.frame <= LightBenchmark::warmup_frame_count)
+		return;
+
+	benchmark.total_time += app->frame_time;
+	if (benchmark.frame < LightBenchmark::warmup_frame_count + LightBenchmark::frame_count)
+		return;
+
+	benchmark.average_times[benchmark.step / 2][benchmark.step % 2] = benchmark.total_time / LightBenchmark::frame_count;
+	benchmark.step += 1;
+	if (benchmark.step < LightBenchmark::step_count) {
+		begin_light_benchmark_step();
+		return;
+	}
+
+	destroy_benchmark_lights();
+	free(benchmark.lights);
+	app->use_single_pass_lighting = benchmark.was_single_pass;
+	app->tg->set_vsync(true);
+	benchmark.running = false;
+
+	print("lights | single pass ms | multi pass ms\n");
+	for (u32 i = 0; i < count_of(LightBenchmark::light_counts); ++i) {
+		print("{} | {} | {}\n",
+			LightBenchmark::light_counts[i],
+			FormatFloat{.value = benchmark.average_times[i][0] * 1000, .precision = 3},
+			FormatFloat{.value = benchmark.average_times[i][1] * 1000, .precision = 3});
+	}
+}
+
+//
+// Measures script reload on the current scene with 50k script components added to it. Started with Ctrl+F5.
+// The dll is not recompiled, so every type keeps its layout. Reload in place is compared with what reload did before:
+// serialize every component to text, reload the dll, then construct and deserialize every component again.
+//
+static void benchmark_script_reload() {
+	static constexpr u32 component_count = 50'000;
+
+	auto &scene = *app->current_scene;
+
+	// Any script component will do
+	Optional<Uid> type_uid;
+	for (auto name : all_component_names) {
+		if (auto found = app->component_name_to_uid.find(name)) {
+			type_uid = found.get();
+			break;
+		}
+	}
+	if (!type_uid) {
+		print(Print_error, "Reload benchmark needs a project with at least one script component\n");
+		return;
+	}
+
+	List<EntityHandle> entities;
+	entities.allocator = default_allocator;
+	defer {
+		for (auto handle : entities) {
+			if (auto entity = scene.get_entity(handle)) {
+				destroy_entity(*entity);
+			}
+		}
+		free(entities);
+	};
+
+	for (u32 i = 0; i < component_count; ++i) {
+		auto &entity = scene.create_entity();
+		add_component(entity, type_uid.value());
+		entities.add(entity.handle);
+	}
+
+	// First reload pulls the dll into file cache
+	reload_all_scripts(false);
+
+	auto timer = create_precise_timer();
+	reload_all_scripts(false);
+	auto in_place_time = get_time(timer);
+
+	reset(timer);
+	{
+		scoped_allocator(temporary_allocator);
+
+		StringBuilder builder;
+		List<ComponentIndex> components;
+		for_each(scene.entities, [&](Entity &entity) {
+			for (auto &component : entity.components) {
+				get_component_info(component.type_uid).serialize(builder, scene.get_component_data(component), false);
+				append(builder, '}');
+				components.add(component);
+			}
+		});
+
+		reload_all_scripts(false);
+
 		auto string = as_utf8(to_string(builder));
 		auto tokens = parse_tokens(string).value();
 		auto t = tokens.data;
-		for (auto &component : components_to_update) {
-			auto found_info = app->component_infos.find(component.type_uid);
-			assert(found_info);
-			auto &info = *found_info;
-			auto data = app->current_scene->get_component_data(component);
+		for (auto &component : components) {
+			auto &info = get_component_info(component.type_uid);
+			auto data = scene.get_component_data(component);
+
+			// Old reload skipped `free` and `init` and leaked owned resources, do them so the scene stays usable
+			if (info.free) {
+				info.free(data);
+			}
 			info.construct(data);
 			info.deserialize_text(t, tokens.end(), data);
+			if (info.init) {
+				info.init(data);
+			}
 		}
 	}
+	auto through_text_time = get_time(timer);
+
+	print("Reload with {} more components: {} ms in place, {} ms through text\n",
+		component_count,
+		FormatFloat{.value = in_place_time * 1000, .precision = 3},
+		FormatFloat{.value = through_text_time * 1000, .precision = 3});
 }
 
 struct Task {
@@ -850,6 +1092,7 @@ void load_project() {
 			mr.material = &app->surface_material;
 			mr.lightmap = app->assets.get_texture_2d(u8"floor_lightmap.png"s);
 		}
+		floor.flags |= Entity_static;
 
 		auto light_texture = app->assets.get_texture_2d(u8"spotlight_mask.png"s);
 
@@ -858,6 +1101,7 @@ void load_project() {
 			light.position = {0,2,6};
 			//light.rotation = quaternion_from_euler(-pi/10,0,pi/6);
 			light.rotation = quaternion_from_euler(0,0,0);
+			light.flags |= Entity_static;
 			add_component<Light>(light).mask = light_texture;
 		}
 
@@ -865,6 +1109,7 @@ void load_project() {
 			auto &light = scene->create_entity("light2");
 			light.position = {6,2,-6};
 			light.rotation = quaternion_from_euler(-pi/10,pi*0.75,0);
+			light.flags |= Entity_static;
 			add_component<Light>(light).mask = light_texture;
 		}
 
@@ -1166,21 +1411,80 @@ void draw_editor() {
 
 	if (key_down(Key_f2, {.anywhere = true})) {
 		for_each(app->current_scene->entities, [](Entity &e) {
-			print("name: {}, index: {}, flags: {}, position: {}, rotation: {}\n", e.name, get_entity_index(e), e.flags, e.position, degrees(to_euler_angles(e.rotation)));
+			print("name: {}, handle: {}, flags: {}, position: {}, rotation: {}\n", e.name, e.handle, e.flags, e.position, degrees(to_euler_angles(e.rotation)));
 			for (auto &c : e.components) {
-				print("\tparent: {}, type: {} ({}), index: {}\n", c.entity_index, c.type_uid, get_component_info(c.type_uid).name, c.storage_index);
+				print("\tparent: {}, type: {} ({}), index: {}\n", c.entity, c.type_uid, get_component_info(c.type_uid).name, c.storage_index);
 			}
 		});
 	}
 
 
+	if (key_down(Key_f3, {.anywhere = true})) {
+		if (!key_held(Key_control)) {
+			print_update_stats();
+		} else if (editor->playing) {
+			// Running scripts may hold component pointers
+			print(Print_warning, "Can't compact component storages while playing\n");
+		} else {
+			auto &scene = *app->current_scene;
+			u32 compacted_count = 0;
+			while (scene.compact_most_fragmented_storage())
+				++compacted_count;
+			print("Compacted {} component storages\n", compacted_count);
+		}
+	}
+
+	if (key_down(Key_f5, {.anywhere = true}) && key_held(Key_control)) {
+		benchmark_script_reload();
+	}
+
 	if (key_down(Key_f6, {.anywhere = true})) {
 		build_executable();
 	}
+
+	if (key_down(Key_f7, {.anywhere = true})) {
+		if (key_held(Key_control)) {
+			start_light_benchmark();
+		} else {
+			app->use_single_pass_lighting = !app->use_single_pass_lighting;
+			print("Lighting: {}\n", app->use_single_pass_lighting ? "single pass" : "multi pass");
+		}
+	}
+
+	if (key_down(Key_f8, {.anywhere = true})) {
+		app->use_light_clusters = !app->use_light_clusters;
+		print("Light clusters: {}\n", app->use_light_clusters ? "on" : "off");
+	}
+
+	if (key_down(Key_f9, {.anywhere = true})) {
+		app->use_instancing = !app->use_instancing;
+		print("Instancing: {}\n", app->use_instancing ? "on" : "off");
+	}
+
+	if (key_down(Key_f10, {.anywhere = true})) {
+		app->use_shadow_cache = !app->use_shadow_cache;
+		print("Shadow cache: {}\n", app->use_shadow_cache ? "on" : "off");
+	}
+
+	if (key_down(Key_f11, {.anywhere = true})) {
+		app->use_occlusion_culling = !app->use_occlusion_culling;
+		print("Occlusion culling: {}\n", app->use_occlusion_culling ? "on" : "off");
+	}
+
+	if (key_down(Key_f12, {.anywhere = true})) {
+		app->use_lods = !app->use_lods;
+		print("Mesh LODs: {}\n", app->use_lods ? "on" : "off");
+	}
 	app->window->min_window_size = client_size_to_window_size(*app->window, editor->main_window->get_min_size());
 
 	timed_block("frame"s);
 
+	if (editor->playing) {
+		runtime_simulate();
+	}
+
+	update_light_benchmark();
+
 	runtime_render();
 
 	{
@@ -1477,7 +1781,7 @@ void run() {
 		update_time();
 
 		++fps_counter;
-		set_title(app->window, tformat(u8"frame_time: {} ms, fps: {}, draw calls: {}", FormatFloat{.value = app->frame_time * 1000, .precision = 1}, fps_counter_result, app->tg->draw_call_count));
+		set_title(app->window, tformat(u8"frame_time: {} ms, fps: {}, draw calls: {}, triangles: {}, visible: {}, culled: {}, occluded: {}, state changes: {} ({} saved), uniforms: {} KB, shadow passes skipped: {}, render targets: {} MB ({} MB unaliased)", FormatFloat{.value = app->frame_time * 1000, .precision = 1}, fps_counter_result, app->tg->draw_call_count, app->render_state.triangle_count, app->visible_object_count, app->culled_object_count, app->occluded_object_count, app->render_state.issued_count, app->render_state.skipped_count, app->uploaded_uniform_bytes / 1024, app->shadow_cache.skipped_pass_count, app->render_target_pool.allocated_bytes >> 20, app->render_target_pool.unaliased_bytes >> 20));
 
 		set_cursor(*app->window, app->current_cursor);
 
@@ -1541,6 +1845,17 @@ void run() {
 	for (auto scene : app->scenes) {
 		scene->free();
 	}
+
+	free(app->light_cluster_binner);
+	free(app->render_queue);
+	free(app->entity_constants_ring);
+	free(app->light_constants_ring);
+	free(app->instance_constants_ring);
+	free(app->shadow_cache);
+	free(app->shadow_atlas);
+	free(app->occlusion_buffer);
+	free(app->render_target_pool);
+	free(app->jobs);
 }
 
 s32 tl_main(Span<Span<utf8>> arguments) {
@@ -4,7 +4,8 @@
 #include "runtime.h"
 #include "assets.h"
 
-Camera *main_camera;
+// Component storages may be compacted, so keep the entity and look the camera up every frame
+EntityHandle main_camera_entity;
 
 File data_file;
 Span<u8> data_buffer;
@@ -46,6 +47,25 @@ void load_assets() {
 
 		print("Got asset '{}'\n", asset_path);
 	}
+
+	cursor = data_buffer.data + data_header->mesh_lod_offset;
+	end    = data_buffer.data + data_header->mesh_lod_offset + data_header->mesh_lod_size;
+	while (cursor != end) {
+		auto name_size = *(u32 *)cursor;
+		cursor += sizeof(name_size);
+		assert(cursor < end);
+
+		Span<utf8> name = {(utf8 *)cursor, name_size};
+		cursor += name_size;
+		assert(cursor < end);
+
+		auto lod_size = *(u32 *)cursor;
+		cursor += sizeof(lod_size);
+		assert(cursor + lod_size <= end);
+
+		app->assets.mesh_name_to_lod_data.get_or_insert(name) = Span(cursor, lod_size);
+		cursor += lod_size;
+	}
 }
 
 extern "C" void t3d_get_component_descs(List<ComponentDesc> &descs);
@@ -99,15 +119,20 @@ s32 tl_main(Span<Span<utf8>> arguments) {
 		app->scenes.add(app->current_scene);
 
 		print("Starting runtime ...\n");
+		app->use_fixed_time_step = true;
 		runtime_start();
 
 		app->current_scene->for_each_component<Camera>([&](Camera &camera) {
-			main_camera = &camera;
+			main_camera_entity = camera._entity;
 			for_each_break;
 		});
 	};
 
 	info.on_draw = [](Window &window) {
+		runtime_simulate();
+
+		auto main_camera = get_component<Camera>(*app->current_scene->get_entity(main_camera_entity));
+
 		static v2u old_window_size;
 		if (any_true(old_window_size != window.client_size)) {
 			old_window_size = window.client_size;
@@ -115,7 +140,6 @@ s32 tl_main(Span<Span<utf8>> arguments) {
 			main_camera->resize_targets(window.client_size);
 		}
 
-		runtime_update();
 		runtime_render();
 
 		app->tg->clear(app->tg->back_buffer, tg::ClearFlags_color | tg::ClearFlags_depth, {}, 1);
@@ -125,7 +149,7 @@ s32 tl_main(Span<Span<utf8>> arguments) {
 
 		app->tg->set_render_target(app->tg->back_buffer);
 		app->tg->set_viewport(app->current_viewport);
-		blit(main_camera->source_target->color);
+		blit(main_camera->output_target->color);
 
 		app->tg->present();
 
@@ -3,6 +3,14 @@
 #include <tl/masked_block_list.h>
 
 struct Material {
+	// Draws one light, called once per light with additive blending
 	tg::Shader *shader;
+
+	// Draws all lights from `ForwardLightConstants` at once. Optional.
+	tg::Shader *forward_shader;
+
 	tg::ShaderConstants *constants;
+
+	// Shaders read entity matrices through `get_local_to_*` functions of the shader header, so they work with instanced draws
+	bool supports_instancing;
 };
@@ -9,3 +9,40 @@ void draw_mesh(Mesh *mesh) {
 	app->tg->set_index_buffer(mesh->index_buffer);
 	app->tg->draw_indexed(mesh->index_count);
 }
+
+void update_bounds(Mesh &mesh) {
+	if (!mesh.positions.count) {
+		mesh.bounds = {};
+		mesh.sphere_center = {};
+		mesh.sphere_radius = 0;
+		return;
+	}
+
+	mesh.bounds.min = mesh.bounds.max = mesh.positions[0];
+	for (auto position : mesh.positions) {
+		mesh.bounds.min = min(mesh.bounds.min, position);
+		mesh.bounds.max = max(mesh.bounds.max, position);
+	}
+
+	// Sphere around box center is not minimal, but it is never worse than the box's circumscribed sphere
+	mesh.sphere_center = mesh.bounds.center();
+	f32 radius_squared = 0;
+	for (auto position : mesh.positions) {
+		radius_squared = max(radius_squared, length_squared(position - mesh.sphere_center));
+	}
+	mesh.sphere_radius = sqrtf(radius_squared);
+}
+
+tg::IndexBuffer *create_index_buffer(Span<u32> indices, u32 vertex_count) {
+	if (vertex_count > 0x10000) {
+		return app->tg->create_index_buffer(as_bytes(indices), sizeof(u32));
+	}
+
+	List<u16> short_indices;
+	short_indices.allocator = temporary_allocator;
+	short_indices.resize(indices.count);
+	for (umm i = 0; i < indices.count; ++i) {
+		short_indices[i] = (u16)indices[i];
+	}
+	return app->tg->create_index_buffer(as_bytes(short_indices), sizeof(u16));
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include "mesh_lod.h"
 #include <tl/mesh.h>
 
 struct Mesh {
@@ -9,6 +10,19 @@ struct Mesh {
 	List<utf8> name;
 	List<v3f> positions;
 	List<u32> indices;
+
+	// Local space bounds of `positions`
+	aabb<v3f> bounds;
+	v3f sphere_center;
+	f32 sphere_radius;
+
+	// Level 0 is `index_buffer` itself. Filled by `generate_lods` or `deserialize_lods`.
+	List<MeshLod> lods;
 };
 
+void update_bounds(Mesh &mesh);
+
+// Index buffer of u16 when all indices fit, u32 otherwise
+tg::IndexBuffer *create_index_buffer(Span<u32> indices, u32 vertex_count);
+
 void draw_mesh(Mesh *mesh);
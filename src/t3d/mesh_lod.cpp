@@ -0,0 +1,472 @@
+#include "mesh_lod.h"
+#include <t3d/mesh.h>
+#include <t3d/mesh_optimize.h>
+#include <t3d/app.h>
+#include <tl/profiler.h>
+#include <algorithm>
+
+// Symmetric 4x4 matrix. Evaluating it at a point gives the sum of squared distances to the planes it was made of.
+struct Quadric {
+	f64 a00, a01, a02, a11, a12, a22;
+	f64 b0, b1, b2;
+	f64 c;
+};
+
+static Quadric make_plane_quadric(v3f normal, f32 d) {
+	f64 x = normal.x, y = normal.y, z = normal.z;
+	return {
+		.a00 = x * x, .a01 = x * y, .a02 = x * z,
+		.a11 = y * y, .a12 = y * z,
+		.a22 = z * z,
+		.b0 = x * d, .b1 = y * d, .b2 = z * d,
+		.c = (f64)d * d,
+	};
+}
+
+static void add(Quadric &a, Quadric const &b) {
+	a.a00 += b.a00; a.a01 += b.a01; a.a02 += b.a02;
+	a.a11 += b.a11; a.a12 += b.a12;
+	a.a22 += b.a22;
+	a.b0 += b.b0; a.b1 += b.b1; a.b2 += b.b2;
+	a.c += b.c;
+}
+
+static f32 evaluate(Quadric const &q, v3f p) {
+	f64 x = p.x, y = p.y, z = p.z;
+	auto result =
+		q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+		2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+		2 * (q.b0 * x + q.b1 * y + q.b2 * z) +
+		q.c;
+	return (f32)max(result, 0.0);
+}
+
+List<u32> simplify(Span<v3f> positions, Span<u32> indices, u32 target_index_count, f32 &error) {
+	timed_function();
+
+	auto vertex_count = (u32)positions.count;
+
+	List<u32> result = copy(indices);
+	error = 0;
+
+	//
+	// Vertices that share a position are copies of one vertex with different attributes, like both sides of a uv seam.
+	// Collapses work on welded vertices: topology, quadrics and locks are per position, so seams are not borders.
+	// `welded[v]` is the first copy of `v`'s position.
+	//
+	List<u32> welded;
+	welded.allocator = temporary_allocator;
+	welded.resize(vertex_count);
+	{
+		List<u32> sorted_vertices;
+		sorted_vertices.allocator = temporary_allocator;
+		sorted_vertices.resize(vertex_count);
+		for (u32 i = 0; i < vertex_count; ++i) {
+			sorted_vertices[i] = i;
+		}
+		std::sort(sorted_vertices.begin(), sorted_vertices.end(), [&](u32 a, u32 b) {
+			auto pa = positions[a];
+			auto pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			if (pa.z != pb.z) return pa.z < pb.z;
+			return a < b;
+		});
+		u32 first = 0;
+		for (u32 i = 0; i < vertex_count; ++i) {
+			auto v = sorted_vertices[i];
+			if (i == 0 || !all_true(positions[sorted_vertices[i - 1]] == positions[v])) {
+				first = v;
+			}
+			welded[v] = first;
+		}
+	}
+
+	//
+	// Lock vertices of edges that only one triangle uses
+	//
+	List<u8> locked;
+	locked.allocator = temporary_allocator;
+	locked.resize(vertex_count);
+
+	List<u64> edges;
+	edges.allocator = temporary_allocator;
+	edges.reserve(indices.count);
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		for (u32 k = 0; k < 3; ++k) {
+			auto a = welded[indices[i + k]];
+			auto b = welded[indices[i + (k + 1) % 3]];
+			if (a != b) {
+				edges.add(((u64)min(a, b) << 32) | max(a, b));
+			}
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (umm i = 0; i < edges.count;) {
+		umm run_end = i + 1;
+		while (run_end < edges.count && edges[run_end] == edges[i]) {
+			run_end += 1;
+		}
+		if (run_end - i == 1) {
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xffffffff] = 1;
+		}
+		i = run_end;
+	}
+
+	//
+	// Every vertex starts with planes of its triangles
+	//
+	List<Quadric> quadrics;
+	quadrics.allocator = temporary_allocator;
+	quadrics.resize(vertex_count);
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		auto p0 = positions[indices[i + 0]];
+		auto p1 = positions[indices[i + 1]];
+		auto p2 = positions[indices[i + 2]];
+		auto normal = cross(p1 - p0, p2 - p0);
+		auto normal_length = length(normal);
+		if (normal_length == 0)
+			continue;
+
+		normal /= normal_length;
+		auto quadric = make_plane_quadric(normal, -dot(normal, p0));
+		for (u32 k = 0; k < 3; ++k) {
+			add(quadrics[welded[indices[i + k]]], quadric);
+		}
+	}
+
+	struct Collapse {
+		u32 from;
+		u32 to;
+		f32 cost;
+	};
+
+	// Copy of `from` and copy of `to` that it moves to
+	struct CopyPair {
+		u32 from;
+		u32 to;
+	};
+	static constexpr u32 max_copy_count = 8;
+
+	List<Collapse> collapses;
+	collapses.allocator = temporary_allocator;
+	List<u32> triangle_offsets;
+	triangle_offsets.allocator = temporary_allocator;
+	List<u32> vertex_triangles;
+	vertex_triangles.allocator = temporary_allocator;
+	List<u32> remap;
+	remap.allocator = temporary_allocator;
+	List<u8> touched;
+	touched.allocator = temporary_allocator;
+
+	f32 max_cost = 0;
+
+	//
+	// Every pass collapses cheapest edges that don't share triangles with each other, then rebuilds adjacency.
+	// `result` keeps original vertices, adjacency, collapses, `locked` and `touched` are of welded ones.
+	//
+	while (result.count > target_index_count) {
+		auto triangle_count = (u32)(result.count / 3);
+
+		// Triangles of every welded vertex
+		triangle_offsets.clear();
+		triangle_offsets.resize(vertex_count + 1);
+		for (auto index : result) {
+			triangle_offsets[welded[index] + 1] += 1;
+		}
+		for (u32 i = 0; i < vertex_count; ++i) {
+			triangle_offsets[i + 1] += triangle_offsets[i];
+		}
+		vertex_triangles.resize(result.count);
+		{
+			auto cursors = with(temporary_allocator, copy(triangle_offsets));
+			for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+				for (u32 k = 0; k < 3; ++k) {
+					vertex_triangles[cursors[welded[result[triangle * 3 + k]]]++] = triangle;
+				}
+			}
+		}
+
+		collapses.clear();
+		for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+			for (u32 k = 0; k < 3; ++k) {
+				auto a = welded[result[triangle * 3 + k]];
+				auto b = welded[result[triangle * 3 + (k + 1) % 3]];
+				Quadric sum = quadrics[a];
+				add(sum, quadrics[b]);
+				if (!locked[a]) collapses.add({a, b, evaluate(sum, positions[b])});
+				if (!locked[b]) collapses.add({b, a, evaluate(sum, positions[a])});
+			}
+		}
+		if (!collapses.count)
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](Collapse const &a, Collapse const &b) { return a.cost < b.cost; });
+
+		remap.resize(vertex_count);
+		for (u32 i = 0; i < vertex_count; ++i) {
+			remap[i] = i;
+		}
+		touched.clear();
+		touched.resize(vertex_count);
+
+		u32 indices_to_remove = (u32)result.count - target_index_count;
+		u32 removed_index_count = 0;
+		u32 collapse_count = 0;
+		for (auto collapse : collapses) {
+			if (removed_index_count >= indices_to_remove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			auto triangles = Span(vertex_triangles.data + triangle_offsets[collapse.from], triangle_offsets[collapse.from + 1] - triangle_offsets[collapse.from]);
+
+			//
+			// Every copy of `from` moves to the copy of `to` it shares an edge with, so attributes stay on their side of a seam.
+			// Copies without such an edge would have to take attributes from another side, so the collapse is skipped.
+			// That keeps seam vertices moving only along their seam.
+			//
+			CopyPair pairs[max_copy_count];
+			u32 pair_count = 0;
+			bool can_collapse = true;
+			for (auto triangle : triangles) {
+				auto t = result.data + triangle * 3;
+				for (u32 k = 0; k < 3; ++k) {
+					if (welded[t[k]] != collapse.from)
+						continue;
+
+					CopyPair *pair = 0;
+					for (u32 i = 0; i < pair_count; ++i) {
+						if (pairs[i].from == t[k]) {
+							pair = &pairs[i];
+							break;
+						}
+					}
+					if (!pair) {
+						if (pair_count == max_copy_count) {
+							can_collapse = false;
+							break;
+						}
+						pair = &pairs[pair_count++];
+						*pair = {t[k], ~0u};
+					}
+
+					for (u32 j = 0; j < 3; ++j) {
+						if (welded[t[j]] != collapse.to)
+							continue;
+						if (pair->to != ~0u && pair->to != t[j]) {
+							can_collapse = false;
+						}
+						pair->to = t[j];
+					}
+				}
+			}
+			for (u32 i = 0; i < pair_count; ++i) {
+				if (pairs[i].to == ~0u) {
+					can_collapse = false;
+				}
+			}
+			if (!can_collapse)
+				continue;
+
+			// Triangles that stay must not flip
+			bool flips = false;
+			for (auto triangle : triangles) {
+				auto t = result.data + triangle * 3;
+				if (welded[t[0]] == collapse.to || welded[t[1]] == collapse.to || welded[t[2]] == collapse.to)
+					continue;
+
+				v3f old_corners[3], new_corners[3];
+				for (u32 k = 0; k < 3; ++k) {
+					old_corners[k] = positions[t[k]];
+					new_corners[k] = welded[t[k]] == collapse.from ? positions[collapse.to] : positions[t[k]];
+				}
+				auto old_normal = cross(old_corners[1] - old_corners[0], old_corners[2] - old_corners[0]);
+				auto new_normal = cross(new_corners[1] - new_corners[0], new_corners[2] - new_corners[0]);
+				if (dot(old_normal, new_normal) <= 0) {
+					flips = true;
+					break;
+				}
+			}
+			if (flips)
+				continue;
+
+			for (u32 i = 0; i < pair_count; ++i) {
+				remap[pairs[i].from] = pairs[i].to;
+			}
+			for (auto triangle : triangles) {
+				auto t = result.data + triangle * 3;
+				touched[welded[t[0]]] = 1;
+				touched[welded[t[1]]] = 1;
+				touched[welded[t[2]]] = 1;
+				if (welded[t[0]] == collapse.to || welded[t[1]] == collapse.to || welded[t[2]] == collapse.to) {
+					removed_index_count += 3;
+				}
+			}
+			add(quadrics[collapse.to], quadrics[collapse.from]);
+			max_cost = max(max_cost, collapse.cost);
+			collapse_count += 1;
+		}
+		if (!collapse_count)
+			break;
+
+		// Drop triangles that became degenerate
+		umm kept_count = 0;
+		for (umm i = 0; i < result.count; i += 3) {
+			auto a = remap[result[i + 0]];
+			auto b = remap[result[i + 1]];
+			auto c = remap[result[i + 2]];
+			if (welded[a] == welded[b] || welded[b] == welded[c] || welded[c] == welded[a])
+				continue;
+			result[kept_count++] = a;
+			result[kept_count++] = b;
+			result[kept_count++] = c;
+		}
+		result.resize(kept_count);
+	}
+
+	error = sqrtf(max_cost);
+	return result;
+}
+
+static void add_lod(Mesh &mesh, Span<u32> indices, f32 error) {
+	mesh.lods.add({
+		.index_buffer = create_index_buffer(indices, (u32)mesh.positions.count),
+		.index_count = (u32)indices.count,
+		.error = error,
+		.indices = with(default_allocator, copy(indices)),
+	});
+}
+
+void generate_lods(Mesh &mesh) {
+	timed_function();
+
+	mesh.lods.clear();
+	mesh.lods.add({
+		.index_buffer = mesh.index_buffer,
+		.index_count = mesh.index_count,
+		.error = 0,
+	});
+
+	scoped_allocator(temporary_allocator);
+
+	List<u32> current = copy(mesh.indices);
+	f32 total_error = 0;
+	while (mesh.lods.count < max_lod_count) {
+		auto target_index_count = (u32)(current.count / 6 * 3);
+		if (target_index_count < min_lod_index_count)
+			break;
+
+		f32 error;
+		auto simplified = simplify(mesh.positions, current, target_index_count, error);
+
+		// Not worth another index buffer
+		if (simplified.count > current.count * 3 / 4)
+			break;
+
+		// Collapses leave holes in the cache order of the previous level
+		optimize_vertex_cache(simplified, (u32)mesh.positions.count);
+
+		// Every level is simplified from the previous one, so errors add up
+		total_error += error;
+		add_lod(mesh, simplified, total_error);
+		current = simplified;
+	}
+}
+
+void serialize_lods(StringBuilder &builder, Mesh &mesh) {
+	append_bytes(builder, (u32)(mesh.lods.count ? mesh.lods.count - 1 : 0));
+	for (umm i = 1; i < mesh.lods.count; ++i) {
+		auto &lod = mesh.lods[i];
+		append_bytes(builder, lod.error);
+		append_bytes(builder, lod.index_count);
+		append_bytes(builder, as_bytes(lod.indices));
+	}
+}
+
+bool deserialize_lods(Mesh &mesh, Span<u8> data) {
+	mesh.lods.clear();
+	mesh.lods.add({
+		.index_buffer = mesh.index_buffer,
+		.index_count = mesh.index_count,
+		.error = 0,
+	});
+
+	auto vertex_count = (u32)mesh.positions.count;
+
+	//
+	// Check everything before creating index buffers, so nothing is left behind on failure
+	//
+	auto read = [&](u8 *&cursor, umm size) -> u8 * {
+		if (size > (umm)(data.end() - cursor))
+			return 0;
+		auto result = cursor;
+		cursor += size;
+		return result;
+	};
+
+	auto cursor = data.data;
+	auto lod_count_data = read(cursor, sizeof(u32));
+	if (!lod_count_data)
+		return false;
+
+	auto lod_count = *(u32 *)lod_count_data;
+	if (lod_count >= max_lod_count)
+		return false;
+
+	for (u32 i = 0; i < lod_count; ++i) {
+		auto header = read(cursor, sizeof(f32) + sizeof(u32));
+		if (!header)
+			return false;
+
+		auto index_count = *(u32 *)(header + sizeof(f32));
+		if (index_count % 3)
+			return false;
+
+		auto indices = (u32 *)read(cursor, (umm)index_count * sizeof(u32));
+		if (!indices)
+			return false;
+
+		for (u32 j = 0; j < index_count; ++j) {
+			if (indices[j] >= vertex_count)
+				return false;
+		}
+	}
+
+	cursor = data.data + sizeof(u32);
+	for (u32 i = 0; i < lod_count; ++i) {
+		auto error = *(f32 *)cursor;
+		cursor += sizeof(error);
+		auto index_count = *(u32 *)cursor;
+		cursor += sizeof(index_count);
+
+		add_lod(mesh, Span((u32 *)cursor, index_count), error);
+		cursor += index_count * sizeof(u32);
+	}
+	return true;
+}
+
+u32 select_lod(Mesh &mesh, u32 current_lod, f32 pixels_per_unit) {
+	if (mesh.lods.count <= 1)
+		return 0;
+
+	auto get_coarsest = [&](f32 max_error_pixels) {
+		u32 result = 0;
+		for (u32 i = 1; i < mesh.lods.count; ++i) {
+			if (mesh.lods[i].error * pixels_per_unit > max_error_pixels)
+				break;
+			result = i;
+		}
+		return result;
+	};
+
+	current_lod = min(current_lod, (u32)mesh.lods.count - 1);
+
+	// Go finer as soon as the error is visible, go coarser only when it is well below that
+	auto lod = get_coarsest(max_lod_error_pixels);
+	if (lod < current_lod)
+		return lod;
+
+	return max(get_coarsest(max_lod_error_pixels * (1 - lod_hysteresis)), current_lod);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <t3d/common.h>
+
+struct Mesh;
+
+//
+// Levels of detail of meshes.
+//
+// Levels are made at import by quadric error simplification. Edges are collapsed into one of their vertices, cheapest first.
+// Cost of a collapse is the sum of squared distances from the remaining vertex to planes of triangles that were merged into it.
+// Vertices are never moved, so all levels share the vertex buffer and only have their own index buffer.
+// Vertices with the same position are welded for the collapse, so seams (same position, different attributes) are
+// simplified like the rest of the surface. A seam vertex collapses only along its seam, with every copy moving to the copy
+// on its side, so seams don't tear. Vertices on open borders are never collapsed, so borders don't get holes.
+//
+// A renderer picks the coarsest level whose error projects to at most `max_lod_error_pixels` on screen.
+// Going to a coarser level needs the error to be `lod_hysteresis` smaller, so renderers near the threshold don't switch every frame.
+//
+
+inline constexpr u32 max_lod_count = 5;
+inline constexpr u32 min_lod_index_count = 3 * 32;
+inline constexpr f32 max_lod_error_pixels = 1.0f;
+inline constexpr f32 lod_hysteresis = 0.25f;
+
+struct MeshLod {
+	tg::IndexBuffer *index_buffer;
+	u32 index_count;
+
+	// Upper bound of distance between this level and the original surface, in mesh units. Zero for level 0.
+	f32 error;
+
+	// Kept for `serialize_lods`. Empty for level 0, which is `Mesh::indices`.
+	List<u32> indices;
+};
+
+// Returns about `target_index_count` indices, or more if simplification got stuck. Sets `error` to the largest collapse error.
+List<u32> simplify(Span<v3f> positions, Span<u32> indices, u32 target_index_count, f32 &error);
+
+// Fills `mesh.lods`. Level 0 is mesh's own index buffer, every next level has about half of triangles of the previous one.
+void generate_lods(Mesh &mesh);
+
+// Writes levels after 0 for `data.bin`, so the runtime doesn't have to simplify meshes
+void serialize_lods(StringBuilder &builder, Mesh &mesh);
+
+// Fills `mesh.lods` from data written by `serialize_lods`. Returns false if data is corrupted, then only level 0 is filled.
+bool deserialize_lods(Mesh &mesh, Span<u8> data);
+
+// `pixels_per_unit` is how many pixels a mesh unit covers at the distance of the renderer
+u32 select_lod(Mesh &mesh, u32 current_lod, f32 pixels_per_unit);
@@ -0,0 +1,401 @@
+#include "mesh_optimize.h"
+#include <tl/profiler.h>
+#include <algorithm>
+
+static f32 get_vertex_score(s32 cache_position, u32 remaining_triangle_count) {
+	if (!remaining_triangle_count)
+		return -1;
+
+	f32 result = 0;
+	if (cache_position >= 0) {
+		// Vertices of the last triangle get a fixed score, so it's not always best to reuse all three
+		if (cache_position < 3) {
+			result = 0.75f;
+		} else {
+			result = powf(1 - (f32)(cache_position - 3) / (vertex_cache_size - 3), 1.5f);
+		}
+	}
+
+	// Vertices with few triangles left are finished first
+	result += 2 * powf((f32)remaining_triangle_count, -0.5f);
+	return result;
+}
+
+void optimize_vertex_cache(Span<u32> indices, u32 vertex_count) {
+	timed_function();
+
+	auto triangle_count = (u32)(indices.count / 3);
+	if (!triangle_count)
+		return;
+
+	scoped_allocator(temporary_allocator);
+
+	//
+	// Triangles of every vertex
+	//
+	List<u32> triangle_offsets;
+	triangle_offsets.resize(vertex_count + 1);
+	for (auto index : indices) {
+		triangle_offsets[index + 1] += 1;
+	}
+	for (u32 i = 0; i < vertex_count; ++i) {
+		triangle_offsets[i + 1] += triangle_offsets[i];
+	}
+	List<u32> vertex_triangles;
+	vertex_triangles.resize(indices.count);
+	List<u32> remaining_triangle_counts;
+	remaining_triangle_counts.resize(vertex_count);
+	for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+		for (u32 k = 0; k < 3; ++k) {
+			auto vertex = indices[triangle * 3 + k];
+			vertex_triangles[triangle_offsets[vertex] + remaining_triangle_counts[vertex]++] = triangle;
+		}
+	}
+
+	//
+	// Scores
+	//
+	List<s32> cache_positions;
+	cache_positions.resize(vertex_count);
+	List<f32> vertex_scores;
+	vertex_scores.resize(vertex_count);
+	for (u32 vertex = 0; vertex < vertex_count; ++vertex) {
+		cache_positions[vertex] = -1;
+		vertex_scores[vertex] = get_vertex_score(-1, remaining_triangle_counts[vertex]);
+	}
+
+	List<f32> triangle_scores;
+	triangle_scores.resize(triangle_count);
+	List<u8> emitted;
+	emitted.resize(triangle_count);
+	for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+		triangle_scores[triangle] = vertex_scores[indices[triangle * 3 + 0]] + vertex_scores[indices[triangle * 3 + 1]] + vertex_scores[indices[triangle * 3 + 2]];
+	}
+
+	List<u32> result;
+	result.reserve(indices.count);
+
+	// Vertex indices in LRU order. Three extra slots for vertices of a new triangle before the oldest ones are pushed out.
+	u32 cache[vertex_cache_size + 3];
+	u32 cache_count = 0;
+	u32 new_cache[vertex_cache_size + 3];
+
+	u32 fallback_cursor = 0;
+	s64 best_triangle = -1;
+	while (result.count < indices.count) {
+		// When no triangle in cache has anything left, take the next one in the original order
+		if (best_triangle < 0) {
+			while (emitted[fallback_cursor]) {
+				fallback_cursor += 1;
+			}
+			best_triangle = fallback_cursor;
+		}
+
+		auto t = indices.data + best_triangle * 3;
+		result.add(t[0]);
+		result.add(t[1]);
+		result.add(t[2]);
+		emitted[best_triangle] = 1;
+
+		//
+		// Emitted triangle's vertices go to the front of the cache
+		//
+		u32 new_cache_count = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			auto vertex = t[k];
+			new_cache[new_cache_count++] = vertex;
+
+			// Remove the triangle from vertex's list
+			auto triangles = vertex_triangles.data + triangle_offsets[vertex];
+			auto &remaining = remaining_triangle_counts[vertex];
+			for (u32 i = 0; i < remaining; ++i) {
+				if (triangles[i] == best_triangle) {
+					triangles[i] = triangles[remaining - 1];
+					remaining -= 1;
+					break;
+				}
+			}
+		}
+		for (u32 i = 0; i < cache_count; ++i) {
+			auto vertex = cache[i];
+			if (vertex != t[0] && vertex != t[1] && vertex != t[2]) {
+				new_cache[new_cache_count++] = vertex;
+			}
+		}
+
+		//
+		// Rescore cached vertices and their triangles, pick the best one of those
+		//
+		for (u32 i = 0; i < new_cache_count; ++i) {
+			auto vertex = new_cache[i];
+			cache_positions[vertex] = i < vertex_cache_size ? (s32)i : -1;
+		}
+
+		best_triangle = -1;
+		f32 best_score = -1;
+		for (u32 i = 0; i < new_cache_count; ++i) {
+			auto vertex = new_cache[i];
+			auto new_score = get_vertex_score(cache_positions[vertex], remaining_triangle_counts[vertex]);
+			auto score_delta = new_score - vertex_scores[vertex];
+			vertex_scores[vertex] = new_score;
+
+			auto triangles = vertex_triangles.data + triangle_offsets[vertex];
+			for (u32 j = 0; j < remaining_triangle_counts[vertex]; ++j) {
+				auto triangle = triangles[j];
+				triangle_scores[triangle] += score_delta;
+				if (triangle_scores[triangle] > best_score) {
+					best_score = triangle_scores[triangle];
+					best_triangle = triangle;
+				}
+			}
+		}
+
+		cache_count = min(new_cache_count, vertex_cache_size);
+		memcpy(cache, new_cache, cache_count * sizeof(cache[0]));
+	}
+
+	memcpy(indices.data, result.data, indices.count * sizeof(u32));
+}
+
+//
+// The cache model `optimize_vertex_cache` optimizes for: emitted triangle's vertices go to the front, others move back,
+// the ones past `vertex_cache_size` are gone. Writes vertices of triangle `t` that were not in the cache to `missed`,
+// returns their count.
+//
+static u32 use_triangle(VertexCache &cache, u32 const *t, u32 (&missed)[3]) {
+	u32 miss_count = 0;
+	u32 new_vertices[vertex_cache_size + 3];
+	u32 new_count = 0;
+	for (u32 k = 0; k < 3; ++k) {
+		// Degenerate triangles repeat vertices
+		if ((k > 0 && t[k] == t[0]) || (k == 2 && t[k] == t[1]))
+			continue;
+
+		bool cached = false;
+		for (u32 i = 0; i < cache.count; ++i) {
+			if (cache.vertices[i] == t[k]) {
+				cached = true;
+				break;
+			}
+		}
+		if (!cached) {
+			missed[miss_count++] = t[k];
+		}
+		new_vertices[new_count++] = t[k];
+	}
+	for (u32 i = 0; i < cache.count; ++i) {
+		auto vertex = cache.vertices[i];
+		if (vertex != t[0] && vertex != t[1] && vertex != t[2]) {
+			new_vertices[new_count++] = vertex;
+		}
+	}
+	cache.count = min(new_count, vertex_cache_size);
+	memcpy(cache.vertices, new_vertices, cache.count * sizeof(cache.vertices[0]));
+	return miss_count;
+}
+
+void optimize_overdraw(Span<u32> indices, Span<v3f> positions) {
+	timed_function();
+
+	auto triangle_count = (u32)(indices.count / 3);
+	if (!triangle_count)
+		return;
+
+	scoped_allocator(temporary_allocator);
+
+	//
+	// New cluster starts where all three vertices of a triangle missed the cache
+	//
+	List<u32> cluster_starts;
+	{
+		VertexCache cache;
+		for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+			u32 missed[3];
+			auto miss_count = use_triangle(cache, indices.data + triangle * 3, missed);
+			if (triangle == 0 || miss_count == 3) {
+				cluster_starts.add(triangle);
+			}
+		}
+	}
+	cluster_starts.add(triangle_count);
+
+	auto cluster_count = (u32)cluster_starts.count - 1;
+	if (cluster_count <= 1)
+		return;
+
+	//
+	// Clusters facing away from the center of the mesh go first
+	//
+	auto get_triangle_normal = [&](u32 triangle, v3f &centroid) {
+		auto p0 = positions[indices[triangle * 3 + 0]];
+		auto p1 = positions[indices[triangle * 3 + 1]];
+		auto p2 = positions[indices[triangle * 3 + 2]];
+		centroid = (p0 + p1 + p2) / 3;
+
+		// Length is twice the area
+		return cross(p1 - p0, p2 - p0);
+	};
+
+	v3f mesh_centroid = {};
+	f32 mesh_area = 0;
+	for (u32 triangle = 0; triangle < triangle_count; ++triangle) {
+		v3f centroid;
+		auto area = length(get_triangle_normal(triangle, centroid));
+		mesh_centroid += centroid * area;
+		mesh_area += area;
+	}
+	if (mesh_area > 0) {
+		mesh_centroid /= mesh_area;
+	}
+
+	struct Cluster {
+		u32 index;
+		f32 sort_key;
+	};
+	List<Cluster> clusters;
+	clusters.resize(cluster_count);
+	for (u32 cluster = 0; cluster < cluster_count; ++cluster) {
+		v3f cluster_centroid = {};
+		v3f cluster_normal = {};
+		f32 cluster_area = 0;
+		for (u32 triangle = cluster_starts[cluster]; triangle < cluster_starts[cluster + 1]; ++triangle) {
+			v3f centroid;
+			auto normal = get_triangle_normal(triangle, centroid);
+			auto area = length(normal);
+			cluster_centroid += centroid * area;
+			cluster_normal += normal;
+			cluster_area += area;
+		}
+		if (cluster_area > 0) {
+			cluster_centroid /= cluster_area;
+			cluster_normal /= cluster_area;
+		}
+		clusters[cluster] = {cluster, dot(cluster_centroid - mesh_centroid, cluster_normal)};
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) { return a.sort_key > b.sort_key; });
+
+	List<u32> result;
+	result.reserve(indices.count);
+	for (auto cluster : clusters) {
+		for (u32 i = cluster_starts[cluster.index] * 3; i < cluster_starts[cluster.index + 1] * 3; ++i) {
+			result.add(indices[i]);
+		}
+	}
+
+	memcpy(indices.data, result.data, indices.count * sizeof(u32));
+}
+
+u32 optimize_vertex_fetch(Span<u8> vertices, u32 vertex_size, Span<u32> indices) {
+	timed_function();
+
+	auto vertex_count = (u32)(vertices.count / vertex_size);
+	if (!vertex_count)
+		return 0;
+
+	scoped_allocator(temporary_allocator);
+
+	auto get_vertex = [&](u32 index) {
+		return vertices.data + (umm)index * vertex_size;
+	};
+
+	//
+	// Identical vertices become one. Sorting bytes puts them next to each other.
+	//
+	List<u32> sorted;
+	sorted.resize(vertex_count);
+	for (u32 i = 0; i < vertex_count; ++i) {
+		sorted[i] = i;
+	}
+	std::sort(sorted.begin(), sorted.end(), [&](u32 a, u32 b) {
+		auto order = memcmp(get_vertex(a), get_vertex(b), vertex_size);
+		return order ? order < 0 : a < b;
+	});
+
+	List<u32> canonical;
+	canonical.resize(vertex_count);
+	for (u32 i = 0; i < vertex_count; ++i) {
+		if (i && memcmp(get_vertex(sorted[i - 1]), get_vertex(sorted[i]), vertex_size) == 0) {
+			canonical[sorted[i]] = canonical[sorted[i - 1]];
+		} else {
+			canonical[sorted[i]] = sorted[i];
+		}
+	}
+
+	//
+	// Vertices go in the order of first use. Unused ones are dropped.
+	//
+	static constexpr u32 unused = ~0u;
+
+	List<u32> new_indices;
+	new_indices.resize(vertex_count);
+	for (auto &new_index : new_indices) {
+		new_index = unused;
+	}
+
+	List<u8> result;
+	result.reserve(vertices.count);
+
+	u32 new_vertex_count = 0;
+	for (auto &index : indices) {
+		auto vertex = canonical[index];
+		if (new_indices[vertex] == unused) {
+			new_indices[vertex] = new_vertex_count++;
+			result.add(Span(get_vertex(vertex), vertex_size));
+		}
+		index = new_indices[vertex];
+	}
+
+	memcpy(vertices.data, result.data, result.count);
+	return new_vertex_count;
+}
+
+VertexCacheStats get_vertex_cache_stats(Span<u32> indices, u32 vertex_count, u32 vertex_size) {
+	if (!indices.count || !vertex_count)
+		return {};
+
+	scoped_allocator(temporary_allocator);
+
+	List<u8> used;
+	used.resize(vertex_count);
+	u32 used_vertex_count = 0;
+	for (auto index : indices) {
+		used_vertex_count += !used[index];
+		used[index] = 1;
+	}
+
+	//
+	// Every transformed vertex reads the cache lines it spans. Reading the same line as the previous read is free,
+	// which is what a sequential vertex buffer gets.
+	//
+	static constexpr u32 cache_line_size = 64;
+	u32 fetched_line_count = 0;
+	umm last_line = ~(umm)0;
+	auto fetch = [&](u32 vertex) {
+		auto first_line = (umm)vertex * vertex_size / cache_line_size;
+		auto last_line_of_vertex = ((umm)vertex * vertex_size + vertex_size - 1) / cache_line_size;
+		for (auto line = first_line; line <= last_line_of_vertex; ++line) {
+			if (line != last_line) {
+				fetched_line_count += 1;
+				last_line = line;
+			}
+		}
+	};
+
+	VertexCache cache;
+	u32 miss_count = 0;
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		u32 missed[3];
+		auto triangle_miss_count = use_triangle(cache, indices.data + i, missed);
+		for (u32 k = 0; k < triangle_miss_count; ++k) {
+			fetch(missed[k]);
+		}
+		miss_count += triangle_miss_count;
+	}
+
+	return {
+		.acmr = (f32)miss_count / (indices.count / 3),
+		.atvr = (f32)miss_count / used_vertex_count,
+		.overfetch = (f32)fetched_line_count * cache_line_size / ((f32)used_vertex_count * vertex_size),
+	};
+}
@@ -0,0 +1,449 @@
+#include "occlusion.h"
+#include <t3d/scene.h>
+#include <t3d/app.h>
+#include <t3d/jobs.h>
+#include <t3d/components/mesh_renderer.h>
+#include <tl/profiler.h>
+#include <immintrin.h>
+
+static constexpr u32 width  = OcclusionBuffer::width;
+static constexpr u32 height = OcclusionBuffer::height;
+
+static_assert(width % 4 == 0, "rasterizer processes four pixels at a time");
+static_assert(height % OcclusionBuffer::band_height == 0);
+static_assert((height >> (OcclusionBuffer::level_count - 1)) != 0);
+
+void free(OcclusionBuffer &buffer) {
+	for (u32 i = 0; i < OcclusionBuffer::max_occluders; ++i) {
+		free(buffer.occluder_vertices[i]);
+		free(buffer.occluder_triangles[i]);
+	}
+	for (auto &level : buffer.levels) {
+		free(level);
+	}
+}
+
+static v3f clip_to_screen(v4f v) {
+	auto inv_w = 1.0f / v.w;
+	return {
+		(v.x * inv_w * 0.5f + 0.5f) * width,
+		(v.y * inv_w * 0.5f + 0.5f) * height,
+		 v.z * inv_w * 0.5f + 0.5f,
+	};
+}
+
+// Determinant of the upper 3x3, same for either storage order
+static f32 get_determinant3(m4 const &m) {
+	auto e = (f32 const *)&m;
+	return e[0] * (e[5] * e[10] - e[6] * e[9])
+	     - e[1] * (e[4] * e[10] - e[6] * e[8])
+	     + e[2] * (e[4] * e[9]  - e[5] * e[8]);
+}
+
+//
+// Transforms triangles to screen space, clipping them by the near plane.
+// Back faces are dropped, front faces of a closed mesh cover the same pixels and are closer.
+// Mirroring transforms turn front faces clockwise, so winding is flipped for them.
+//
+static void setup_occluder(OcclusionBuffer &buffer, u32 slot, Span<v3f> positions, Span<u32> indices, m4 const &local_to_world) {
+	auto &vertices = buffer.occluder_vertices[slot];
+	auto &triangles = buffer.occluder_triangles[slot];
+	vertices.clear();
+	triangles.clear();
+
+	auto local_to_clip = buffer.world_to_clip * local_to_world;
+	auto front_sign = get_determinant3(local_to_world) < 0 ? -1.0f : 1.0f;
+
+	for (auto position : positions) {
+		vertices.add(local_to_clip * V4f(position, 1));
+	}
+
+	auto add_triangle = [&](v4f a, v4f b, v4f c) {
+		auto sa = clip_to_screen(a);
+		auto sb = clip_to_screen(b);
+		auto sc = clip_to_screen(c);
+
+		// Counter-clockwise is positive, screen y goes up
+		auto area = (sb.x - sa.x) * (sc.y - sa.y) - (sb.y - sa.y) * (sc.x - sa.x);
+		if (area * front_sign <= 0)
+			return;
+
+		// Rasterizer expects counter-clockwise
+		if (area < 0) {
+			triangles.add({sa, sc, sb});
+		} else {
+			triangles.add({sa, sb, sc});
+		}
+	};
+
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		v4f v[3] = {
+			vertices[indices[i + 0]],
+			vertices[indices[i + 1]],
+			vertices[indices[i + 2]],
+		};
+
+		// Whole triangle is outside of one of the side planes
+		if (v[0].x >  v[0].w && v[1].x >  v[1].w && v[2].x >  v[2].w) continue;
+		if (v[0].x < -v[0].w && v[1].x < -v[1].w && v[2].x < -v[2].w) continue;
+		if (v[0].y >  v[0].w && v[1].y >  v[1].w && v[2].y >  v[2].w) continue;
+		if (v[0].y < -v[0].w && v[1].y < -v[1].w && v[2].y < -v[2].w) continue;
+		if (v[0].z >  v[0].w && v[1].z >  v[1].w && v[2].z >  v[2].w) continue;
+
+		// Distance to the near plane, z = -w
+		f32 d[3];
+		u32 inside_count = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			d[k] = v[k].z + v[k].w;
+			inside_count += d[k] >= 0;
+		}
+
+		if (inside_count == 3) {
+			add_triangle(v[0], v[1], v[2]);
+			continue;
+		}
+		if (inside_count == 0)
+			continue;
+
+		// Clipped triangle is a triangle or a quad
+		v4f clipped[4];
+		u32 clipped_count = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			auto next = (k + 1) % 3;
+			if (d[k] >= 0) {
+				clipped[clipped_count++] = v[k];
+			}
+			if ((d[k] >= 0) != (d[next] >= 0)) {
+				auto t = d[k] / (d[k] - d[next]);
+				clipped[clipped_count++] = v[k] + (v[next] - v[k]) * t;
+			}
+		}
+		for (u32 k = 2; k < clipped_count; ++k) {
+			add_triangle(clipped[0], clipped[k - 1], clipped[k]);
+		}
+	}
+}
+
+//
+// Rasterizes every occluder triangle into rows of one band. Samples are at pixel centers,
+// pixels on the edge are not covered, so occluders never grow.
+//
+static void rasterize_band(OcclusionBuffer &buffer, u32 band) {
+	s32 band_begin = band * OcclusionBuffer::band_height;
+	s32 band_end = band_begin + OcclusionBuffer::band_height;
+
+	auto depth = buffer.levels[0].data;
+	for (s32 i = band_begin * width; i < band_end * width; ++i) {
+		depth[i] = 1;
+	}
+
+	auto const zero = _mm_setzero_ps();
+	auto const pixel_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (u32 slot = 0; slot < buffer.occluder_count; ++slot) {
+		for (auto &t : buffer.occluder_triangles[slot]) {
+			s32 min_y = max((s32)floorf(min(min(t.a.y, t.b.y), t.c.y)), band_begin);
+			s32 max_y = min((s32)ceilf (max(max(t.a.y, t.b.y), t.c.y)), band_end);
+			if (min_y >= max_y)
+				continue;
+
+			s32 min_x = max((s32)floorf(min(min(t.a.x, t.b.x), t.c.x)), 0);
+			s32 max_x = min((s32)ceilf (max(max(t.a.x, t.b.x), t.c.x)), (s32)width);
+			if (min_x >= max_x)
+				continue;
+
+			// Start on a group of four
+			min_x &= ~3;
+
+			// Edge function `e = x * dx + y * dy + c` is positive inside
+			struct Edge { f32 dx, dy, c; };
+			auto make_edge = [](v3f a, v3f b) {
+				Edge e;
+				e.dx = a.y - b.y;
+				e.dy = b.x - a.x;
+				e.c = -(e.dx * a.x + e.dy * a.y);
+				return e;
+			};
+			Edge ab = make_edge(t.a, t.b);
+			Edge bc = make_edge(t.b, t.c);
+			Edge ca = make_edge(t.c, t.a);
+
+			// Weight of a vertex is the edge function of the opposite edge divided by area, so depth is linear in screen space too
+			auto inv_area = 1.0f / (ab.dx * t.c.x + ab.dy * t.c.y + ab.c);
+			f32 depth_dx = (bc.dx * t.a.z + ca.dx * t.b.z + ab.dx * t.c.z) * inv_area;
+			f32 depth_dy = (bc.dy * t.a.z + ca.dy * t.b.z + ab.dy * t.c.z) * inv_area;
+			f32 depth_c  = (bc.c  * t.a.z + ca.c  * t.b.z + ab.c  * t.c.z) * inv_area;
+
+			auto ab_dx = _mm_set1_ps(ab.dx);
+			auto bc_dx = _mm_set1_ps(bc.dx);
+			auto ca_dx = _mm_set1_ps(ca.dx);
+			auto z_dx = _mm_set1_ps(depth_dx);
+
+			for (s32 y = min_y; y < max_y; ++y) {
+				f32 py = y + 0.5f;
+				auto ab_row = _mm_set1_ps(ab.dy * py + ab.c);
+				auto bc_row = _mm_set1_ps(bc.dy * py + bc.c);
+				auto ca_row = _mm_set1_ps(ca.dy * py + ca.c);
+				auto z_row = _mm_set1_ps(depth_dy * py + depth_c);
+
+				auto row = depth + y * width;
+				for (s32 x = min_x; x < max_x; x += 4) {
+					auto px = _mm_add_ps(_mm_set1_ps((f32)x), pixel_offsets);
+
+					auto inside = _mm_and_ps(
+						_mm_and_ps(
+							_mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(ab_dx, px), ab_row), zero),
+							_mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(bc_dx, px), bc_row), zero)
+						),
+						_mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(ca_dx, px), ca_row), zero)
+					);
+					if (!_mm_movemask_ps(inside))
+						continue;
+
+					auto z = _mm_add_ps(_mm_mul_ps(z_dx, px), z_row);
+					auto old_z = _mm_loadu_ps(row + x);
+					auto new_z = _mm_min_ps(old_z, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_z), _mm_andnot_ps(inside, old_z)));
+				}
+			}
+		}
+	}
+}
+
+static void build_pyramid(OcclusionBuffer &buffer) {
+	for (u32 level = 1; level < OcclusionBuffer::level_count; ++level) {
+		auto source_width = width >> (level - 1);
+		auto level_width  = width >> level;
+		auto level_height = height >> level;
+
+		auto source = buffer.levels[level - 1].data;
+		auto destination = buffer.levels[level].data;
+		for (u32 y = 0; y < level_height; ++y) {
+			auto row0 = source + (y * 2 + 0) * source_width;
+			auto row1 = source + (y * 2 + 1) * source_width;
+			for (u32 x = 0; x < level_width; ++x) {
+				destination[y * level_width + x] = max(max(row0[x * 2], row0[x * 2 + 1]), max(row1[x * 2], row1[x * 2 + 1]));
+			}
+		}
+	}
+}
+
+void begin_occluders(OcclusionBuffer &buffer, m4 const &world_to_clip) {
+	buffer.world_to_clip = world_to_clip;
+	buffer.occluder_count = 0;
+	for (u32 level = 0; level < OcclusionBuffer::level_count; ++level) {
+		buffer.levels[level].resize((width >> level) * (height >> level));
+	}
+}
+
+void add_occluder(OcclusionBuffer &buffer, Span<v3f> positions, Span<u32> indices, m4 const &local_to_world) {
+	assert(buffer.occluder_count < OcclusionBuffer::max_occluders);
+	setup_occluder(buffer, buffer.occluder_count++, positions, indices, local_to_world);
+}
+
+void rasterize_occluders(OcclusionBuffer &buffer, JobSystem &jobs) {
+	//
+	// Every band is a job
+	//
+	static constexpr u32 band_count = height / OcclusionBuffer::band_height;
+	struct BandJob {
+		OcclusionBuffer *buffer;
+		u32 band;
+	};
+	BandJob band_jobs[band_count];
+
+	JobCounter counter;
+	for (u32 band = 0; band < band_count; ++band) {
+		band_jobs[band] = {&buffer, band};
+		push(jobs, {
+			.function = [](void *data) {
+				auto &job = *(BandJob *)data;
+				rasterize_band(*job.buffer, job.band);
+			},
+			.data = &band_jobs[band],
+			.counter = &counter,
+		});
+	}
+	wait(jobs, counter);
+
+	build_pyramid(buffer);
+}
+
+void render_occluders(OcclusionBuffer &buffer, Scene &scene, Span<u32> candidates, m4 const &world_to_clip, v3f camera_position, JobSystem &jobs) {
+	timed_function();
+
+	auto &bounds = scene.bounds;
+
+	begin_occluders(buffer, world_to_clip);
+
+	//
+	// Biggest boxes on screen make best occluders. Keep the best ones sorted by score.
+	//
+	struct Occluder {
+		u32 renderer_index;
+		f32 score;
+	};
+	Occluder occluders[OcclusionBuffer::max_occluders];
+	u32 occluder_count = 0;
+
+	for (auto index : candidates) {
+		auto mesh = bounds.meshes[index];
+		if (!mesh->indices.count || mesh->indices.count / 3 > OcclusionBuffer::max_occluder_triangles)
+			continue;
+
+		v3f center = {bounds.center_x[index], bounds.center_y[index], bounds.center_z[index]};
+		v3f extent = {bounds.extent_x[index], bounds.extent_y[index], bounds.extent_z[index]};
+		auto to_center = center - camera_position;
+		auto score = dot(extent, extent) / max(dot(to_center, to_center), 0.0001f);
+		if (score < OcclusionBuffer::min_occluder_score)
+			continue;
+
+		if (occluder_count == OcclusionBuffer::max_occluders && score <= occluders[occluder_count - 1].score)
+			continue;
+
+		u32 i = occluder_count < OcclusionBuffer::max_occluders ? occluder_count++ : occluder_count - 1;
+		while (i && occluders[i - 1].score < score) {
+			occluders[i] = occluders[i - 1];
+			--i;
+		}
+		occluders[i] = {index, score};
+	}
+	buffer.occluder_count = occluder_count;
+
+	//
+	// Every occluder is a job
+	//
+	struct SetupJob {
+		OcclusionBuffer *buffer;
+		u32 slot;
+		Mesh *mesh;
+		m4 local_to_world;
+	};
+	SetupJob setup_jobs[OcclusionBuffer::max_occluders];
+
+	JobCounter counter;
+	for (u32 slot = 0; slot < occluder_count; ++slot) {
+		auto index = occluders[slot].renderer_index;
+		setup_jobs[slot] = {
+			.buffer = &buffer,
+			.slot = slot,
+			.mesh = bounds.meshes[index],
+			.local_to_world = scene.transforms.local_to_world[bounds.entity_indices[index]],
+		};
+		push(jobs, {
+			.function = [](void *data) {
+				auto &job = *(SetupJob *)data;
+				setup_occluder(*job.buffer, job.slot, job.mesh->positions, job.mesh->indices, job.local_to_world);
+			},
+			.data = &setup_jobs[slot],
+			.counter = &counter,
+		});
+	}
+	wait(jobs, counter);
+
+	rasterize_occluders(buffer, jobs);
+}
+
+bool is_occluded(OcclusionBuffer &buffer, v3f center, v3f extent) {
+	v2f min_position = {max_value<f32>, max_value<f32>};
+	v2f max_position = {-max_value<f32>, -max_value<f32>};
+	f32 min_depth = max_value<f32>;
+	for (u32 corner = 0; corner < 8; ++corner) {
+		v3f p = center + v3f{
+			corner & 1 ? extent.x : -extent.x,
+			corner & 2 ? extent.y : -extent.y,
+			corner & 4 ? extent.z : -extent.z,
+		};
+		auto clip = buffer.world_to_clip * V4f(p, 1);
+
+		// Box crosses the near plane or is behind the camera, nothing to compare against
+		if (clip.z < -clip.w)
+			return false;
+
+		auto screen = clip_to_screen(clip);
+		min_position = min(min_position, screen.xy);
+		max_position = max(max_position, screen.xy);
+		min_depth = min(min_depth, screen.z);
+	}
+
+	// Inclusive rectangle of pixels the box touches
+	s32 x0 = max((s32)floorf(min_position.x), 0);
+	s32 y0 = max((s32)floorf(min_position.y), 0);
+	s32 x1 = min((s32)ceilf(max_position.x), (s32)width) - 1;
+	s32 y1 = min((s32)ceilf(max_position.y), (s32)height) - 1;
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	// Level where the rectangle covers at most 2x2 texels
+	u32 level = 0;
+	while (level + 1 < OcclusionBuffer::level_count && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+		level += 1;
+	}
+
+	auto level_width = width >> level;
+	auto depth = buffer.levels[level].data;
+	f32 max_depth = 0;
+	for (s32 y = y0 >> level; y <= (y1 >> level); ++y) {
+		for (s32 x = x0 >> level; x <= (x1 >> level); ++x) {
+			max_depth = max(max_depth, depth[y * level_width + x]);
+		}
+	}
+
+	return min_depth > max_depth;
+}
+
+void cull_occluded(OcclusionBuffer &buffer, SceneBounds &bounds, List<u32> &visible, JobSystem &jobs) {
+	timed_function();
+
+	if (!buffer.occluder_count || !visible.count)
+		return;
+
+	List<u8> hidden;
+	hidden.allocator = temporary_allocator;
+	hidden.resize(visible.count);
+
+	//
+	// Every chunk of renderers is a job
+	//
+	static constexpr u32 chunk_size = 256;
+	struct TestJob {
+		OcclusionBuffer *buffer;
+		SceneBounds *bounds;
+		Span<u32> indices;
+		u8 *hidden;
+	};
+	List<TestJob> test_jobs;
+	test_jobs.allocator = temporary_allocator;
+
+	for (umm begin = 0; begin < visible.count; begin += chunk_size) {
+		auto count = min(visible.count - begin, (umm)chunk_size);
+		test_jobs.add({&buffer, &bounds, Span(visible.data + begin, count), hidden.data + begin});
+	}
+
+	JobCounter counter;
+	for (auto &test_job : test_jobs) {
+		push(jobs, {
+			.function = [](void *data) {
+				auto &job = *(TestJob *)data;
+				for (umm i = 0; i < job.indices.count; ++i) {
+					auto index = job.indices.data[i];
+					auto &bounds = *job.bounds;
+					job.hidden[i] = is_occluded(*job.buffer, {bounds.center_x[index], bounds.center_y[index], bounds.center_z[index]}, {bounds.extent_x[index], bounds.extent_y[index], bounds.extent_z[index]});
+				}
+			},
+			.data = &test_job,
+			.counter = &counter,
+		});
+	}
+	wait(jobs, counter);
+
+	umm kept_count = 0;
+	for (umm i = 0; i < visible.count; ++i) {
+		if (!hidden[i]) {
+			visible[kept_count++] = visible[i];
+		}
+	}
+	app->occluded_object_count += (u32)(visible.count - kept_count);
+	app->visible_object_count -= (u32)(visible.count - kept_count);
+	visible.resize(kept_count);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <t3d/common.h>
+
+struct Scene;
+struct SceneBounds;
+struct JobSystem;
+
+//
+// Occlusion culling on the CPU.
+//
+// A few renderers that are big on screen are picked as occluders and their triangles are rasterized into a small
+// depth buffer that keeps the nearest depth of every pixel. Then a hierarchical-Z pyramid is built from it, where every texel
+// has the farthest depth of the four texels below. A box is hidden if its nearest point is behind the farthest depth of the
+// pyramid texels that cover its screen rectangle. Texels are picked from the level where the rectangle covers at most 2x2.
+//
+// Rasterization is split into bands of rows, one job per band, so jobs never write the same pixel.
+// Pixels are processed four at a time with SSE.
+//
+
+struct OcclusionBuffer {
+	static constexpr u32 width = 256;
+	static constexpr u32 height = 128;
+	static constexpr u32 level_count = 8;
+	static constexpr u32 band_height = 16;
+
+	static constexpr u32 max_occluders = 16;
+	static constexpr u32 max_occluder_triangles = 4096;
+
+	// Boxes that are smaller on screen than this are not used as occluders. Squared ratio of box radius to its distance.
+	static constexpr f32 min_occluder_score = 0.01f;
+
+	// x and y are in pixels, z is depth in [0, 1]
+	struct Triangle {
+		v3f a, b, c;
+	};
+
+	// Per occluder, so occluders can be set up in parallel
+	List<v4f> occluder_vertices[max_occluders];
+	List<Triangle> occluder_triangles[max_occluders];
+	u32 occluder_count;
+
+	// Level 0 is `width` x `height`, every next level is half of that
+	List<f32> levels[level_count];
+
+	m4 world_to_clip;
+
+	OcclusionBuffer() {
+		for (u32 i = 0; i < max_occluders; ++i) {
+			occluder_vertices[i].allocator = default_allocator;
+			occluder_triangles[i].allocator = default_allocator;
+		}
+		for (auto &level : levels) {
+			level.allocator = default_allocator;
+		}
+	}
+};
+
+void free(OcclusionBuffer &buffer);
+
+// Lower level interface, `render_occluders` is made of these.
+// Call `begin_occluders`, then `add_occluder` at most `max_occluders` times, then `rasterize_occluders`.
+void begin_occluders(OcclusionBuffer &buffer, m4 const &world_to_clip);
+void add_occluder(OcclusionBuffer &buffer, Span<v3f> positions, Span<u32> indices, m4 const &local_to_world);
+void rasterize_occluders(OcclusionBuffer &buffer, JobSystem &jobs);
+
+// Is a box hidden by occluders of last `rasterize_occluders`
+bool is_occluded(OcclusionBuffer &buffer, v3f center, v3f extent);
+
+// Picks occluders from `candidates`, which point into `scene.bounds.renderers`, and renders them into `buffer`
+void render_occluders(OcclusionBuffer &buffer, Scene &scene, Span<u32> candidates, m4 const &world_to_clip, v3f camera_position, JobSystem &jobs);
+
+// Removes renderers that are hidden by occluders of last `render_occluders` from `visible`. Counts them in `app->occluded_object_count`.
+void cull_occluded(OcclusionBuffer &buffer, SceneBounds &bounds, List<u32> &visible, JobSystem &jobs);
@@ -1,13 +1,17 @@
 #pragma once
 #include "common.h"
+#include "render_graph.h"
 
+//
+// Post effects add their passes to camera's render graph. `source` is the previous image, `destination` is where
+// the result goes. Intermediate targets should be transients of the graph, so they are not held between frames.
+//
 struct PostEffect {
 	Allocator allocator = current_allocator;
 	void *data;
 	void (*_init)(void *data);
 	void (*_free)(void *data);
-	void (*_render)(void *data, tg::RenderTarget *source, tg::RenderTarget *destination);
-	void (*_resize)(void *data, v2u size);
+	void (*_add_passes)(void *data, RenderGraph &graph, RenderResource source, RenderResource destination);
 
 	void init() {
 		_init(data);
@@ -16,15 +20,11 @@ struct PostEffect {
 		_free(data);
 		allocator.free(data);
 	}
-	void render(tg::RenderTarget *source, tg::RenderTarget *destination) {
-		_render(data, source, destination);
-	}
-	void resize(v2u size) {
-		_resize(data, size);
+	void add_passes(RenderGraph &graph, RenderResource source, RenderResource destination) {
+		_add_passes(data, graph, source, destination);
 	}
 };
 
 template <class Effect> void post_effect_init(void *data) { ((Effect *)data)->init(); }
 template <class Effect> void post_effect_free(void *data) { ((Effect *)data)->free(); }
-template <class Effect> void post_effect_render(void *data, tg::RenderTarget *source, tg::RenderTarget *destination) { ((Effect *)data)->render(source, destination); }
-template <class Effect> void post_effect_resize(void *data, v2u size) { ((Effect *)data)->resize(size); }
+template <class Effect> void post_effect_add_passes(void *data, RenderGraph &graph, RenderResource source, RenderResource destination) { ((Effect *)data)->add_passes(graph, source, destination); }
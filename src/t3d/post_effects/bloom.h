@@ -13,11 +13,8 @@ struct Bloom {
 	tg::Shader *blur_y_shader;
 	tg::TypedShaderConstants<Constants> constants;
 
-	struct TempRenderTarget {
-		tg::RenderTarget *source;
-		tg::RenderTarget *destination;
-	};
-	List<TempRenderTarget> temp_targets;
+	static constexpr u32 level_count = 8;
+
 	f32 threshold = 1;
 	f32 intensity = 0.2f;
 
@@ -147,93 +144,81 @@ void main() {
 )"s));
 	}
 
-	void render(tg::RenderTarget *source, tg::RenderTarget *destination) {
+	//
+	// Each level is downsampled from the previous one, then blurred in x and y. All blurred levels are added to the source.
+	//
+	void add_passes(RenderGraph &graph, RenderResource source, RenderResource destination) {
+		v2u size = get_description(graph, source).size;
 
-		app->tg->set_rasterizer(
-			app->tg->get_rasterizer()
-				.set_depth_test(false)
-				.set_depth_write(false)
-		);
-
-		app->tg->set_shader(downsample_filter_shader);
-		app->tg->set_shader_constants(constants, 0);
-		app->tg->set_sampler(tg::Filtering_linear, 0);
+		RenderResource downsampled[level_count];
+		RenderResource blurred[level_count];
 
 		auto sample_from = source;
-		for (auto &target : temp_targets) {
-			app->tg->set_render_target(target.destination);
-			app->tg->set_viewport(target.destination->color->size);
-			app->tg->set_texture(sample_from->color, 0);
-			app->tg->update_shader_constants(constants, {.texel_size = 1.0f / (v2f)sample_from->color->size, .threshold = threshold});
-			app->tg->draw(3);
+		for (u32 level = 0; level < level_count; ++level) {
+			downsampled[level] = create_transient(graph, {.size = size, .format = tg::Format_rgb_f16});
 
-			swap(target.source, target.destination);
+			auto shader = level == 0 ? downsample_filter_shader : downsample_shader;
+			add_pass(graph, u8"bloom downsample"s, {sample_from}, {downsampled[level]}, [this, shader, sample_from, target = downsampled[level]](RenderGraph &graph) {
+				auto from = get_target(graph, sample_from);
+				app->tg->update_shader_constants(constants, {.texel_size = 1.0f / (v2f)from->color->size, .threshold = threshold});
+				draw_fullscreen(shader, from, get_target(graph, target));
+			});
 
-			sample_from = target.source;
+			sample_from = downsampled[level];
 
-			if (&target == &temp_targets.front())
-				app->tg->set_shader(downsample_shader);
+			size.x /= 2;
+			size.y /= 2;
 		}
 
-		app->tg->set_shader(blur_x_shader);
-		for (auto &target : temp_targets) {
-			app->tg->set_render_target(target.destination);
-			app->tg->set_viewport(target.destination->color->size);
-			app->tg->set_texture(target.source->color, 0);
-			app->tg->draw(3);
-			swap(target.source, target.destination);
-		}
+		for (u32 level = 0; level < level_count; ++level) {
+			auto blurred_x = create_transient(graph, get_description(graph, downsampled[level]));
+			add_pass(graph, u8"bloom blur x"s, {downsampled[level]}, {blurred_x}, [this, from = downsampled[level], to = blurred_x](RenderGraph &graph) {
+				draw_fullscreen(blur_x_shader, get_target(graph, from), get_target(graph, to));
+			});
 
-		app->tg->set_shader(blur_y_shader);
-		for (auto &target : temp_targets) {
-			app->tg->set_render_target(target.destination);
-			app->tg->set_viewport(target.destination->color->size);
-			app->tg->set_texture(target.source->color, 0);
-			app->tg->draw(3);
-			swap(target.source, target.destination);
+			blurred[level] = create_transient(graph, get_description(graph, downsampled[level]));
+			add_pass(graph, u8"bloom blur y"s, {blurred_x}, {blurred[level]}, [this, from = blurred_x, to = blurred[level]](RenderGraph &graph) {
+				draw_fullscreen(blur_y_shader, get_target(graph, from), get_target(graph, to));
+			});
 		}
 
-		app->tg->set_shader(app->blit_texture_shader);
+		RenderResource composite_inputs[level_count + 1];
+		composite_inputs[0] = source;
+		memcpy(composite_inputs + 1, blurred, sizeof(blurred));
+
+		add_pass(graph, u8"bloom composite"s, array_as_span(composite_inputs), Span(&destination, 1), [this, source, destination, blurred](RenderGraph &graph) {
+			auto target = get_target(graph, destination);
+
+			draw_fullscreen(app->blit_texture_shader, get_target(graph, source), target);
+
+			app->tg->set_shader(app->blit_texture_color_shader);
+			app->tg->update_shader_constants(app->blit_texture_color_constants, {.color = V4f(intensity)});
+			app->tg->set_shader_constants(app->blit_texture_color_constants, 0);
+			app->tg->set_blend(tg::BlendFunction_add, tg::Blend_one, tg::Blend_one);
+			for (auto level : blurred) {
+				app->tg->set_texture(get_target(graph, level)->color, 0);
+				app->tg->draw(3);
+			}
+		});
+	}
+
+	// Fullscreen triangle with `shader` sampling `source`
+	void draw_fullscreen(tg::Shader *shader, tg::RenderTarget *source, tg::RenderTarget *destination) {
+		app->tg->set_rasterizer(
+			app->tg->get_rasterizer()
+				.set_depth_test(false)
+				.set_depth_write(false)
+		);
+		app->tg->disable_blend();
+
+		app->tg->set_shader(shader);
+		app->tg->set_shader_constants(constants, 0);
+		app->tg->set_sampler(tg::Filtering_linear, 0);
 		app->tg->set_render_target(destination);
 		app->tg->set_viewport(destination->color->size);
-		app->tg->disable_blend();
 		app->tg->set_texture(source->color, 0);
 		app->tg->draw(3);
-
-		app->tg->set_shader(app->blit_texture_color_shader);
-		app->tg->update_shader_constants(app->blit_texture_color_constants, {.color = V4f(intensity)});
-		app->tg->set_shader_constants(app->blit_texture_color_constants, 0);
-		app->tg->set_blend(tg::BlendFunction_add, tg::Blend_one, tg::Blend_one);
-		for (auto &target : temp_targets) {
-			app->tg->set_texture(target.source->color, 0);
-			app->tg->draw(3);
-		}
 	}
 
-	void resize(v2u size) {
-		v2u next_size = size;
-		u32 target_index = 0;
-
-		for (u32 target_index = 0; target_index < 8; ++target_index) {
-			if (target_index < temp_targets.count) {
-				app->tg->resize_texture(temp_targets[target_index].source     ->color, next_size);
-				app->tg->resize_texture(temp_targets[target_index].destination->color, next_size);
-			} else {
-				auto create_temp_target = [&]() {
-					return app->tg->create_render_target(
-						app->tg->create_texture_2d(next_size.x, next_size.y, 0, tg::Format_rgb_f16),
-						0
-					);
-				};
-				temp_targets.add({
-					create_temp_target(),
-					create_temp_target(),
-				});
-			}
-
-			next_size.x /= 2;
-			next_size.y /= 2;
-		}
-	}
 	void free() {}
 };
@@ -56,6 +56,12 @@ void main() {
 )"s);
 	}
 
+	void add_passes(RenderGraph &graph, RenderResource source, RenderResource destination) {
+		add_pass(graph, u8"dither"s, {source}, {destination}, [this, source, destination](RenderGraph &graph) {
+			render(get_target(graph, source), get_target(graph, destination));
+		});
+	}
+
 	void render(tg::RenderTarget *source, tg::RenderTarget *destination) {
 		app->tg->set_rasterizer(
 			app->tg->get_rasterizer()
@@ -70,11 +76,11 @@ void main() {
 		app->tg->update_shader_constants(constants, {.time = app->time, .frame_index = app->frame_index});
 
 		app->tg->set_render_target(destination);
+		app->tg->set_viewport(destination->color->size);
 		app->tg->set_sampler(tg::Filtering_nearest, 0);
 		app->tg->set_texture(source->color, 0);
 		app->tg->draw(3);
 	}
 
-	void resize(v2u size) {}
 	void free() {}
 };
@@ -30,7 +30,6 @@ struct Exposure {
 	f32 adapted_exposure = 1;
 	f32 limit_min = 0;
 	f32 limit_max = 1 << 24;
-	List<tg::RenderTarget *> downsampled_targets;
 	bool auto_adjustment;
 
 	void init() {
@@ -79,80 +78,112 @@ void main() {
 	}
 
 
-	void render(tg::RenderTarget *source, tg::RenderTarget *destination) {
+	void add_passes(RenderGraph &graph, RenderResource source, RenderResource destination) {
+		// Image is downsampled to `min_texture_size` and read back to measure brightness
+		auto measured = source;
+		if (auto_adjustment) {
+			auto size = get_description(graph, source).size;
+			v2u next_size = max(floor_to_power_of_2(size - 1), V2u(min_texture_size));
+			while (1) {
+				auto downsampled = create_transient(graph, {.size = next_size, .format = tg::Format_rgb_f16});
+				add_pass(graph, u8"exposure downsample"s, {measured}, {downsampled}, [this, measured, downsampled](RenderGraph &graph) {
+					downsample(get_target(graph, measured), get_target(graph, downsampled));
+				});
+				measured = downsampled;
+
+				if (next_size.x == Exposure::min_texture_size && next_size.y == Exposure::min_texture_size) break;
+
+				if (next_size.x != Exposure::min_texture_size) next_size.x /= 2;
+				if (next_size.y != Exposure::min_texture_size) next_size.y /= 2;
+			}
+		}
+
+		add_pass(graph, u8"exposure"s, {source, measured}, {destination}, [this, source, measured, destination](RenderGraph &graph) {
+			if (auto_adjustment) {
+				adapt(get_target(graph, measured));
+			}
+			render(get_target(graph, source), get_target(graph, destination));
+		});
+	}
+
+	void downsample(tg::RenderTarget *source, tg::RenderTarget *destination) {
+		timed_block("blit"s);
 		app->tg->set_rasterizer(
 			app->tg->get_rasterizer()
 				.set_depth_test(false)
 				.set_depth_write(false)
 		);
+		app->tg->disable_blend();
 
-		if (auto_adjustment) {
-			app->tg->disable_blend();
-
-			app->tg->set_shader(app->blit_texture_shader);
-			app->tg->set_sampler(tg::Filtering_linear, 0);
-
-			auto sample_from = source;
-			for (auto &target : downsampled_targets) {
-				timed_block("blit"s);
-				app->tg->set_render_target(target);
-				app->tg->set_viewport(target->color->size);
-				app->tg->set_texture(sample_from->color, 0);
-				app->tg->draw(3);
-				sample_from = target;
-			}
+		app->tg->set_shader(app->blit_texture_shader);
+		app->tg->set_sampler(tg::Filtering_linear, 0);
+		app->tg->set_render_target(destination);
+		app->tg->set_viewport(destination->color->size);
+		app->tg->set_texture(source->color, 0);
+		app->tg->draw(3);
+	}
 
-			v3f texels[Exposure::min_texture_size * Exposure::min_texture_size];
+	// `measured` is `min_texture_size` squared
+	void adapt(tg::RenderTarget *measured) {
+		v3f texels[Exposure::min_texture_size * Exposure::min_texture_size];
 
-			{
-				timed_block("tg::read_texture"s);
-				app->tg->read_texture(downsampled_targets.back()->color, as_bytes(array_as_span(texels)));
-			}
-			{
-				timed_block("average"s);
-				f32 target_exposure = 0;
-				switch (mask_kind) {
-					case Exposure::Mask_one: {
-						f32 sum_luminance = 0;
-						for (auto texel : texels) {
-							sum_luminance += max(texel.x, texel.y, texel.z);
-						}
-						if (sum_luminance == 0) {
-							target_exposure = limit_max;
-						} else {
-							target_exposure = clamp(1 / sum_luminance * count_of(texels), limit_min, limit_max);
-						}
-						break;
+		{
+			timed_block("tg::read_texture"s);
+			app->tg->read_texture(measured->color, as_bytes(array_as_span(texels)));
+		}
+		{
+			timed_block("average"s);
+			f32 target_exposure = 0;
+			switch (mask_kind) {
+				case Exposure::Mask_one: {
+					f32 sum_luminance = 0;
+					for (auto texel : texels) {
+						sum_luminance += max(texel.x, texel.y, texel.z);
 					}
-					case Exposure::Mask_proximity: {
-						f32 sum_luminance = 0;
-						f32 sum_mask = 0;
-						for (u32 y = 0; y < Exposure::min_texture_size; ++y) {
-							for (u32 x = 0; x < Exposure::min_texture_size; ++x) {
-								auto texel = texels[y*Exposure::min_texture_size+x];
-								f32 dist = distance(V2f(x,y), V2f(63)*0.5);
-
-								constexpr f32 inv_diagonal = 1 / max(1, tl::sqrt(pow2(Exposure::min_texture_size * 0.5f - 0.5f) * 2));
-
-								f32 mask = map_clamped(dist * inv_diagonal, mask_radius, 0.0f, 0.0f, 1.0f);
-								sum_mask += mask;
-								sum_luminance += mask * max(texel.x, texel.y, texel.z);
-							}
-						}
-						if (sum_luminance == 0) {
-							target_exposure = limit_max;
-						} else {
-							target_exposure = clamp(1 / sum_luminance * sum_mask, limit_min, limit_max);
+					if (sum_luminance == 0) {
+						target_exposure = limit_max;
+					} else {
+						target_exposure = clamp(1 / sum_luminance * count_of(texels), limit_min, limit_max);
+					}
+					break;
+				}
+				case Exposure::Mask_proximity: {
+					f32 sum_luminance = 0;
+					f32 sum_mask = 0;
+					for (u32 y = 0; y < Exposure::min_texture_size; ++y) {
+						for (u32 x = 0; x < Exposure::min_texture_size; ++x) {
+							auto texel = texels[y*Exposure::min_texture_size+x];
+							f32 dist = distance(V2f(x,y), V2f(63)*0.5);
+
+							constexpr f32 inv_diagonal = 1 / max(1, tl::sqrt(pow2(Exposure::min_texture_size * 0.5f - 0.5f) * 2));
+
+							f32 mask = map_clamped(dist * inv_diagonal, mask_radius, 0.0f, 0.0f, 1.0f);
+							sum_mask += mask;
+							sum_luminance += mask * max(texel.x, texel.y, texel.z);
 						}
-						break;
 					}
-					default:
-						invalid_code_path("mask_kind is invalid");
-						break;
+					if (sum_luminance == 0) {
+						target_exposure = limit_max;
+					} else {
+						target_exposure = clamp(1 / sum_luminance * sum_mask, limit_min, limit_max);
+					}
+					break;
 				}
-				adapted_exposure = pow(2, lerp(log2(adapted_exposure), log2(target_exposure), app->frame_time));
+				default:
+					invalid_code_path("mask_kind is invalid");
+					break;
 			}
+			adapted_exposure = pow(2, lerp(log2(adapted_exposure), log2(target_exposure), app->frame_time));
 		}
+	}
+
+	void render(tg::RenderTarget *source, tg::RenderTarget *destination) {
+		app->tg->set_rasterizer(
+			app->tg->get_rasterizer()
+				.set_depth_test(false)
+				.set_depth_write(false)
+		);
+		app->tg->disable_blend();
 
 		app->tg->update_shader_constants(constants, {
 			.exposure_offset = adapted_exposure * exposure,
@@ -167,28 +198,5 @@ void main() {
 		app->tg->draw(3);
 	}
 
-	void resize(v2u size) {
-		if (size.x == 0) size.x = 1;
-		if (size.y == 0) size.y = 1;
-		v2u next_size = max(floor_to_power_of_2(size - 1), V2u(min_texture_size));
-		u32 target_index = 0;
-		while (1) {
-			if (target_index < downsampled_targets.count) {
-				app->tg->resize_texture(downsampled_targets[target_index]->color, next_size);
-			} else {
-				downsampled_targets.add(app->tg->create_render_target(
-					app->tg->create_texture_2d(next_size.x, next_size.y, 0, tg::Format_rgb_f16),
-					0
-				));
-			}
-
-			if (next_size.x == Exposure::min_texture_size && next_size.y == Exposure::min_texture_size) break;
-
-			if (next_size.x != Exposure::min_texture_size) next_size.x /= 2;
-			if (next_size.y != Exposure::min_texture_size) next_size.y /= 2;
-
-			++target_index;
-		}
-	}
 	void free() {}
 };
@@ -0,0 +1,206 @@
+#include "render_graph.h"
+#include <t3d/app.h>
+#include <tl/profiler.h>
+
+static umm get_bytes_per_texel(tg::Format format) {
+	switch (format) {
+		case tg::Format_rgb_u8n:  return 3;
+		case tg::Format_rgba_u8n: return 4;
+		case tg::Format_rgb_f16:  return 6;
+		case tg::Format_depth:    return 4;
+		default: invalid_code_path("format is not supported by render graph"); return 0;
+	}
+}
+
+umm get_size_in_bytes(RenderTargetDescription description) {
+	auto bytes_per_texel = get_bytes_per_texel(description.format);
+	if (description.depth) {
+		bytes_per_texel += get_bytes_per_texel(tg::Format_depth);
+	}
+	return (umm)description.size.x * description.size.y * bytes_per_texel;
+}
+
+void free(RenderTargetPool &pool) {
+	// tg can't free textures
+	free(pool.targets);
+}
+
+void begin_frame(RenderTargetPool &pool) {
+	pool.unaliased_bytes = 0;
+
+	for (auto &pooled : pool.targets) {
+		assert(!pooled.in_use, "render target was not released");
+
+		if (pooled.description.size.x == 1 && pooled.description.size.y == 1)
+			continue;
+
+		if (pooled.last_used_frame + RenderTargetPool::trim_frame_count <= app->frame_index) {
+			pool.allocated_bytes -= get_size_in_bytes(pooled.description);
+			pooled.description.size = {1, 1};
+			pool.allocated_bytes += get_size_in_bytes(pooled.description);
+
+			app->tg->resize_texture(pooled.target->color, pooled.description.size);
+			if (pooled.target->depth) {
+				app->tg->resize_texture(pooled.target->depth, pooled.description.size);
+			}
+		}
+	}
+}
+
+tg::RenderTarget *acquire(RenderTargetPool &pool, RenderTargetDescription description) {
+	pool.unaliased_bytes += get_size_in_bytes(description);
+
+	auto use = [&](PooledRenderTarget &pooled) {
+		pooled.in_use = true;
+		pooled.last_used_frame = app->frame_index;
+		return pooled.target;
+	};
+
+	for (auto &pooled : pool.targets) {
+		if (!pooled.in_use && pooled.description == description) {
+			return use(pooled);
+		}
+	}
+
+	// Trimmed targets of the same formats can be resized instead of creating new ones
+	for (auto &pooled : pool.targets) {
+		if (!pooled.in_use && pooled.description.size.x == 1 && pooled.description.size.y == 1 && pooled.description.format == description.format && pooled.description.depth == description.depth) {
+			pool.allocated_bytes -= get_size_in_bytes(pooled.description);
+			pooled.description = description;
+			pool.allocated_bytes += get_size_in_bytes(pooled.description);
+
+			app->tg->resize_texture(pooled.target->color, description.size);
+			if (description.depth) {
+				app->tg->resize_texture(pooled.target->depth, description.size);
+			}
+			return use(pooled);
+		}
+	}
+
+	auto color = app->tg->create_texture_2d(description.size.x, description.size.y, 0, description.format);
+	auto depth = description.depth ? app->tg->create_texture_2d(description.size.x, description.size.y, 0, tg::Format_depth) : 0;
+
+	pool.targets.add({
+		.description = description,
+		.target = app->tg->create_render_target(color, depth),
+	});
+	pool.allocated_bytes += get_size_in_bytes(description);
+	return use(pool.targets.back());
+}
+
+void release(RenderTargetPool &pool, tg::RenderTarget *target) {
+	for (auto &pooled : pool.targets) {
+		if (pooled.target == target) {
+			assert(pooled.in_use);
+			pooled.in_use = false;
+			return;
+		}
+	}
+	invalid_code_path("render target is not from this pool");
+}
+
+static constexpr u32 no_pass = ~0u;
+
+RenderGraph create_render_graph(RenderTargetPool &pool) {
+	RenderGraph graph;
+	graph.pool = &pool;
+	graph.resources.allocator = temporary_allocator;
+	graph.passes.allocator = temporary_allocator;
+	return graph;
+}
+
+RenderResource create_transient(RenderGraph &graph, RenderTargetDescription description) {
+	if (description.size.x == 0) description.size.x = 1;
+	if (description.size.y == 0) description.size.y = 1;
+
+	graph.resources.add({
+		.description = description,
+		.first_pass = no_pass,
+		.last_pass = no_pass,
+	});
+	return (RenderResource)graph.resources.count - 1;
+}
+
+// Only cameras' HDR targets are imported for now
+RenderResource import_target(RenderGraph &graph, tg::RenderTarget *target) {
+	graph.resources.add({
+		.description = {
+			.size = target->color->size,
+			.format = tg::Format_rgb_f16,
+			.depth = target->depth != 0,
+		},
+		.target = target,
+		.imported = true,
+		.first_pass = no_pass,
+		.last_pass = no_pass,
+	});
+	return (RenderResource)graph.resources.count - 1;
+}
+
+RenderTargetDescription get_description(RenderGraph &graph, RenderResource resource) {
+	return graph.resources[resource].description;
+}
+
+tg::RenderTarget *get_target(RenderGraph &graph, RenderResource resource) {
+	auto target = graph.resources[resource].target;
+	assert(target, "resource is not alive, add it to pass's inputs or outputs");
+	return target;
+}
+
+void add_pass(RenderGraph &graph, Span<utf8> name, Span<RenderResource> inputs, Span<RenderResource> outputs, void (*execute)(void *data, RenderGraph &graph), void *data) {
+	graph.passes.add({
+		.name = name,
+		.inputs = with(temporary_allocator, copy(inputs)),
+		.outputs = with(temporary_allocator, copy(outputs)),
+		.execute = execute,
+		.data = data,
+	});
+}
+
+void execute(RenderGraph &graph) {
+	timed_function();
+
+	//
+	// Lifetime of a transient is from the first pass that writes it to the last pass that uses it
+	//
+	for (u32 pass_index = 0; pass_index < graph.passes.count; ++pass_index) {
+		auto &pass = graph.passes[pass_index];
+		for (auto input : pass.inputs) {
+			auto &resource = graph.resources[input];
+			assert(resource.imported || resource.first_pass != no_pass, "transient is read before it is written");
+			resource.last_pass = pass_index;
+		}
+		for (auto output : pass.outputs) {
+			auto &resource = graph.resources[output];
+			if (resource.first_pass == no_pass) {
+				resource.first_pass = pass_index;
+			}
+			resource.last_pass = pass_index;
+		}
+	}
+
+	for (u32 pass_index = 0; pass_index < graph.passes.count; ++pass_index) {
+		auto &pass = graph.passes[pass_index];
+
+		for (auto output : pass.outputs) {
+			auto &resource = graph.resources[output];
+			if (!resource.imported && resource.first_pass == pass_index) {
+				resource.target = acquire(*graph.pool, resource.description);
+			}
+		}
+
+		pass.execute(pass.data, graph);
+
+		auto release_dead = [&](Span<RenderResource> resources) {
+			for (auto index : resources) {
+				auto &resource = graph.resources[index];
+				if (!resource.imported && resource.last_pass == pass_index && resource.target) {
+					release(*graph.pool, resource.target);
+					resource.target = 0;
+				}
+			}
+		};
+		release_dead(pass.inputs);
+		release_dead(pass.outputs);
+	}
+}
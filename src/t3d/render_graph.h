@@ -0,0 +1,113 @@
+#pragma once
+#include <t3d/common.h>
+#include <initializer_list>
+#include <type_traits>
+
+//
+// Render graph of one camera frame. Passes declare which render targets they read and write, `execute` runs them in order.
+//
+// Targets made with `create_transient` have no texture until the first pass that writes them runs, and give it back to
+// `RenderTargetPool` after the last pass that reads them. The next transient with the same description gets the same texture,
+// so targets whose lifetimes don't overlap share memory. The pool keeps textures between graphs and frames: cameras,
+// scene views and post effects all draw into the same few textures instead of owning a set each.
+//
+// Targets made with `import_target`, like a camera's output, belong to someone else and are never pooled.
+//
+
+struct RenderTargetDescription {
+	v2u size;
+	tg::Format format;
+	bool depth;
+
+	bool operator==(RenderTargetDescription const &that) const {
+		return size.x == that.size.x && size.y == that.size.y && format == that.format && depth == that.depth;
+	}
+};
+
+umm get_size_in_bytes(RenderTargetDescription description);
+
+struct PooledRenderTarget {
+	RenderTargetDescription description;
+	tg::RenderTarget *target;
+	u32 last_used_frame;
+	bool in_use;
+};
+
+struct RenderTargetPool {
+	// Free targets unused for this many frames are shrunk to one texel. tg can't free textures, so they are resized instead.
+	static constexpr u32 trim_frame_count = 8;
+
+	List<PooledRenderTarget> targets;
+
+	// Memory of all pooled textures
+	umm allocated_bytes;
+
+	// Sum of memory of all transients in this frame. That's what it would take if every target had its own textures,
+	// as cameras and post effects did before they were pooled.
+	umm unaliased_bytes;
+
+	RenderTargetPool() {
+		targets.allocator = default_allocator;
+	}
+};
+
+void free(RenderTargetPool &pool);
+void begin_frame(RenderTargetPool &pool);
+
+tg::RenderTarget *acquire(RenderTargetPool &pool, RenderTargetDescription description);
+void release(RenderTargetPool &pool, tg::RenderTarget *target);
+
+using RenderResource = u32;
+
+struct RenderGraph {
+	struct Resource {
+		RenderTargetDescription description;
+		tg::RenderTarget *target; // Imported target, or transient's pooled one while it is alive
+		bool imported;
+		u32 first_pass;
+		u32 last_pass;
+	};
+
+	struct Pass {
+		Span<utf8> name;
+		Span<RenderResource> inputs;
+		Span<RenderResource> outputs;
+		void (*execute)(void *data, RenderGraph &graph);
+		void *data;
+	};
+
+	RenderTargetPool *pool;
+
+	// Use temporary allocator, graph lives for one frame
+	List<Resource> resources;
+	List<Pass> passes;
+};
+
+RenderGraph create_render_graph(RenderTargetPool &pool);
+
+RenderResource create_transient(RenderGraph &graph, RenderTargetDescription description);
+RenderResource import_target(RenderGraph &graph, tg::RenderTarget *target);
+
+RenderTargetDescription get_description(RenderGraph &graph, RenderResource resource);
+
+// Valid only inside of a pass that has `resource` in its inputs or outputs
+tg::RenderTarget *get_target(RenderGraph &graph, RenderResource resource);
+
+void add_pass(RenderGraph &graph, Span<utf8> name, Span<RenderResource> inputs, Span<RenderResource> outputs, void (*execute)(void *data, RenderGraph &graph), void *data);
+
+// `execute` is called as `execute(graph)` when the pass runs. It is copied into temporary memory and never destroyed.
+template <class Execute>
+void add_pass(RenderGraph &graph, Span<utf8> name, Span<RenderResource> inputs, Span<RenderResource> outputs, Execute &&execute) {
+	using Function = std::remove_cvref_t<Execute>;
+	static_assert(std::is_trivially_destructible_v<Function>);
+
+	auto data = new (temporary_allocator.allocate(sizeof(Function), alignof(Function))) Function(execute);
+	add_pass(graph, name, inputs, outputs, [](void *data, RenderGraph &graph) { (*(Function *)data)(graph); }, data);
+}
+
+template <class Execute>
+void add_pass(RenderGraph &graph, Span<utf8> name, std::initializer_list<RenderResource> inputs, std::initializer_list<RenderResource> outputs, Execute &&execute) {
+	add_pass(graph, name, Span((RenderResource *)inputs.begin(), inputs.size()), Span((RenderResource *)outputs.begin(), outputs.size()), execute);
+}
+
+void execute(RenderGraph &graph);
@@ -0,0 +1,198 @@
+#include "render_queue.h"
+#include <t3d/app.h>
+#include <t3d/mesh.h>
+#include <tl/profiler.h>
+
+void free(RenderQueue &queue) {
+	free(queue.packets);
+	free(queue.sort_scratch);
+	free(queue.ids);
+}
+
+u32 get_id(RenderQueue &queue, void *object) {
+	auto found = queue.ids.find(object);
+	if (found) {
+		return found.get();
+	}
+	auto id = queue.next_id++;
+	queue.ids.get_or_insert(object) = id;
+	return id;
+}
+
+u64 make_sort_key(RenderPass pass, u32 shader_id, u32 material_id, u32 mesh_id, f32 depth) {
+	auto quantized_depth = (u64)(clamp(depth, 0.0f, 1.0f) * ((1 << 20) - 1));
+	return
+		((u64)pass                  << 60) |
+		((u64)(shader_id   & 0xfff) << 48) |
+		((u64)(material_id & 0xfff) << 36) |
+		((u64)(mesh_id    & 0xffff) << 20) |
+		quantized_depth;
+}
+
+void sort(RenderQueue &queue) {
+	timed_function();
+
+	auto count = queue.packets.count;
+	if (count < 2)
+		return;
+
+	queue.sort_scratch.resize(count);
+
+	auto source = queue.packets.data;
+	auto destination = queue.sort_scratch.data;
+
+	// Least significant byte first. Bytes that are the same in all keys are skipped.
+	for (u32 shift = 0; shift < 64; shift += 8) {
+		u32 offsets[256] = {};
+		for (umm i = 0; i < count; ++i) {
+			offsets[(source[i].key >> shift) & 0xff] += 1;
+		}
+
+		if (offsets[(source[0].key >> shift) & 0xff] == count)
+			continue;
+
+		u32 total = 0;
+		for (auto &offset : offsets) {
+			auto bucket_count = offset;
+			offset = total;
+			total += bucket_count;
+		}
+
+		for (umm i = 0; i < count; ++i) {
+			destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+		}
+		swap(source, destination);
+	}
+
+	if (source != queue.packets.data) {
+		memcpy(queue.packets.data, source, count * sizeof(DrawPacket));
+	}
+}
+
+Span<DrawPacket> get_packets(RenderQueue &queue, RenderPass pass) {
+	umm begin = 0;
+	while (begin < queue.packets.count && get_pass(queue.packets[begin].key) < pass) {
+		++begin;
+	}
+	umm end = begin;
+	while (end < queue.packets.count && get_pass(queue.packets[end].key) == pass) {
+		++end;
+	}
+	return Span(queue.packets.data + begin, end - begin);
+}
+
+void RenderStateTracker::reset() {
+	shader = 0;
+	for (auto &slot_constants : constants) {
+		slot_constants = 0;
+	}
+	for (auto &texture : textures) {
+		texture = 0;
+	}
+	for (auto &sampler : samplers) {
+		sampler.is_set = false;
+	}
+	mesh = 0;
+	index_buffer = 0;
+}
+
+void RenderStateTracker::set_shader(tg::Shader *new_shader) {
+	if (shader == new_shader) {
+		skipped_count += 1;
+		return;
+	}
+	shader = new_shader;
+	app->tg->set_shader(new_shader);
+	issued_count += 1;
+}
+
+void RenderStateTracker::set_shader_constants(tg::ShaderConstants *new_constants, u32 slot) {
+	if (constants[slot] == new_constants) {
+		skipped_count += 1;
+		return;
+	}
+	constants[slot] = new_constants;
+	app->tg->set_shader_constants(new_constants, slot);
+	issued_count += 1;
+}
+
+void RenderStateTracker::set_texture(tg::Texture2D *texture, u32 slot) {
+	if (textures[slot] == texture) {
+		skipped_count += 1;
+		return;
+	}
+	textures[slot] = texture;
+	app->tg->set_texture(texture, slot);
+	issued_count += 1;
+}
+
+void RenderStateTracker::set_sampler(tg::Filtering filtering, u32 slot) {
+	auto &sampler = samplers[slot];
+	if (sampler.is_set && !sampler.has_comparison && sampler.filtering == filtering) {
+		skipped_count += 1;
+		return;
+	}
+	sampler = {.filtering = filtering, .has_comparison = false, .is_set = true};
+	app->tg->set_sampler(filtering, slot);
+	issued_count += 1;
+}
+
+void RenderStateTracker::set_sampler(tg::Filtering filtering, tg::Comparison comparison, u32 slot) {
+	auto &sampler = samplers[slot];
+	if (sampler.is_set && sampler.has_comparison && sampler.filtering == filtering && sampler.comparison == comparison) {
+		skipped_count += 1;
+		return;
+	}
+	sampler = {.filtering = filtering, .comparison = comparison, .has_comparison = true, .is_set = true};
+	app->tg->set_sampler(filtering, comparison, slot);
+	issued_count += 1;
+}
+
+// Level 0 of meshes that were not made by `Assets::create_mesh` and have no `lods`
+static MeshLod get_lod(Mesh *mesh, u32 lod) {
+	if (!mesh->lods.count) {
+		return {.index_buffer = mesh->index_buffer, .index_count = mesh->index_count};
+	}
+	return mesh->lods[min(lod, (u32)mesh->lods.count - 1)];
+}
+
+bool RenderStateTracker::set_mesh(Mesh *new_mesh, u32 lod) {
+	if (!new_mesh) {
+		return false;
+	}
+	if (mesh == new_mesh) {
+		skipped_count += 1;
+	} else {
+		mesh = new_mesh;
+		app->tg->set_vertex_buffer(new_mesh->vertex_buffer);
+		issued_count += 1;
+	}
+
+	auto new_index_buffer = get_lod(new_mesh, lod).index_buffer;
+	if (index_buffer == new_index_buffer) {
+		skipped_count += 1;
+	} else {
+		index_buffer = new_index_buffer;
+		app->tg->set_index_buffer(new_index_buffer);
+		issued_count += 1;
+	}
+	return true;
+}
+
+void RenderStateTracker::draw_mesh(Mesh *new_mesh, u32 lod) {
+	if (!set_mesh(new_mesh, lod)) {
+		return;
+	}
+	auto index_count = get_lod(new_mesh, lod).index_count;
+	app->tg->draw_indexed(index_count);
+	triangle_count += index_count / 3;
+}
+
+void RenderStateTracker::draw_mesh_instanced(Mesh *new_mesh, u32 lod, u32 instance_count) {
+	if (!set_mesh(new_mesh, lod)) {
+		return;
+	}
+	auto index_count = get_lod(new_mesh, lod).index_count;
+	app->tg->draw_indexed_instanced(index_count, instance_count);
+	triangle_count += (u64)index_count / 3 * instance_count;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <t3d/common.h>
+
+struct Mesh;
+
+//
+// Draws of a pass are collected as packets with 64-bit sort keys and radix sorted, so draws that share
+// shader, material and mesh end up next to each other. `RenderStateTracker` then drops tg calls that
+// would set state that is already set.
+//
+// Key layout, from most significant bits: pass (4), shader (12), material (12), mesh (16), depth (20).
+// Depth is front to back, so opaque draws are rejected early by depth test.
+//
+
+enum RenderPass : u32 {
+	RenderPass_shadow,
+	RenderPass_single_pass_lighting,
+	RenderPass_multi_pass_lighting,
+};
+
+struct DrawPacket {
+	u64 key;
+	u32 renderer_index; // Into `SceneBounds::renderers`
+};
+
+struct RenderQueue {
+	List<DrawPacket> packets;
+	List<DrawPacket> sort_scratch;
+
+	// Small ids of shaders, materials and meshes to put into keys. Ids that don't fit are wrapped around,
+	// which only makes grouping worse.
+	HashMap<void *, u32> ids;
+	u32 next_id = 0;
+
+	RenderQueue() {
+		packets.allocator = default_allocator;
+		sort_scratch.allocator = default_allocator;
+		ids.allocator = default_allocator;
+	}
+};
+
+void free(RenderQueue &queue);
+
+u32 get_id(RenderQueue &queue, void *object);
+
+// `depth` is in [0, 1], 0 being closest to the camera
+u64 make_sort_key(RenderPass pass, u32 shader_id, u32 material_id, u32 mesh_id, f32 depth);
+
+inline RenderPass get_pass(u64 key) {
+	return (RenderPass)(key >> 60);
+}
+
+// Sorts `queue.packets` by key
+void sort(RenderQueue &queue);
+
+// Packets of `pass`. Queue must be sorted.
+Span<DrawPacket> get_packets(RenderQueue &queue, RenderPass pass);
+
+//
+// Remembers state that was set through it and skips calls that would not change anything.
+// Call `reset` when state could have been changed directly through `app->tg`.
+//
+struct RenderStateTracker {
+	static constexpr u32 slot_count = 16;
+
+	struct Sampler {
+		tg::Filtering filtering;
+		tg::Comparison comparison;
+		bool has_comparison;
+		bool is_set;
+	};
+
+	tg::Shader *shader;
+	tg::ShaderConstants *constants[slot_count];
+	tg::Texture2D *textures[slot_count];
+	Sampler samplers[slot_count];
+	Mesh *mesh;
+	tg::IndexBuffer *index_buffer;
+
+	// State changes that were sent to tg and that were skipped. Reset every frame by `runtime_render`.
+	u32 issued_count;
+	u32 skipped_count;
+
+	// Triangles drawn through `draw_mesh` and `draw_mesh_instanced`, counting every instance. Reset every frame by `runtime_render`.
+	u64 triangle_count;
+
+	void reset();
+
+	void set_shader(tg::Shader *shader);
+	void set_shader_constants(tg::ShaderConstants *constants, u32 slot);
+	void set_texture(tg::Texture2D *texture, u32 slot);
+	void set_sampler(tg::Filtering filtering, u32 slot);
+	void set_sampler(tg::Filtering filtering, tg::Comparison comparison, u32 slot);
+
+	// Binds vertex buffer of `mesh` and index buffer of its level `lod` if they are not bound yet. Returns false for null mesh.
+	bool set_mesh(Mesh *mesh, u32 lod = 0);
+
+	// Bind `mesh` with `set_mesh`, then draw it
+	void draw_mesh(Mesh *mesh, u32 lod = 0);
+	void draw_mesh_instanced(Mesh *mesh, u32 lod, u32 instance_count);
+};
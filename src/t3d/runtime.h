@@ -9,6 +9,10 @@
 #include <t3d/debug.h>
 #include <t3d/serialize.h>
 #include <t3d/blit.h>
+#include <t3d/transform.h>
+#include <t3d/culling.h>
+#include <t3d/light_clusters.h>
+#include <t3d/render_queue.h>
 
 #include <tl/profiler.h>
 
@@ -45,17 +49,82 @@ layout(binding=)" STRINGIZE(ENTITY_CONSTANTS_SLOT) R"(, std140) uniform entity_u
 	mat4 local_to_world_position_matrix;
 	mat4 local_to_world_normal_matrix;
 	mat4 object_rotation_matrix;
+
+	uint instanced;
+};
+
+struct InstanceData {
+	mat4 local_to_world_position_matrix;
+	mat4 local_to_world_normal_matrix;
 };
 
+layout(binding=)" STRINGIZE(INSTANCE_CONSTANTS_SLOT) R"(, std140) uniform instance_uniforms {
+	InstanceData instances[)" STRINGIZE(MAX_INSTANCES) R"(];
+};
+
+#ifdef VERTEX_SHADER
+// Entity matrices that work for both instanced and regular draws
+mat4 get_local_to_world_position_matrix() {
+	return instanced != 0 ? instances[gl_InstanceID].local_to_world_position_matrix : local_to_world_position_matrix;
+}
+mat4 get_local_to_world_normal_matrix() {
+	return instanced != 0 ? instances[gl_InstanceID].local_to_world_normal_matrix : local_to_world_normal_matrix;
+}
+mat4 get_local_to_camera_matrix() {
+	return instanced != 0 ? local_to_camera_matrix * instances[gl_InstanceID].local_to_world_position_matrix : local_to_camera_matrix;
+}
+#endif
+
 layout(binding=)" STRINGIZE(LIGHT_CONSTANTS_SLOT) R"(, std140) uniform light_uniforms {
 	mat4 world_to_light_matrix;
 
 	vec3 light_position;
 	float light_intensity;
 
+	vec4 shadow_uv_rect;
+
 	uint light_index;
 };
 
+struct ForwardLight {
+	mat4 world_to_light_matrix;
+
+	vec3 position;
+	float intensity;
+
+	vec4 shadow_uv_rect;
+
+	int mask_slot;
+};
+
+layout(binding=)" STRINGIZE(FORWARD_LIGHT_CONSTANTS_SLOT) R"(, std140) uniform forward_light_uniforms {
+	ForwardLight forward_lights[)" STRINGIZE(MAX_FORWARD_LIGHTS) R"(];
+	uint forward_light_count;
+};
+
+layout(binding=)" STRINGIZE(LIGHT_CLUSTER_CONSTANTS_SLOT) R"(, std140) uniform light_cluster_uniforms {
+	float cluster_near_plane;
+	float cluster_far_plane;
+	float cluster_log_depth_scale;
+	uint light_clusters_enabled;
+
+	uvec4 cluster_ranges[)" STRINGIZE(CLUSTER_COUNT) R"( / 4];
+	uvec4 cluster_light_indices[)" STRINGIZE(MAX_CLUSTER_LIGHT_INDICES) R"( / 16];
+};
+
+uint get_cluster_index(vec2 ndc, float depth) {
+	uint x = uint(clamp(int((ndc.x * 0.5 + 0.5) * )" STRINGIZE(CLUSTER_COUNT_X) R"(), 0, )" STRINGIZE(CLUSTER_COUNT_X) R"( - 1));
+	uint y = uint(clamp(int((ndc.y * 0.5 + 0.5) * )" STRINGIZE(CLUSTER_COUNT_Y) R"(), 0, )" STRINGIZE(CLUSTER_COUNT_Y) R"( - 1));
+	uint z = uint(clamp(int(log(max(depth, cluster_near_plane) / cluster_near_plane) * cluster_log_depth_scale), 0, )" STRINGIZE(CLUSTER_COUNT_Z) R"( - 1));
+	return (z * )" STRINGIZE(CLUSTER_COUNT_Y) R"( + y) * )" STRINGIZE(CLUSTER_COUNT_X) R"( + x;
+}
+uint get_cluster_range(uint cluster) {
+	return cluster_ranges[cluster / 4][cluster % 4];
+}
+uint get_cluster_light(uint i) {
+	return (cluster_light_indices[i / 16][(i / 4) % 4] >> ((i % 4) * 8)) & 0xff;
+}
+
 layout(binding=)" STRINGIZE(SHADOW_MAP_TEXTURE_SLOT) R"() uniform sampler2DShadow shadow_map;
 layout(binding=)" STRINGIZE(LIGHT_TEXTURE_SLOT) R"() uniform sampler2D light_texture;
 layout(binding=)" STRINGIZE(LIGHTMAP_TEXTURE_SLOT) R"() uniform sampler2D lightmap_texture;
@@ -120,13 +189,21 @@ float3 pbr(float3 albedo, float3 N, float3 L, float3 V) {
 	return diffuse + specular;
 }
 
-float sample_shadow_map(sampler2DShadow shadow_map, float3 light_space, float bias) {
+// `uv_rect` is light's tile in the atlas, see `get_uv_rect`
+float sample_shadow_map(sampler2DShadow shadow_map, float3 light_space, float bias, float4 uv_rect) {
 	float light = 0;
 	const int shadow_sample_radius = 2;
 	if (saturate(light_space) == light_space) {
+		// Light has no tile, so no shadows
+		if (uv_rect.z == 0)
+			return 1;
+
+		// Keep all samples inside of the tile
+		float2 margin = (shadow_sample_radius + 0.5) / float2(textureSize(shadow_map, 0));
+		float2 uv = clamp(uv_rect.xy + light_space.xy * uv_rect.zw, uv_rect.xy + margin, uv_rect.xy + uv_rect.zw - margin);
 		for (int y = -shadow_sample_radius; y <= shadow_sample_radius; y += 1) {
 			for (int x = -shadow_sample_radius; x <= shadow_sample_radius; x += 1) {
-				light += textureOffset(shadow_map, vec3(light_space.xy, light_space.z - bias), ivec2(x, y));
+				light += textureOffset(shadow_map, vec3(uv, light_space.z - bias), ivec2(x, y));
 			}
 		}
 		light *= 1 / pow2(shadow_sample_radius * 2 + 1);
@@ -150,24 +227,9 @@ float sample_shadow_map(sampler2DShadow shadow_map, float3 light_space, float bi
 // Called once on program start
 //
 void runtime_init() {
-	//std::sort(component_infos.begin(), component_infos.end(), [](ComponentInfo &a, ComponentInfo &b) {
-	//	if (a.execution_priority != b.execution_priority) {
-	//		return a.execution_priority < b.execution_priority;
-	//	} else {
-	//		if (a.name.size != b.name.size) {
-	//			return a.name.size < b.name.size;
-	//		} else {
-	//			auto res = memcmp(a.name.data, b.name.data, a.name.size);
-	//			assert(res != 0, "Components with same name???");
-	//			return res < 0;
-	//		}
-	//	}
-	//});
-
-	//for (u32 i = 0; i < component_infos.size; ++i) {
-	//	auto &info = component_infos[i];
-	//	*info.registry_index = i;
-	//}
+	// Component execution order is built later, in `update_component_execution_order`, because components are registered after this
+
+	init(app->jobs);
 
 	app->tg = tg::init(tg::GraphicsApi_opengl, {
 		.window = app->window->handle,
@@ -181,8 +243,15 @@ void runtime_init() {
 	app->entity_constants = app->tg->create_shader_constants<EntityConstants>();
 	app->tg->set_shader_constants(app->entity_constants, ENTITY_CONSTANTS_SLOT);
 
-	app->light_constants = app->tg->create_shader_constants<LightConstants>();
-	app->tg->set_shader_constants(app->light_constants, LIGHT_CONSTANTS_SLOT);
+	init(app->entity_constants_ring, sizeof(EntityConstants), ENTITY_CONSTANTS_SLOT);
+	init(app->light_constants_ring, sizeof(LightConstants), LIGHT_CONSTANTS_SLOT);
+	init(app->instance_constants_ring, sizeof(InstanceConstants), INSTANCE_CONSTANTS_SLOT);
+
+	app->forward_light_constants = app->tg->create_shader_constants<ForwardLightConstants>();
+	app->tg->set_shader_constants(app->forward_light_constants, FORWARD_LIGHT_CONSTANTS_SLOT);
+
+	app->light_cluster_constants = app->tg->create_shader_constants<LightClusterConstants>();
+	app->tg->set_shader_constants(app->light_cluster_constants, LIGHT_CLUSTER_CONSTANTS_SLOT);
 
 	switch (app->tg->api) {
 		case tg::GraphicsApi_opengl: {
@@ -210,14 +279,14 @@ layout(location=3) in vec2 uv;
 
 void main() {
 	vec3 local_position = position;
-	vertex_normal = (local_to_world_normal_matrix * vec4(normal, 0)).xyz;
+	vertex_normal = (get_local_to_world_normal_matrix() * vec4(normal, 0)).xyz;
 	vertex_color = color * u_color;
-	vertex_world_position = (local_to_world_position_matrix * vec4(local_position, 1)).xyz;
+	vertex_world_position = (get_local_to_world_position_matrix() * vec4(local_position, 1)).xyz;
 	vertex_position_in_light_space = world_to_light_matrix * vec4(vertex_world_position, 1);
 	vertex_view_direction = camera_position - vertex_world_position;
 	vertex_to_light_direction = light_position - vertex_world_position;
 	vertex_uv = uv;
-	gl_Position = local_to_camera_matrix * vec4(local_position, 1);
+	gl_Position = get_local_to_camera_matrix() * vec4(local_position, 1);
 }
 #endif
 #ifdef FRAGMENT_SHADER
@@ -227,7 +296,7 @@ void main() {
 
 	vec3 light_space = (vertex_position_in_light_space.xyz / vertex_position_in_light_space.w) * 0.5 + 0.5;
 
-	float light = sample_shadow_map(shadow_map, light_space, 0.001f);
+	float light = sample_shadow_map(shadow_map, light_space, 0.001f, shadow_uv_rect);
 	light *= light_intensity / pow2(length(vertex_to_light_direction) + 1);
 	fragment_color *= light * texture(light_texture, light_space.xy);
 
@@ -239,6 +308,92 @@ void main() {
 }
 #endif
 )"s);
+			app->surface_material.forward_shader = create_shader(u8R"(
+layout (std140, binding=0) uniform _ {
+	vec4 u_color;
+};
+
+V2F vec3 vertex_normal;
+V2F vec4 vertex_color;
+V2F vec3 vertex_world_position;
+V2F vec3 vertex_view_direction;
+V2F vec2 vertex_uv;
+
+#ifdef VERTEX_SHADER
+
+layout(location=0) in vec3 position;
+layout(location=1) in vec3 normal;
+layout(location=2) in vec4 color;
+layout(location=3) in vec2 uv;
+
+void main() {
+	vec3 local_position = position;
+	vertex_normal = (get_local_to_world_normal_matrix() * vec4(normal, 0)).xyz;
+	vertex_color = color * u_color;
+	vertex_world_position = (get_local_to_world_position_matrix() * vec4(local_position, 1)).xyz;
+	vertex_view_direction = camera_position - vertex_world_position;
+	vertex_uv = uv;
+	gl_Position = get_local_to_camera_matrix() * vec4(local_position, 1);
+}
+#endif
+#ifdef FRAGMENT_SHADER
+layout(binding=)" STRINGIZE(FORWARD_SHADOW_ATLAS_TEXTURE_SLOT) R"() uniform sampler2DShadow shadow_atlas;
+layout(binding=)" STRINGIZE(FORWARD_LIGHT_TEXTURE_SLOT) R"() uniform sampler2D forward_light_textures[)" STRINGIZE(MAX_FORWARD_LIGHT_MASKS) R"(];
+layout(binding=)" STRINGIZE(FORWARD_DEFAULT_LIGHT_MASK_TEXTURE_SLOT) R"() uniform sampler2D default_light_mask;
+
+out vec4 fragment_color;
+
+vec3 get_light_space(uint i) {
+	vec4 position_in_light_space = forward_lights[i].world_to_light_matrix * vec4(vertex_world_position, 1);
+	return (position_in_light_space.xyz / position_in_light_space.w) * 0.5 + 0.5;
+}
+
+// Shadows of every light are in the atlas, so all of them are shadowed, like in multi-pass lighting
+vec3 shade_light(uint i, vec3 light_space, vec3 mask, vec3 normal, vec3 view_direction) {
+	float light = sample_shadow_map(shadow_atlas, light_space, 0.001f, forward_lights[i].shadow_uv_rect);
+	vec3 to_light_direction = forward_lights[i].position - vertex_world_position;
+	light *= forward_lights[i].intensity / pow2(length(to_light_direction) + 1);
+	return pbr(vertex_color.xyz, normal, normalize(to_light_direction), view_direction) * light * mask;
+}
+
+vec3 shade_light_with_default_mask(uint i, vec3 normal, vec3 view_direction) {
+	vec3 light_space = get_light_space(i);
+	return shade_light(i, light_space, texture(default_light_mask, light_space.xy).rgb, normal, view_direction);
+}
+
+void main() {
+	vec3 normal = normalize(vertex_normal);
+	vec3 view_direction = normalize(vertex_view_direction);
+
+	vec3 color = texture(lightmap_texture, vertex_uv).rgb / pi;
+
+	// Lights with mask slots come first. Loop index is the same for every fragment, so indexing the mask array with it is fine.
+	uint masked_light_count = min(forward_light_count, )" STRINGIZE(MAX_FORWARD_LIGHT_MASKS) R"();
+	for (uint i = 0; i < masked_light_count; i += 1) {
+		vec3 light_space = get_light_space(i);
+		vec3 mask = texture(forward_light_textures[i], light_space.xy).rgb;
+		color += shade_light(i, light_space, mask, normal, view_direction);
+	}
+
+	if (light_clusters_enabled != 0) {
+		vec4 clip_position = world_to_camera_matrix * vec4(vertex_world_position, 1);
+		uint range = get_cluster_range(get_cluster_index(clip_position.xy / clip_position.w, clip_position.w));
+		uint first = range & 0xffff;
+		uint count = range >> 16;
+		for (uint j = 0; j < count; j += 1) {
+			color += shade_light_with_default_mask(get_cluster_light(first + j), normal, view_direction);
+		}
+	} else {
+		for (uint i = masked_light_count; i < forward_light_count; i += 1) {
+			color += shade_light_with_default_mask(i, normal, view_direction);
+		}
+	}
+
+	fragment_color = vec4(color, 1);
+}
+#endif
+)"s);
+			app->surface_material.supports_instancing = true;
 			app->handle_constants = app->tg->create_shader_constants<HandleConstants>();
 			app->handle_shader = create_shader(u8R"(
 layout (std140, binding=0) uniform _ {
@@ -388,11 +543,30 @@ layout(location=0) in vec3 position;
 
 void main() {
 	vec3 local_position = position;
-	gl_Position = local_to_camera_matrix * vec4(local_position, 1);
+	gl_Position = get_local_to_camera_matrix() * vec4(local_position, 1);
+}
+#endif
+#ifdef FRAGMENT_SHADER
+void main() {
+}
+#endif
+)"s);
+			app->copy_depth_shader = create_shader(u8R"(
+layout(binding=0) uniform sampler2D source_depth;
+
+#ifdef VERTEX_SHADER
+void main() {
+	vec2 positions[] = vec2[](
+		vec2(-1, 3),
+		vec2(-1,-1),
+		vec2( 3,-1)
+	);
+	gl_Position = vec4(positions[gl_VertexID], 0, 1);
 }
 #endif
 #ifdef FRAGMENT_SHADER
 void main() {
+	gl_FragDepth = texelFetch(source_depth, ivec2(gl_FragCoord.xy), 0).r;
 }
 #endif
 )"s);
@@ -567,32 +741,421 @@ void pixel_main(in V2P input, out float4 color : SV_Target) {
 // in build:
 // Called once after runtime_init()
 //
-void runtime_start() {
-	for_each(app->current_scene->component_storages, [&](Uid uid, ComponentStorage &storage) {
-		auto &info = app->component_infos.find(uid).get();
-		if (info.start) {
-			storage.for_each([&](void *data) {
-				info.start(data);
-			});
+void update_component_execution_order() {
+	if (!app->component_execution_order_is_dirty)
+		return;
+
+	auto &order = app->component_execution_order;
+	order.allocator = default_allocator;
+	order.clear();
+	for_each(app->component_infos, [&](Uid uid, ComponentInfo &info) {
+		order.add(uid);
+	});
+
+	std::sort(order.begin(), order.end(), [](Uid a_uid, Uid b_uid) {
+		auto &a = get_component_info(a_uid);
+		auto &b = get_component_info(b_uid);
+		if (a.execution_priority != b.execution_priority) {
+			return a.execution_priority < b.execution_priority;
+		}
+		if (a.name.count != b.name.count) {
+			return a.name.count < b.name.count;
 		}
+		auto result = memcmp(a.name.data, b.name.data, a.name.count);
+		assert(result != 0, "Components with same name???");
+		return result < 0;
 	});
+
+	app->component_execution_order_is_dirty = false;
+}
+
+void runtime_start() {
+	update_component_execution_order();
+
+	auto &scene = *app->current_scene;
+	for (auto uid : app->component_execution_order) {
+		auto &info = get_component_info(uid);
+		if (!info.start)
+			continue;
+
+		auto found_storage = scene.component_storages.find(uid);
+		if (!found_storage)
+			continue;
+
+		found_storage->for_each([&](void *data) {
+			info.start(data);
+		});
+	}
+}
+
+struct StorageUpdate {
+	Uid type_uid;
+	ComponentInfo *info;
+	ComponentStorage *storage;
+	Scene *scene;
+};
+
+void update_component_block(StorageUpdate &update, u32 block_index) {
+	auto &info = *update.info;
+	auto &storage = *update.storage;
+	auto block = storage.blocks[block_index];
+
+	// Remember who is ticked now to put them to sleep afterwards, in case `update` changes sleeping state
+	ComponentStorage::Mask ticked_masks[ComponentStorage::masks_per_block];
+	if (info.tick_interval > 0) {
+		for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+			ticked_masks[mask_index] = block->masks[mask_index] & ~block->sleeping_masks[mask_index];
+		}
+	}
+
+	if (info.update_batch) {
+		storage.for_each_run_in_block(block, info.update_batch, true);
+	} else {
+		storage.for_each_in_block(block, info.update, true);
+	}
+
+	if (info.tick_interval > 0) {
+		for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+			// Skip the ones that went to sleep by themselves
+			ticked_masks[mask_index] &= block->masks[mask_index] & ~block->sleeping_masks[mask_index];
+		}
+		sleep_components_in_block(*update.scene, update.type_uid, storage, block_index, ticked_masks, info.tick_interval);
+	}
+}
+
+void update_component_storage(StorageUpdate &update) {
+	auto &storage = *update.storage;
+
+	auto is_awake = [&](ComponentStorage::Block *block) {
+		return block->value_count != block->sleeping_count;
+	};
+
+	if (!update.info->parallel_safe || app->jobs.workers.count <= 1) {
+		for (u32 block_index = 0; block_index < storage.blocks.count; block_index += 1) {
+			if (!is_awake(storage.blocks[block_index]))
+				continue;
+
+			update_component_block(update, block_index);
+		}
+		return;
+	}
+
+	//
+	// Each block with awake components becomes a separate job
+	//
+	struct BlockUpdate {
+		StorageUpdate *update;
+		u32 block_index;
+	};
+
+	List<BlockUpdate> block_updates;
+	block_updates.allocator = temporary_allocator;
+	block_updates.reserve(storage.blocks.count);
+
+	JobCounter counter;
+	for (u32 block_index = 0; block_index < storage.blocks.count; block_index += 1) {
+		if (!is_awake(storage.blocks[block_index]))
+			continue;
+
+		block_updates.add({&update, block_index});
+		push(app->jobs, {
+			.function = [](void *data) {
+				auto &block_update = *(BlockUpdate *)data;
+				update_component_block(*block_update.update, block_update.block_index);
+			},
+			.data = &block_updates.back(),
+			.counter = &counter,
+		});
+	}
+	wait(app->jobs, counter);
 }
 
 void runtime_update() {
+	reset_stats(app->jobs);
+
+	auto &scene = *app->current_scene;
+	prepare_command_buffers(scene);
+
+	advance(scene.scheduler, scene, app->frame_time);
+
+	app->ticked_component_count = 0;
+	app->skipped_component_count = 0;
+
+	update_component_execution_order();
+
+	for (auto uid : app->component_execution_order) {
+		auto &info = get_component_info(uid);
+		if (!info.update && !info.update_batch)
+			continue;
+
+		auto found_storage = scene.component_storages.find(uid);
+		if (!found_storage)
+			continue;
+
+		auto &storage = found_storage.get();
+		info.ticked_count = 0;
+		info.skipped_count = 0;
+		for (auto block : storage.blocks) {
+			info.ticked_count += block->value_count - block->sleeping_count;
+			info.skipped_count += block->sleeping_count;
+		}
+		app->ticked_component_count += info.ticked_count;
+		app->skipped_component_count += info.skipped_count;
+
+		StorageUpdate update = {
+			.type_uid = uid,
+			.info = &info,
+			.storage = &storage,
+			.scene = &scene,
+		};
+
+		auto timer = create_precise_timer();
+		update_component_storage(update);
+		info.update_time = get_time(timer);
+	}
+
+	// Sync point: storages are not iterated anymore, apply structural changes recorded during update
+	flush_commands(scene);
+}
+
+//
+// Called once per frame instead of `runtime_update`. Runs it one or more times in fixed-step mode.
+//
+void runtime_simulate() {
+	if (!app->use_fixed_time_step) {
+		runtime_update();
+		app->substep_count = 1;
+		app->interpolation_alpha = 1;
+		return;
+	}
+
+	auto &scene = *app->current_scene;
+	auto frame_time = app->frame_time;
+
+	app->simulation_time_accumulator += frame_time;
+	app->substep_count = 0;
+
+	app->frame_time = app->fixed_time_step;
+	while (app->simulation_time_accumulator >= app->fixed_time_step) {
+		if (app->substep_count == app->max_substeps_per_frame) {
+			// Can't keep up. Drop the time instead of doing even more work next frame.
+			app->simulation_time_accumulator = 0;
+			break;
+		}
+
+		save_previous_transforms(scene);
+		runtime_update();
+
+		app->simulation_time_accumulator -= app->fixed_time_step;
+		app->substep_count += 1;
+	}
+	app->frame_time = frame_time;
+
+	app->interpolation_alpha = app->simulation_time_accumulator / app->fixed_time_step;
+}
+
+void print_update_stats() {
+	print("Component update times:\n");
+	for_each(app->component_infos, [&](Uid uid, ComponentInfo &info) {
+		if (info.update || info.update_batch) {
+			print("\t{}: {} ms, {} ticked, {} sleeping{}{}\n", info.name, FormatFloat{.value = info.update_time * 1000, .precision = 3}, info.ticked_count, info.skipped_count, info.update_batch ? " (batched)" : "", info.parallel_safe ? " (parallel)" : "");
+		}
+	});
+	print("Components ticked: {}, skipped: {}\n", app->ticked_component_count, app->skipped_component_count);
+	print("Component storages:\n");
 	for_each(app->current_scene->component_storages, [&](Uid uid, ComponentStorage &storage) {
-		auto &info = app->component_infos.find(uid).get();
-		if (info.update) {
-			storage.for_each([&](void *data) {
-				info.update(data);
-			});
+		auto stats = storage.get_stats();
+		print("\t{}: {} values in {} blocks ({} empty), occupancy {}%, fragmentation {}%, {} KiB\n",
+			get_component_info(uid).name, stats.value_count, stats.block_count, stats.empty_block_count,
+			FormatFloat{.value = stats.occupancy * 100, .precision = 1},
+			FormatFloat{.value = stats.fragmentation * 100, .precision = 1},
+			stats.allocated_bytes / 1024);
+	});
+	print("Job threads: {}, utilization of worker threads: {}%\n", app->jobs.workers.count, FormatFloat{.value = get_utilization(app->jobs) * 100, .precision = 1});
+	for (u32 worker_index = 0; worker_index < app->jobs.workers.count; worker_index += 1) {
+		auto stats = get_stats(*app->jobs.workers[worker_index]);
+		print("\tworker {}{}: {} jobs ({} stolen), busy {} ms\n", worker_index, worker_index == 0 ? u8" (main thread)"s : u8""s, stats.executed_job_count, stats.stolen_job_count, FormatFloat{.value = stats.busy_time * 1000, .precision = 3});
+	}
+}
+
+// Distance from `eye` to center of renderer's box along `forward`, divided by `far_plane`. For sort keys.
+f32 get_normalized_depth(SceneBounds &bounds, u32 renderer_index, v3f eye, v3f forward, f32 far_plane) {
+	v3f center = {bounds.center_x[renderer_index], bounds.center_y[renderer_index], bounds.center_z[renderer_index]};
+	return dot(center - eye, forward) / far_plane;
+}
+
+Material *get_material(MeshRenderer &mesh_renderer) {
+	return mesh_renderer.material ? mesh_renderer.material : &app->surface_material;
+}
+
+// Id of mesh and its level of detail for sort keys
+u32 get_mesh_id(RenderQueue &queue, MeshRenderer &renderer) {
+	return get_id(queue, renderer.mesh) * max_lod_count + renderer.lod;
+}
+
+//
+// Picks `lod` of a visible renderer from how big its mesh's error would be on screen.
+// `pixels_per_unit` is how many pixels a world unit covers at unit distance from the camera.
+//
+void update_lod(Scene &scene, u32 renderer_index, v3f camera_position, f32 near_plane, f32 pixels_per_unit) {
+	auto &bounds = scene.bounds;
+	auto &renderer = *bounds.renderers[renderer_index];
+	if (!app->use_lods) {
+		renderer.lod = 0;
+		return;
+	}
+
+	v3f center = {bounds.center_x[renderer_index], bounds.center_y[renderer_index], bounds.center_z[renderer_index]};
+	v3f extent = {bounds.extent_x[renderer_index], bounds.extent_y[renderer_index], bounds.extent_z[renderer_index]};
+	auto distance = max(length(center - camera_position) - length(extent), near_plane);
+
+	// Error is in mesh units, take the largest scale
+	auto &local_to_world = scene.transforms.local_to_world[bounds.entity_indices[renderer_index]];
+	auto scale = max(max(
+		length((local_to_world * v4f{1,0,0,0}).xyz),
+		length((local_to_world * v4f{0,1,0,0}).xyz)),
+		length((local_to_world * v4f{0,0,1,0}).xyz));
+
+	renderer.lod = select_lod(*renderer.mesh, renderer.lod, pixels_per_unit * scale / distance);
+}
+
+//
+// Returns packets from the start of `packets` that can be drawn with one instanced draw, at least one.
+// These share mesh, and unless `shadow_pass` is set, material and lightmap.
+//
+Span<DrawPacket> get_instance_batch(Scene &scene, Span<DrawPacket> packets, bool shadow_pass) {
+	umm count = 1;
+	if (app->use_instancing) {
+		auto &first = *scene.bounds.renderers[packets[0].renderer_index];
+		auto material = get_material(first);
+		if (shadow_pass || material->supports_instancing) {
+			for (; count < packets.count && count < MAX_INSTANCES; count += 1) {
+				auto &renderer = *scene.bounds.renderers[packets[count].renderer_index];
+				if (renderer.mesh != first.mesh || renderer.lod != first.lod)
+					break;
+				if (!shadow_pass && (get_material(renderer) != material || renderer.lightmap != first.lightmap))
+					break;
+			}
+		}
+	}
+	return Span(packets.data, count);
+}
+
+// Pushes transforms of `batch`'s renderers to `app->instance_constants_ring`
+void upload_instances(Scene &scene, Span<DrawPacket> batch) {
+	auto &data = app->instance_data;
+	for (umm i = 0; i < batch.count; ++i) {
+		auto &entity = scene.bounds.renderers[batch[i].renderer_index]->entity();
+		data.instances[i] = {
+			.local_to_world_position_matrix = get_local_to_world(entity),
+			.local_to_world_normal_matrix = get_local_to_world_normal(entity),
+		};
+	}
+	push(app->instance_constants_ring, data);
+}
+
+//
+// How much of the view of any camera `light` can reach. Zero if it can't reach any, one if a camera is inside of its range.
+// Uses camera matrices from last frame.
+//
+f32 get_shadow_importance(Scene &scene, Light &light) {
+	auto light_position = get_world_position(light.entity());
+	auto range = get_light_range(light);
+
+	f32 result = 0;
+	scene.for_each_component<Camera>([&] (Camera &camera) {
+		auto frustum = get_frustum(camera.world_to_camera_matrix);
+		for (auto plane : frustum.planes) {
+			if (dot(plane.xyz, light_position) + plane.w < -range * length(plane.xyz))
+				return;
 		}
+
+		auto distance = length(light_position - get_world_position(camera.entity()));
+		auto coverage = distance <= range ? 1.0f : range / (distance * tanf(camera.fov * 0.5f));
+		result = max(result, min(coverage, 1.0f));
 	});
+	return result;
+}
+
+// Clears `tile` of `target` and makes it current for `draw_shadow_casters`
+void begin_shadow_pass(tg::RenderTarget *target, ShadowTile tile) {
+	auto viewport = get_viewport(tile);
+	app->tg->set_render_target(target);
+	app->tg->set_viewport(viewport);
+	app->tg->set_scissor(viewport); // Clear only this tile
+	app->tg->clear(target, tg::ClearFlags_depth, {}, 1);
+	app->render_state.reset();
+}
+
+// Writes depth from the same texels of `source` into current viewport, which must be cleared to 1
+void copy_depth(tg::Texture2D *source) {
+	auto &state = app->render_state;
+	state.set_shader(app->copy_depth_shader);
+	state.set_sampler(tg::Filtering_linear, 0);
+	state.set_texture(source, 0);
+	app->tg->draw(3);
+}
+
+// Draws depth of renderers at `renderer_indices` from `light`'s perspective
+void draw_shadow_casters(Scene &scene, Light &light, Span<u32> renderer_indices, v3f light_position, v3f light_forward) {
+	auto &queue = app->render_queue;
+	auto &state = app->render_state;
+
+	state.set_shader(app->shadow_map_shader);
+
+	// Shader is the same for every draw, so only group by mesh
+	queue.packets.clear();
+	for (auto renderer_index : renderer_indices) {
+		queue.packets.add({
+			.key = make_sort_key(RenderPass_shadow, 0, 0, get_mesh_id(queue, *scene.bounds.renderers[renderer_index]), get_normalized_depth(scene.bounds, renderer_index, light_position, light_forward, light_far_plane)),
+			.renderer_index = renderer_index,
+		});
+	}
+	sort(queue);
+
+	for (umm packet_index = 0; packet_index < queue.packets.count;) {
+		auto batch = get_instance_batch(scene, Span(queue.packets.data + packet_index, queue.packets.count - packet_index), true);
+		packet_index += batch.count;
+
+		auto &mesh_renderer = *scene.bounds.renderers[batch[0].renderer_index];
+		if (batch.count == 1) {
+			push(app->entity_constants_ring, EntityConstants{
+				.local_to_camera_matrix = light.world_to_light_matrix * get_local_to_world(mesh_renderer.entity()),
+			});
+			state.draw_mesh(mesh_renderer.mesh, mesh_renderer.lod);
+		} else {
+			push(app->entity_constants_ring, EntityConstants{
+				.local_to_camera_matrix = light.world_to_light_matrix,
+				.instanced = 1,
+			});
+			upload_instances(scene, batch);
+			state.draw_mesh_instanced(mesh_renderer.mesh, mesh_renderer.lod, (u32)batch.count);
+		}
+	}
 }
 
 //
 // Called once per frame
 //
 void runtime_render() {
+	app->visible_object_count = 0;
+	app->culled_object_count = 0;
+	app->occluded_object_count = 0;
+	app->render_state.issued_count = 0;
+	app->render_state.skipped_count = 0;
+	app->render_state.triangle_count = 0;
+	app->uploaded_uniform_bytes = 0;
+	app->shadow_cache.skipped_pass_count = 0;
+	app->shadow_cache.static_layer_update_count = 0;
+
+	begin_frame(app->entity_constants_ring);
+	begin_frame(app->light_constants_ring);
+	begin_frame(app->instance_constants_ring);
+	begin_frame(app->render_target_pool);
+
+	update_transforms(*app->current_scene, app->use_fixed_time_step ? app->interpolation_alpha : 1);
+	update_world_bounds(*app->current_scene);
+
 	{
 		timed_block("Shadows"s);
 		app->tg->disable_scissor();
@@ -606,56 +1169,139 @@ void runtime_render() {
 		app->tg->set_topology(tg::Topology_triangle_list);
 
 		auto scene = app->current_scene;
+		auto &atlas = app->shadow_atlas;
+		auto &cache = app->shadow_cache;
+
+		List<ShadowAtlasRequest> atlas_requests;
+		atlas_requests.allocator = temporary_allocator;
+		scene->for_each_component<Light>([&] (Light &light) {
+			atlas_requests.add({
+				.light = to_u64(light.entity().handle),
+				.importance = get_shadow_importance(*scene, light),
+			});
+		});
+		update(atlas, atlas_requests);
+
+		List<u32> visible_renderers;
+		visible_renderers.allocator = temporary_allocator;
+
+		List<u32> static_casters;
+		static_casters.allocator = temporary_allocator;
+
+		List<u32> dynamic_casters;
+		dynamic_casters.allocator = temporary_allocator;
 
 		scene->for_each_component<Light>([&] (Light &light) {
 			timed_block("Light"s);
 			auto &light_entity = light.entity();
 
-			app->tg->set_render_target(light.shadow_map);
-			app->tg->set_viewport(shadow_map_resolution, shadow_map_resolution);
-			app->tg->clear(light.shadow_map, tg::ClearFlags_depth, {}, 1);
+			auto light_position = get_world_position(light_entity);
+			auto light_rotation = get_world_rotation(light_entity);
+			auto light_forward = light_rotation * v3f{0,0,-1};
+			light.world_to_light_matrix = m4::perspective_right_handed(1, light.fov, light_near_plane, light_far_plane) * (m4)-light_rotation * m4::translation(-light_position);
+
+			auto light_key = to_u64(light_entity.handle);
+			auto tile = get_tile(atlas, light_key);
+			light.shadow_uv_rect = get_uv_rect(atlas, tile);
+			if (!tile.size)
+				return;
+
+			visible_renderers.clear();
+			cull(scene->bounds, get_frustum(light.world_to_light_matrix), visible_renderers);
+
+			static_casters.clear();
+			dynamic_casters.clear();
+			for (auto renderer_index : visible_renderers) {
+				if (scene->bounds.renderers[renderer_index]->entity().flags & Entity_static) {
+					static_casters.add(renderer_index);
+				} else {
+					dynamic_casters.add(renderer_index);
+				}
+			}
 
-			app->tg->set_shader(app->shadow_map_shader);
+			auto found_entry = cache.entries.find(light_key);
+			bool light_changed = !found_entry || !(found_entry->tile == tile) || memcmp(&found_entry->world_to_light_matrix, &light.world_to_light_matrix, sizeof(m4)) != 0;
 
-			light.world_to_light_matrix = m4::perspective_right_handed(1, light.fov, 0.1f, 100.0f) * (m4)-light_entity.rotation * m4::translation(-light_entity.position);
+			auto &entry = cache.entries.get_or_insert(light_key);
+			entry.world_to_light_matrix = light.world_to_light_matrix;
+			entry.tile = tile;
+			entry.last_used_frame = app->frame_index;
+			if (light_changed) {
+				entry.has_static_layer = false;
+			}
 
-			scene->for_each_component<MeshRenderer>([&] (MeshRenderer &mesh_renderer) {
-				auto &mesh_entity = mesh_renderer.entity();
+			// Both hashes have to be updated, don't short circuit
+			bool static_casters_changed = update_casters_hash(entry.static_casters_hash, scene->bounds, static_casters);
+			bool dynamic_casters_changed = update_casters_hash(entry.dynamic_casters_hash, scene->bounds, dynamic_casters);
 
-				app->tg->update_shader_constants(app->entity_constants, {
-					.local_to_camera_matrix = light.world_to_light_matrix * m4::translation(mesh_entity.position) * (m4)mesh_entity.rotation * m4::scale(mesh_entity.scale),
-				});
-				draw_mesh(mesh_renderer.mesh);
-			});
+			if (app->use_shadow_cache && !light_changed && !static_casters_changed && !dynamic_casters_changed) {
+				cache.skipped_pass_count += 1;
+				return;
+			}
+
+			if (app->use_shadow_cache && (light_entity.flags & Entity_static)) {
+				if (!entry.has_static_layer || static_casters_changed) {
+					begin_shadow_pass(atlas.static_target, tile);
+					draw_shadow_casters(*scene, light, static_casters, light_position, light_forward);
+					entry.has_static_layer = true;
+					cache.static_layer_update_count += 1;
+				}
+
+				begin_shadow_pass(atlas.target, tile);
+				copy_depth(atlas.static_target->depth);
+				draw_shadow_casters(*scene, light, dynamic_casters, light_position, light_forward);
+			} else {
+				begin_shadow_pass(atlas.target, tile);
+				draw_shadow_casters(*scene, light, visible_renderers, light_position, light_forward);
+				entry.has_static_layer = false;
+			}
 		});
+
+		remove_unused_entries(cache, app->frame_index);
+		app->tg->disable_scissor();
 	}
 }
 
-//
-// Render scene from `camera`'s perspective into `camera.destination_target` with current viewport
-//
-void render_camera(Camera &camera, Entity &camera_entity) {
+// Draws a batch from `get_instance_batch`. Expects shader and material constants to be set through `app->render_state`
+void draw_lit_meshes(Camera &camera, Scene &scene, Span<DrawPacket> batch) {
+	auto &mesh_renderer = *scene.bounds.renderers[batch[0].renderer_index];
 
-	m4 camera_projection_matrix = m4::perspective_right_handed((f32)camera.source_target->color->size.x / camera.source_target->color->size.y, camera.fov, camera.near_plane, camera.far_plane);
-	m4 camera_translation_matrix = m4::translation(-camera_entity.position);
-	//m4 camera_rotation_matrix = m4::rotation_r_yxz(-camera_entity.rotation);
-	//m4 camera_rotation_matrix = m4::rotation_r_yxz(-to_euler_angles(camera_entity.rotation));
-	m4 camera_rotation_matrix = transpose((m4)camera_entity.rotation);
-	camera.world_to_camera_matrix = camera_projection_matrix * camera_rotation_matrix * camera_translation_matrix;
+	if (batch.count == 1) {
+		auto &mesh_entity = mesh_renderer.entity();
 
-	app->tg->update_shader_constants(app->global_constants, {
-		.camera_rotation_projection_matrix = camera_projection_matrix * camera_rotation_matrix,
-		.world_to_camera_matrix = camera.world_to_camera_matrix,
-		.camera_position = camera_entity.position,
-		//.camera_forward = m3::rotation_r_zxy(camera_entity.rotation) * v3f{0,0,-1},
-		.camera_forward = camera_entity.rotation * v3f{0,0,-1},
-	});
+		//entity_data.local_to_camera_matrix = camera.world_to_camera_matrix * m4::translation(mesh_entity.position) * m4::rotation_r_zxy(mesh_entity.rotation);
+		auto &local_to_world = get_local_to_world(mesh_entity);
+		push(app->entity_constants_ring, EntityConstants{
+			.local_to_camera_matrix = camera.world_to_camera_matrix * local_to_world,
+			.local_to_world_position_matrix = local_to_world,
+			.local_to_world_normal_matrix = get_local_to_world_normal(mesh_entity),
+		});
+	} else {
+		push(app->entity_constants_ring, EntityConstants{
+			.local_to_camera_matrix = camera.world_to_camera_matrix,
+			.instanced = 1,
+		});
+		upload_instances(scene, batch);
+	}
 
-	app->tg->set_render_target(camera.destination_target);
-	app->tg->set_viewport(camera.destination_target->color->size);
-	app->tg->clear(camera.destination_target, tg::ClearFlags_color | tg::ClearFlags_depth, {.9,.1,.9,1}, 1);
+	auto &state = app->render_state;
+	state.set_sampler(tg::Filtering_linear_mipmap, LIGHTMAP_TEXTURE_SLOT);
+	state.set_texture(mesh_renderer.lightmap ? mesh_renderer.lightmap : app->black_texture, LIGHTMAP_TEXTURE_SLOT);
+	if (batch.count == 1) {
+		state.draw_mesh(mesh_renderer.mesh, mesh_renderer.lod);
+	} else {
+		state.draw_mesh_instanced(mesh_renderer.mesh, mesh_renderer.lod, (u32)batch.count);
+	}
+}
 
-	app->tg->set_topology(tg::Topology_triangle_list);
+//
+// Draws every mesh once per light, adding lights up with blending. Works with any material.
+//
+void draw_lights_multi_pass(Camera &camera, Scene &scene, Span<DrawPacket> packets) {
+	timed_function();
+
+	auto &state = app->render_state;
+	state.reset();
 
 	app->tg->set_rasterizer({
 		.depth_test = true,
@@ -664,11 +1310,9 @@ void render_camera(Camera &camera, Entity &camera_entity) {
 	});
 	app->tg->disable_blend();
 
-	auto scene = app->current_scene;
-
 	u32 light_index = 0;
 
-	scene->for_each_component<Light>([&] (Light &light) {
+	scene.for_each_component<Light>([&] (Light &light) {
 		timed_block("Light"s);
 
 		defer {
@@ -677,43 +1321,31 @@ void render_camera(Camera &camera, Entity &camera_entity) {
 
 		auto &light_entity = light.entity();
 
-		app->tg->update_shader_constants(app->light_constants, {
+		push(app->light_constants_ring, LightConstants{
 			.world_to_light_matrix = light.world_to_light_matrix,
-			.light_position = light_entity.position,
+			.light_position = get_world_position(light_entity),
 			.light_intensity = light.intensity,
+			.shadow_uv_rect = light.shadow_uv_rect,
 			.light_index = light_index,
 		});
 
 
-		app->tg->set_texture(light.shadow_map->depth, SHADOW_MAP_TEXTURE_SLOT);
-		app->tg->set_sampler(tg::Filtering_linear, tg::Comparison_less, SHADOW_MAP_TEXTURE_SLOT);
+		state.set_texture(app->shadow_atlas.target->depth, SHADOW_MAP_TEXTURE_SLOT);
+		state.set_sampler(tg::Filtering_linear, tg::Comparison_less, SHADOW_MAP_TEXTURE_SLOT);
 
-		app->tg->set_texture(light.mask ? light.mask : app->default_light_mask, LIGHT_TEXTURE_SLOT);
-		app->tg->set_sampler(tg::Filtering_linear_mipmap, LIGHT_TEXTURE_SLOT);
-		scene->for_each_component<MeshRenderer>([&] (MeshRenderer &mesh_renderer) {
+		state.set_texture(light.mask ? light.mask : app->default_light_mask, LIGHT_TEXTURE_SLOT);
+		state.set_sampler(tg::Filtering_linear_mipmap, LIGHT_TEXTURE_SLOT);
+		for (umm packet_index = 0; packet_index < packets.count;) {
 			timed_block("MeshRenderer"s);
-			auto &mesh_entity = mesh_renderer.entity();
-
-			auto material = mesh_renderer.material;
-			if (!material) {
-				material = &app->surface_material;
-			}
-
-			app->tg->set_shader(material->shader);
-			app->tg->set_shader_constants(material->constants, 0);
+			auto batch = get_instance_batch(scene, Span(packets.data + packet_index, packets.count - packet_index), false);
+			packet_index += batch.count;
 
+			auto material = get_material(*scene.bounds.renderers[batch[0].renderer_index]);
+			state.set_shader(material->shader);
+			state.set_shader_constants(material->constants, 0);
 
-			//entity_data.local_to_camera_matrix = camera.world_to_camera_matrix * m4::translation(mesh_entity.position) * m4::rotation_r_zxy(mesh_entity.rotation);
-			m4 local_to_world = m4::translation(mesh_entity.position) * (m4)mesh_entity.rotation * m4::scale(mesh_entity.scale);
-			app->tg->update_shader_constants(app->entity_constants, {
-				.local_to_camera_matrix = camera.world_to_camera_matrix * local_to_world,
-				.local_to_world_position_matrix = local_to_world,
-				.local_to_world_normal_matrix = (m4)mesh_entity.rotation * m4::scale(1 / mesh_entity.scale),
-			});
-			app->tg->set_sampler(tg::Filtering_linear_mipmap, LIGHTMAP_TEXTURE_SLOT);
-			app->tg->set_texture(mesh_renderer.lightmap ? mesh_renderer.lightmap : app->black_texture, LIGHTMAP_TEXTURE_SLOT);
-			draw_mesh(mesh_renderer.mesh);
-		});
+			draw_lit_meshes(camera, scene, batch);
+		}
 		app->tg->set_blend(tg::BlendFunction_add, tg::Blend_one, tg::Blend_one);
 		app->tg->set_rasterizer({
 			.depth_test = true,
@@ -722,6 +1354,177 @@ void render_camera(Camera &camera, Entity &camera_entity) {
 		});
 	});
 
+}
+
+//
+// Draws every mesh once with all lights from `ForwardLightConstants`. Materials must have `forward_shader`.
+// Lights without a mask slot are binned into clusters of `view`.
+//
+void draw_lights_single_pass(Camera &camera, Scene &scene, Span<DrawPacket> packets, LightClusterView const &view) {
+	timed_function();
+
+	auto &state = app->render_state;
+	state.reset();
+
+	// Too big for the stack. Only first `light_count` lights are filled.
+	auto &constants = *temporary_allocator.allocate<ForwardLightConstants>();
+	constants.light_count = 0;
+
+	List<ClusterLight> cluster_lights;
+	cluster_lights.allocator = temporary_allocator;
+
+	state.set_texture(app->shadow_atlas.target->depth, FORWARD_SHADOW_ATLAS_TEXTURE_SLOT);
+	state.set_sampler(tg::Filtering_linear, tg::Comparison_less, FORWARD_SHADOW_ATLAS_TEXTURE_SLOT);
+
+	state.set_texture(app->default_light_mask, FORWARD_DEFAULT_LIGHT_MASK_TEXTURE_SLOT);
+	state.set_sampler(tg::Filtering_linear_mipmap, FORWARD_DEFAULT_LIGHT_MASK_TEXTURE_SLOT);
+
+	u32 mask_slot_count = 0;
+	scene.for_each_component<Light>([&] (Light &light) {
+		if (constants.light_count == MAX_FORWARD_LIGHTS)
+			return;
+
+		auto &forward_light = constants.lights[constants.light_count++];
+		forward_light.world_to_light_matrix = light.world_to_light_matrix;
+		forward_light.position = get_world_position(light.entity());
+		forward_light.intensity = light.intensity;
+		forward_light.shadow_uv_rect = light.shadow_uv_rect;
+		forward_light.mask_slot = -1;
+
+		if (mask_slot_count < MAX_FORWARD_LIGHT_MASKS) {
+			auto slot = mask_slot_count++;
+			forward_light.mask_slot = (s32)slot;
+
+			state.set_texture(light.mask ? light.mask : app->default_light_mask, FORWARD_LIGHT_TEXTURE_SLOT + slot);
+			state.set_sampler(tg::Filtering_linear_mipmap, FORWARD_LIGHT_TEXTURE_SLOT + slot);
+		} else {
+			cluster_lights.add({
+				.position = forward_light.position,
+				.range = get_light_range(light),
+				.index = constants.light_count - 1,
+			});
+		}
+	});
+	app->tg->update_shader_constants(app->forward_light_constants, constants);
+	app->uploaded_uniform_bytes += sizeof(constants);
+
+	auto &cluster_constants = *temporary_allocator.allocate<LightClusterConstants>();
+	cluster_constants.enabled = 0;
+	if (app->use_light_clusters) {
+		if (!bin_lights(cluster_constants, app->light_cluster_binner, cluster_lights, view, app->jobs)) {
+			print(Print_warning, "Too many lights in clusters, some were dropped\n");
+		}
+	}
+	app->tg->update_shader_constants(app->light_cluster_constants, cluster_constants);
+	app->uploaded_uniform_bytes += sizeof(cluster_constants);
+
+	app->tg->set_rasterizer({
+		.depth_test = true,
+		.depth_write = true,
+		.depth_func = tg::Comparison_less,
+	});
+	app->tg->disable_blend();
+
+	for (umm packet_index = 0; packet_index < packets.count;) {
+		timed_block("MeshRenderer"s);
+		auto batch = get_instance_batch(scene, Span(packets.data + packet_index, packets.count - packet_index), false);
+		packet_index += batch.count;
+
+		auto material = get_material(*scene.bounds.renderers[batch[0].renderer_index]);
+		state.set_shader(material->forward_shader);
+		state.set_shader_constants(material->constants, 0);
+
+		draw_lit_meshes(camera, scene, batch);
+	}
+}
+
+//
+// Render scene from `camera`'s perspective into `target`
+//
+void draw_scene(Camera &camera, Entity &camera_entity, tg::RenderTarget *target) {
+
+	m4 camera_projection_matrix = m4::perspective_right_handed((f32)target->color->size.x / target->color->size.y, camera.fov, camera.near_plane, camera.far_plane);
+	auto camera_position = get_world_position(camera_entity);
+	auto camera_rotation = get_world_rotation(camera_entity);
+	m4 camera_translation_matrix = m4::translation(-camera_position);
+	//m4 camera_rotation_matrix = m4::rotation_r_yxz(-camera_entity.rotation);
+	//m4 camera_rotation_matrix = m4::rotation_r_yxz(-to_euler_angles(camera_entity.rotation));
+	m4 camera_rotation_matrix = transpose((m4)camera_rotation);
+	camera.world_to_camera_matrix = camera_projection_matrix * camera_rotation_matrix * camera_translation_matrix;
+
+	app->tg->update_shader_constants(app->global_constants, {
+		.camera_rotation_projection_matrix = camera_projection_matrix * camera_rotation_matrix,
+		.world_to_camera_matrix = camera.world_to_camera_matrix,
+		.camera_position = camera_position,
+		//.camera_forward = m3::rotation_r_zxy(camera_entity.rotation) * v3f{0,0,-1},
+		.camera_forward = camera_rotation * v3f{0,0,-1},
+	});
+	app->uploaded_uniform_bytes += sizeof(GlobalConstants);
+
+	app->tg->set_render_target(target);
+	app->tg->set_viewport(target->color->size);
+	app->tg->clear(target, tg::ClearFlags_color | tg::ClearFlags_depth, {.9,.1,.9,1}, 1);
+
+	app->tg->set_topology(tg::Topology_triangle_list);
+
+	app->tg->set_rasterizer({
+		.depth_test = true,
+		.depth_write = true,
+		.depth_func = tg::Comparison_less,
+	});
+	app->tg->disable_blend();
+
+	auto scene = app->current_scene;
+
+	List<u32> visible_renderers;
+	visible_renderers.allocator = temporary_allocator;
+	cull(scene->bounds, get_frustum(camera.world_to_camera_matrix), visible_renderers);
+
+	if (app->use_occlusion_culling) {
+		render_occluders(app->occlusion_buffer, *scene, visible_renderers, camera.world_to_camera_matrix, camera_position, app->jobs);
+		cull_occluded(app->occlusion_buffer, scene->bounds, visible_renderers, app->jobs);
+	}
+
+	//
+	// Meshes whose material has no forward shader are lit per light even when single-pass lighting is on
+	//
+	auto &queue = app->render_queue;
+	auto camera_forward = camera_rotation * v3f{0,0,-1};
+	auto pixels_per_unit = target->color->size.y / (2 * tanf(camera.fov * 0.5f));
+	queue.packets.clear();
+	for (auto renderer_index : visible_renderers) {
+		auto &mesh_renderer = *scene->bounds.renderers[renderer_index];
+		auto material = get_material(mesh_renderer);
+
+		update_lod(*scene, renderer_index, camera_position, camera.near_plane, pixels_per_unit);
+
+		auto pass = app->use_single_pass_lighting && material->forward_shader ? RenderPass_single_pass_lighting : RenderPass_multi_pass_lighting;
+		auto shader = pass == RenderPass_single_pass_lighting ? material->forward_shader : material->shader;
+
+		queue.packets.add({
+			.key = make_sort_key(pass, get_id(queue, shader), get_id(queue, material), get_mesh_id(queue, mesh_renderer), get_normalized_depth(scene->bounds, renderer_index, camera_position, camera_forward, camera.far_plane)),
+			.renderer_index = renderer_index,
+		});
+	}
+	sort(queue);
+
+	auto single_pass_packets = get_packets(queue, RenderPass_single_pass_lighting);
+	if (single_pass_packets.count) {
+		auto projection = (f32 const *)&camera_projection_matrix;
+		draw_lights_single_pass(camera, *scene, single_pass_packets, {
+			.world_to_view = camera_rotation_matrix * camera_translation_matrix,
+			.projection_scale_x = projection[0],
+			.projection_scale_y = projection[5],
+			.near_plane = camera.near_plane,
+			.far_plane = camera.far_plane,
+		});
+	}
+
+	auto multi_pass_packets = get_packets(queue, RenderPass_multi_pass_lighting);
+	if (multi_pass_packets.count) {
+		draw_lights_multi_pass(camera, *scene, multi_pass_packets);
+	}
+
 	app->tg->set_rasterizer({
 		.depth_test = true,
 		.depth_write = false,
@@ -737,15 +1540,31 @@ void render_camera(Camera &camera, Entity &camera_entity) {
 		app->tg->draw(36);
 		app->tg->enable_depth_clip();
 	}
+}
 
-	swap(camera.source_target, camera.destination_target);
+//
+// Render scene and post effects of `camera` into `camera.output_target`.
+// Images in between are transients of a render graph, so all cameras share them through `app->render_target_pool`.
+//
+void render_camera(Camera &camera, Entity &camera_entity) {
+	auto graph = create_render_graph(app->render_target_pool);
 
-	{
-		timed_block("Post effects"s);
-		for (auto &effect : camera.post_effects) {
-			effect.render(camera.source_target, camera.destination_target);
-			swap(camera.source_target, camera.destination_target);
-		}
+	auto output = import_target(graph, camera.output_target);
+	auto hdr_description = get_description(graph, output);
+
+	auto scene_target = camera.post_effects.count ? create_transient(graph, hdr_description) : output;
+	add_pass(graph, u8"scene"s, {}, {scene_target}, [&camera, &camera_entity, scene_target](RenderGraph &graph) {
+		draw_scene(camera, camera_entity, get_target(graph, scene_target));
+	});
+
+	hdr_description.depth = false;
+
+	auto source = scene_target;
+	for (umm i = 0; i < camera.post_effects.count; ++i) {
+		auto destination = i == camera.post_effects.count - 1 ? output : create_transient(graph, hdr_description);
+		camera.post_effects[i].add_passes(graph, source, destination);
+		source = destination;
 	}
 
+	execute(graph);
 }
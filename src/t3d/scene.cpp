@@ -1,8 +1,226 @@
 #include "scene.h"
+#include <tl/profiler.h>
 
 Entity &Scene::create_entity() {
 	auto entity = entities.add();
 	entity.pointer->name = format(u8"Entity {}", entity.index);
 	entity.pointer->scene = this;
+
+	while (entity_generations.count <= entity.index) {
+		entity_generations.add(1);
+	}
+	entity.pointer->handle = {
+		.index = (u32)entity.index,
+		.generation = entity_generations[entity.index],
+	};
+	transforms.order_is_dirty = true;
 	return *entity.pointer;
 }
+
+static bool query_matches(SceneQuery &query, Entity &entity) {
+	for (auto type_uid : query.type_uids) {
+		if (!find_component(entity, type_uid)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool query_contains(SceneQuery &query, Uid type_uid) {
+	return find(query.type_uids, type_uid) != 0;
+}
+
+static void add_match(SceneQuery &query, Entity &entity) {
+	auto &match_index = query.match_indices.get_or_insert(&entity);
+	match_index = (u32)query.matches.count;
+	query.matches.add(&entity);
+}
+
+static void remove_match(SceneQuery &query, Entity &entity) {
+	auto found = query.match_indices.find(&entity);
+	if (!found)
+		return;
+
+	auto match_index = *found;
+	query.match_indices.erase(&entity);
+
+	// Swap with last to keep removal O(1)
+	auto last = query.matches.back();
+	query.matches[match_index] = last;
+	query.matches.pop();
+	if (last != &entity) {
+		query.match_indices.find(last).get() = match_index;
+	}
+}
+
+// Sorted without duplicates, so (A, B), (B, A) and (A, B, A) share the same cache
+static List<Uid> get_query_types(Span<Uid> type_uids) {
+	List<Uid> result;
+	result.allocator = temporary_allocator;
+	for (auto type_uid : type_uids) {
+		if (find(result, type_uid))
+			continue;
+
+		result.add(type_uid);
+		for (umm i = result.count - 1; i > 0 && result[i - 1].value > result[i].value; --i) {
+			auto temp = result[i - 1];
+			result[i - 1] = result[i];
+			result[i] = temp;
+		}
+	}
+	return result;
+}
+
+static u64 get_query_key(Span<Uid> sorted_type_uids) {
+	u64 key = sorted_type_uids.count;
+	for (auto type_uid : sorted_type_uids) {
+		key = (key ^ type_uid.value) * 0x9E3779B97F4A7C15;
+		key ^= key >> 32;
+	}
+	return key;
+}
+
+static bool same_types(Span<Uid> a, Span<Uid> b) {
+	if (a.count != b.count)
+		return false;
+	for (umm i = 0; i < a.count; ++i) {
+		if (a[i] != b[i])
+			return false;
+	}
+	return true;
+}
+
+// Walks the smallest storage and checks the rest of the types on its entities
+static void fill_query(Scene &scene, SceneQuery &query) {
+	ComponentStorage *smallest_storage = 0;
+	u32 smallest_count = ~0u;
+	for (auto type_uid : query.type_uids) {
+		auto found_storage = scene.component_storages.find(type_uid);
+		if (!found_storage) {
+			// No components of this type, so nothing matches yet.
+			return;
+		}
+
+		u32 count = 0;
+		for (auto block : found_storage->blocks) {
+			count += block->value_count;
+		}
+		if (count < smallest_count) {
+			smallest_count = count;
+			smallest_storage = found_storage.raw();
+		}
+	}
+
+	smallest_storage->for_each([&](void *component) {
+		auto &entity = ((Component *)component)->entity();
+		if (!query.match_indices.find(&entity) && query_matches(query, entity)) {
+			add_match(query, entity);
+		}
+	});
+}
+
+SceneQuery &Scene::find_or_create_query(Span<Uid> type_uids) {
+	auto sorted_type_uids = get_query_types(type_uids);
+
+	// Different sets can hash to the same key. Then the next key is tried until the set or a free key is found.
+	// Queries are never removed, so a free key means the set is not cached.
+	auto key = get_query_key(sorted_type_uids);
+	while (auto found = queries.find(key)) {
+		if (same_types(found->type_uids, sorted_type_uids))
+			return *found;
+		key += 1;
+	}
+
+	auto &query = queries.get_or_insert(key);
+	query.type_uids.allocator = default_allocator;
+	query.matches.allocator = default_allocator;
+	query.match_indices.allocator = default_allocator;
+
+	query.type_uids.set(sorted_type_uids);
+	fill_query(*this, query);
+
+	return query;
+}
+
+void Scene::rebuild_queries() {
+	for_each(queries, [&](u64 key, SceneQuery &query) {
+		query.matches.clear();
+		query.match_indices.clear();
+		fill_query(*this, query);
+	});
+}
+
+void Scene::on_component_added(Entity &entity, Uid type_uid) {
+	// Component that was just added is the last one of this type
+	for (umm i = entity.components.count; i--;) {
+		if (entity.components[i].type_uid == type_uid) {
+			schedule_first_tick(scheduler, *this, type_uid, entity.components[i].storage_index);
+			break;
+		}
+	}
+
+	for_each(queries, [&](u64 key, SceneQuery &query) {
+		if (query_contains(query, type_uid) && !query.match_indices.find(&entity) && query_matches(query, entity)) {
+			add_match(query, entity);
+		}
+	});
+}
+
+void Scene::on_component_removed(Entity &entity, Uid type_uid) {
+	for_each(queries, [&](u64 key, SceneQuery &query) {
+		// Entity can still match if it has another component of the same type
+		if (query_contains(query, type_uid) && !query_matches(query, entity)) {
+			remove_match(query, entity);
+		}
+	});
+}
+
+void Scene::on_entity_destroyed(Entity &entity) {
+	for_each(queries, [&](u64 key, SceneQuery &query) {
+		remove_match(query, entity);
+	});
+}
+
+u32 Scene::compact_component_storage(Uid type_uid) {
+	timed_function();
+
+	auto &storage = component_storages.find(type_uid).get();
+
+	auto moves = with(temporary_allocator, storage.compact());
+	on_storage_compacted(scheduler, type_uid, moves);
+	for (auto move : moves) {
+		// Values were copied as is, so `_entity` is still correct
+		auto component = (Component *)storage.get(move.to);
+		auto entity = get_entity(component->_entity);
+		assert(entity, "component's owner does not exist");
+
+		bool fixed = false;
+		for (auto &component_index : entity->components) {
+			if (component_index.type_uid == type_uid && component_index.storage_index == move.from) {
+				component_index.storage_index = move.to;
+				fixed = true;
+				break;
+			}
+		}
+		assert(fixed, "owner does not reference moved component");
+	}
+	return (u32)moves.count;
+}
+
+bool Scene::compact_most_fragmented_storage(f32 min_fragmentation) {
+	Uid most_fragmented_uid = {};
+	f32 max_fragmentation = min_fragmentation;
+	for_each(component_storages, [&](Uid uid, ComponentStorage &storage) {
+		auto stats = storage.get_stats();
+		if (stats.fragmentation > max_fragmentation) {
+			max_fragmentation = stats.fragmentation;
+			most_fragmented_uid = uid;
+		}
+	});
+
+	if (max_fragmentation == min_fragmentation)
+		return false;
+
+	compact_component_storage(most_fragmented_uid);
+	return true;
+}
@@ -1,17 +1,56 @@
 #pragma once
 #include <t3d/entity.h>
+#include <t3d/transform.h>
+#include <t3d/scene_commands.h>
+#include <t3d/tick_scheduler.h>
+#include <t3d/culling.h>
+#include <utility>
+
+//
+// Cached set of entities that have all of `type_uids` components.
+// Kept up to date by `Scene::on_component_added`, `on_component_removed` and `on_entity_destroyed`.
+//
+struct SceneQuery {
+	List<Uid> type_uids;
+	List<Entity *> matches;
+	HashMap<Entity *, u32> match_indices;
+};
 
 struct Scene {
 	StaticMaskedBlockList<Entity, 256> entities;
 	HashMap<Uid, ComponentStorage> component_storages;
+	HashMap<u64, SceneQuery> queries;
+
+	// Current generation of every slot in `entities`
+	List<u32> entity_generations;
+
+	SceneTransforms transforms;
+
+	// Structural changes requested during update, see scene_commands.h
+	List<SceneCommandBuffer> command_buffers;
+
+	TickScheduler scheduler;
+
+	// World space boxes of mesh renderers, see culling.h
+	SceneBounds bounds;
 
 	Scene() {
 		entities.allocator = default_allocator;
 		component_storages.allocator = default_allocator;
+		queries.allocator = default_allocator;
+		entity_generations.allocator = default_allocator;
+		command_buffers.allocator = default_allocator;
 	}
 
 	Entity &create_entity();
 
+	// Returns null if entity was destroyed
+	Entity *get_entity(EntityHandle handle) {
+		if (handle.index >= entity_generations.count || entity_generations[handle.index] != handle.generation)
+			return 0;
+		return &entities.at(handle.index);
+	}
+
 	Entity &create_entity(Span<utf8> name) {
 		auto &result = create_entity();
 		result.name.set(name);
@@ -22,13 +61,42 @@ struct Scene {
 
 	template <class Component, class Fn>
 	void for_each_component(Fn &&fn) {
-		auto found_storage = component_storages.find(component_name_to_uid(Component::_t3d_component_name));
+		auto found_storage = component_storages.find(get_component_uid<Component>());
 		assert(found_storage);
 		found_storage->for_each([&](void *component) {
 			return fn(*(Component *)component);
 		});
 	}
 
+	//
+	// Calls `fn(A &, B &, ...)` for every entity that has all of the components.
+	// Cost is proportional to the number of matching entities.
+	//
+	template <class ...Components, class Fn>
+	void query(Fn &&fn) {
+		Uid type_uids[] = {get_component_uid<Components>()...};
+		auto &query = find_or_create_query(array_as_span(type_uids));
+
+		[&]<umm ...indices>(std::index_sequence<indices...>) {
+			// `fn` may add or remove components, so don't hold on to iterators or storages:
+			// adding a component of a new type creates a storage, which can move the others.
+			// Storages are looked up per match, a query with a type that has no storage has no matches.
+			// Prefer recording structural changes with `get_command_buffer` though.
+			for (u32 match_index = 0; match_index < query.matches.count; ++match_index) {
+				auto &entity = *query.matches[match_index];
+				fn(*(Components *)get_component_data(*find_component(entity, type_uids[indices]))...);
+			}
+		}(std::index_sequence_for<Components...>{});
+	}
+
+	SceneQuery &find_or_create_query(Span<Uid> type_uids);
+	void on_component_added(Entity &entity, Uid type_uid);
+	void on_component_removed(Entity &entity, Uid type_uid);
+	void on_entity_destroyed(Entity &entity);
+
+	// Refills matches of every query. For when entities and components were changed without notifying queries.
+	void rebuild_queries();
+
 	ComponentStorage &find_or_create_component_storage(Uid component_type_uid, ComponentInfo &info) {
 		auto &storage = component_storages.get_or_insert(component_type_uid);
 		if (!storage.bytes_per_entry) {
@@ -38,13 +106,80 @@ struct Scene {
 		return storage;
 	}
 
+	//
+	// Packs components of a type into as few blocks as possible.
+	// Fixes up `ComponentIndex::storage_index` of owners. Component pointers obtained earlier become invalid.
+	// Returns the number of moved components.
+	//
+	u32 compact_component_storage(Uid type_uid);
+
+	// Compacts the most fragmented storage, if it is above `min_fragmentation`.
+	// Not called automatically: scripts and editor panels may hold component pointers, so only call it
+	// at points where nothing does, like from the editor.
+	bool compact_most_fragmented_storage(f32 min_fragmentation = 0.25f);
+
 	void *get_component_data(ComponentIndex component) {
 		return component_storages.find(component.type_uid).get().get(component.storage_index);
 	}
 
+	u32 get_storage_index(Component &component, Uid type_uid) {
+		for (auto &component_index : component.entity().components) {
+			if (component_index.type_uid == type_uid && get_component_data(component_index) == &component) {
+				return component_index.storage_index;
+			}
+		}
+		invalid_code_path("component is not owned by its entity");
+	}
+
 	void free() {
 		for_each(component_storages, [&](Uid uid, ComponentStorage &storage) {
 			::free(storage);
 		});
+		for_each(queries, [&](u64 key, SceneQuery &query) {
+			::free(query.type_uids);
+			::free(query.matches);
+			::free(query.match_indices);
+		});
+		::free(entity_generations);
+		::free(transforms);
+		for (auto &buffer : command_buffers) {
+			::free(buffer);
+		}
+		::free(command_buffers);
+		::free(scheduler);
+		::free(bounds);
 	}
 };
+
+inline Entity &Component::entity() {
+	// Component is alive, so is the entity. No need to check the generation.
+	return _scene->entities.at(_entity.index);
+}
+
+// Don't hold on to the result across frames: storages can be compacted, which moves components
+template <class T>
+T *get_component(Entity &entity, u32 nth = 0) {
+	auto type_uid = get_component_uid<T>();
+	for (auto component : entity.components) {
+		if (component.type_uid == type_uid) {
+			if (nth == 0) {
+				return (T *)entity.scene->get_component_data(component);
+			}
+			--nth;
+		}
+	}
+	return 0;
+}
+
+// Component won't be updated for `seconds`, see tick_scheduler.h
+template <class T>
+void sleep_component(T &component, f32 seconds = sleep_forever) {
+	auto type_uid = get_component_uid<T>();
+	sleep_component(*component._scene, type_uid, component._scene->get_storage_index(component, type_uid), seconds);
+}
+
+template <class T>
+void wake_component(T &component) {
+	auto type_uid = get_component_uid<T>();
+	wake_component(*component._scene, type_uid, component._scene->get_storage_index(component, type_uid));
+}
@@ -0,0 +1,191 @@
+#include "scene_commands.h"
+#include <t3d/scene.h>
+#include <t3d/transform.h>
+#include <t3d/app.h>
+#include <tl/profiler.h>
+
+EntityHandle create_entity(SceneCommandBuffer &buffer, Span<utf8> name) {
+	EntityHandle result = {
+		.index = buffer.created_entity_count++,
+		.generation = provisional_entity_generation,
+	};
+
+	SceneCommand command = {
+		.kind = SceneCommand_create_entity,
+		.entity = result,
+	};
+	command.name_offset = (u32)buffer.names.count;
+	command.name_count = (u32)name.count;
+	buffer.commands.add(command);
+
+	for (auto c : name) {
+		buffer.names.add(c);
+	}
+	return result;
+}
+
+void destroy_entity(SceneCommandBuffer &buffer, EntityHandle entity) {
+	buffer.commands.add({
+		.kind = SceneCommand_destroy_entity,
+		.entity = entity,
+	});
+}
+
+void add_component(SceneCommandBuffer &buffer, EntityHandle entity, Uid type_uid) {
+	SceneCommand command = {
+		.kind = SceneCommand_add_component,
+		.entity = entity,
+	};
+	command.type_uid = type_uid;
+	buffer.commands.add(command);
+}
+
+void remove_component(SceneCommandBuffer &buffer, EntityHandle entity, Uid type_uid) {
+	SceneCommand command = {
+		.kind = SceneCommand_remove_component,
+		.entity = entity,
+	};
+	command.type_uid = type_uid;
+	buffer.commands.add(command);
+}
+
+void set_parent(SceneCommandBuffer &buffer, EntityHandle entity, EntityHandle parent) {
+	SceneCommand command = {
+		.kind = SceneCommand_set_parent,
+		.entity = entity,
+	};
+	command.parent = parent;
+	buffer.commands.add(command);
+}
+
+void append(SceneCommandBuffer &destination, SceneCommandBuffer &source) {
+	auto entity_offset = destination.created_entity_count;
+	auto name_offset = (u32)destination.names.count;
+
+	auto remap = [&](EntityHandle &handle) {
+		if (is_provisional(handle)) {
+			handle.index += entity_offset;
+		}
+	};
+
+	destination.commands.reserve(destination.commands.count + source.commands.count);
+	for (auto command : source.commands) {
+		remap(command.entity);
+		switch (command.kind) {
+			case SceneCommand_create_entity: command.name_offset += name_offset; break;
+			case SceneCommand_set_parent: remap(command.parent); break;
+		}
+		destination.commands.add(command);
+	}
+
+	destination.names.reserve(destination.names.count + source.names.count);
+	for (auto c : source.names) {
+		destination.names.add(c);
+	}
+
+	destination.created_entity_count += source.created_entity_count;
+
+	clear(source);
+}
+
+void flush(SceneCommandBuffer &buffer, Scene &scene) {
+	timed_function();
+
+	if (!buffer.commands.count)
+		return;
+
+	List<EntityHandle> created_entities;
+	created_entities.allocator = temporary_allocator;
+	created_entities.reserve(buffer.created_entity_count);
+
+	auto resolve = [&](EntityHandle handle) -> Entity * {
+		if (is_provisional(handle)) {
+			if (handle.index >= created_entities.count)
+				return 0;
+			handle = created_entities[handle.index];
+		}
+		return scene.get_entity(handle);
+	};
+
+	for (auto &command : buffer.commands) {
+		switch (command.kind) {
+			case SceneCommand_create_entity: {
+				auto &entity = command.name_count ?
+					scene.create_entity(Span(buffer.names.data + command.name_offset, command.name_count)) :
+					scene.create_entity();
+				created_entities.add(entity.handle);
+				break;
+			}
+			case SceneCommand_destroy_entity: {
+				if (auto entity = resolve(command.entity)) {
+					destroy_entity(*entity);
+				}
+				break;
+			}
+			case SceneCommand_add_component: {
+				if (auto entity = resolve(command.entity)) {
+					add_component(*entity, command.type_uid);
+				}
+				break;
+			}
+			case SceneCommand_remove_component: {
+				if (auto entity = resolve(command.entity)) {
+					if (auto component = find_component(*entity, command.type_uid)) {
+						remove_component(*entity, component);
+					}
+				}
+				break;
+			}
+			case SceneCommand_set_parent: {
+				if (auto entity = resolve(command.entity)) {
+					if (command.parent == EntityHandle{}) {
+						set_parent(*entity, 0);
+					} else if (auto parent = resolve(command.parent)) {
+						set_parent(*entity, parent);
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	clear(buffer);
+}
+
+void clear(SceneCommandBuffer &buffer) {
+	buffer.commands.clear();
+	buffer.names.clear();
+	buffer.created_entity_count = 0;
+}
+
+void free(SceneCommandBuffer &buffer) {
+	free(buffer.commands);
+	free(buffer.names);
+	buffer.created_entity_count = 0;
+}
+
+void prepare_command_buffers(Scene &scene) {
+	while (scene.command_buffers.count < app->jobs.workers.count) {
+		scene.command_buffers.add({});
+	}
+}
+
+SceneCommandBuffer &get_command_buffer(Scene &scene) {
+	auto worker_index = get_current_worker_index(app->jobs);
+	if (worker_index == 0 && scene.command_buffers.count == 0) {
+		prepare_command_buffers(scene);
+	}
+	assert(worker_index < scene.command_buffers.count, "`prepare_command_buffers` was not called before starting jobs");
+	return scene.command_buffers[worker_index];
+}
+
+void flush_commands(Scene &scene) {
+	if (!scene.command_buffers.count)
+		return;
+
+	auto &destination = scene.command_buffers[0];
+	for (u32 worker_index = 1; worker_index < scene.command_buffers.count; worker_index += 1) {
+		append(destination, scene.command_buffers[worker_index]);
+	}
+	flush(destination, scene);
+}
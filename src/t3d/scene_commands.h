@@ -0,0 +1,87 @@
+#pragma once
+#include <t3d/entity.h>
+
+//
+// Records structural changes (creating and destroying entities, adding and removing components)
+// so they can be requested while component storages are being iterated, possibly from job threads.
+// Everything is applied in recorded order by `flush`.
+//
+// Entities created through the buffer get a provisional handle, with `index` pointing into the buffer's created entities.
+// It can be used in subsequent commands of the same buffer and is resolved during `flush`.
+//
+
+enum SceneCommandKind : u8 {
+	SceneCommand_create_entity,
+	SceneCommand_destroy_entity,
+	SceneCommand_add_component,
+	SceneCommand_remove_component,
+	SceneCommand_set_parent,
+};
+
+struct SceneCommand {
+	SceneCommandKind kind;
+	EntityHandle entity;
+	union {
+		Uid type_uid;        // add_component, remove_component
+		EntityHandle parent; // set_parent, zero handle means no parent
+		struct {             // create_entity
+			u32 name_offset;
+			u32 name_count;
+		};
+	};
+};
+
+struct SceneCommandBuffer {
+	List<SceneCommand> commands;
+	List<utf8> names;
+	u32 created_entity_count = 0;
+
+	SceneCommandBuffer() {
+		commands.allocator = default_allocator;
+		names.allocator = default_allocator;
+	}
+};
+
+inline constexpr u32 provisional_entity_generation = ~0u;
+
+inline bool is_provisional(EntityHandle handle) {
+	return handle.generation == provisional_entity_generation;
+}
+
+EntityHandle create_entity(SceneCommandBuffer &buffer, Span<utf8> name = {});
+void destroy_entity(SceneCommandBuffer &buffer, EntityHandle entity);
+void add_component(SceneCommandBuffer &buffer, EntityHandle entity, Uid type_uid);
+void remove_component(SceneCommandBuffer &buffer, EntityHandle entity, Uid type_uid);
+void set_parent(SceneCommandBuffer &buffer, EntityHandle entity, EntityHandle parent);
+
+template <class T>
+void add_component(SceneCommandBuffer &buffer, EntityHandle entity) {
+	add_component(buffer, entity, get_component_uid<T>());
+}
+
+template <class T>
+void remove_component(SceneCommandBuffer &buffer, EntityHandle entity) {
+	remove_component(buffer, entity, get_component_uid<T>());
+}
+
+// Moves commands of `source` to the end of `destination`, remapping provisional handles. `source` is left empty.
+void append(SceneCommandBuffer &destination, SceneCommandBuffer &source);
+
+// Applies and clears recorded commands. Memory is kept for reuse.
+// Commands targeting entities that no longer exist are skipped.
+void flush(SceneCommandBuffer &buffer, struct Scene &scene);
+
+// Drops recorded commands without applying them
+void clear(SceneCommandBuffer &buffer);
+
+void free(SceneCommandBuffer &buffer);
+
+//
+// Every scene has one buffer per job worker, so parallel updates can record commands without locking.
+// `prepare_command_buffers` must be called on the main thread before jobs may use `get_command_buffer`.
+//
+void prepare_command_buffers(struct Scene &scene);
+SceneCommandBuffer &get_command_buffer(struct Scene &scene);
+
+// Merges per-worker buffers in worker order and applies them
+void flush_commands(struct Scene &scene);
@@ -1,6 +1,49 @@
 #include "serialize.h"
 #include <t3d/entity.h>
 #include <t3d/app.h>
+#include <t3d/transform.h>
+
+// Parents are stored as an index of the entity in the file, because slot indices are not preserved
+static constexpr u32 no_parent_in_file = ~0u;
+
+static List<u32> get_file_indices(Scene *scene) {
+	List<u32> file_indices;
+	file_indices.allocator = temporary_allocator;
+	file_indices.resize(scene->entity_generations.count);
+	for (auto &file_index : file_indices) {
+		file_index = no_parent_in_file;
+	}
+
+	u32 file_index = 0;
+	for_each(scene->entities, [&](Entity &entity) {
+		if (is_editor_entity(entity)) {
+			return;
+		}
+		file_indices[entity.handle.index] = file_index++;
+	});
+	return file_indices;
+}
+
+static u32 get_parent_file_index(Entity &entity, List<u32> const &file_indices) {
+	auto parent = get_parent(entity);
+	return parent ? file_indices[parent->handle.index] : no_parent_in_file;
+}
+
+static void link_parents(Span<Entity *> entities, Span<u32> parent_file_indices) {
+	for (umm i = 0; i < entities.count; ++i) {
+		auto parent_file_index = parent_file_indices[i];
+		if (parent_file_index == no_parent_in_file)
+			continue;
+
+		if (parent_file_index >= entities.count) {
+			print(Print_warning, "Entity \"{}\" has invalid parent index {}\n", entities[i]->name, parent_file_index);
+			continue;
+		}
+		if (!set_parent(*entities[i], entities[parent_file_index])) {
+			print(Print_warning, "Entity \"{}\" can't be a child of \"{}\": that would create a cycle\n", entities[i]->name, entities[parent_file_index]->name);
+		}
+	}
+}
 
 void serialize_binary(StringBuilder &builder, f32 value) {
 	append_bytes(builder, value);
@@ -32,6 +75,8 @@ List<u8> serialize_scene_binary(Scene *scene, HashMap<Uid, Uid> component_type_u
 	StringBuilder builder;
 	builder.allocator = temporary_allocator;
 
+	auto file_indices = get_file_indices(scene);
+
 	for_each(scene->entities, [&](Entity &entity) {
 		if (is_editor_entity(entity)) {
 			return;
@@ -42,6 +87,8 @@ List<u8> serialize_scene_binary(Scene *scene, HashMap<Uid, Uid> component_type_u
 		append_bytes(builder, entity.position);
 		append_bytes(builder, entity.rotation);
 		append_bytes(builder, entity.scale);
+		append_bytes(builder, (EntityFlags)(entity.flags & ~Entity_editor_mask));
+		append_bytes(builder, get_parent_file_index(entity, file_indices));
 
 		append_bytes(builder, (u32)entity.components.count);
 		for (auto &component : entity.components) {
@@ -109,6 +156,7 @@ List<u8> serialize_scene_text(Scene *scene) {
 	StringBuilder builder;
 	builder.allocator = temporary_allocator;
 
+	auto file_indices = get_file_indices(scene);
 
 	for_each(scene->entities, [&](Entity &entity) {
 		if (is_editor_entity(entity)) {
@@ -128,6 +176,15 @@ List<u8> serialize_scene_text(Scene *scene) {
 		serialize_text(builder, entity.scale);
 		append(builder, ";\n");
 
+		if (entity.flags & Entity_static) {
+			append(builder, "\tstatic;\n");
+		}
+
+		auto parent_file_index = get_parent_file_index(entity, file_indices);
+		if (parent_file_index != no_parent_in_file) {
+			append_format(builder, "\tparent {};\n", parent_file_index);
+		}
+
 		for (auto &component : entity.components) {
 			append(builder, "\t");
 			auto &info = get_component_info(component.type_uid);
@@ -160,6 +217,9 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 	Token *end = tokens.end();
 
 	List<Entity *> added_entities;
+	added_entities.allocator = temporary_allocator;
+	List<u32> parent_file_indices;
+	parent_file_indices.allocator = temporary_allocator;
 	bool success = false;
 	defer {
 		if (!success) {
@@ -210,12 +270,11 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 
 		auto &entity = scene->create_entity(unescaped_name);
 		added_entities.add(&entity);
-
-		auto entity_index = (u32)index_of(scene->entities, &entity).value();
+		parent_file_indices.add(no_parent_in_file);
 
 		while (t != end && t->kind != '}') {
 			if (t->kind != Token_identifier) {
-				print(Print_error, "Expected position, rotation, scale or component name, but got '{}'\n", t->string);
+				print(Print_error, "Expected position, rotation, scale, static, parent or component name, but got '{}'\n", t->string);
 				return 0;
 			}
 
@@ -277,6 +336,30 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 					print(Print_error, "Error while parsing \"{}\"'s scale. Expected ';' at the end of line instead of {}.", t->string);
 					go_to_next_property(started_from, t, end);
 				}
+			} else if (t->string == u8"static"s) {
+				t += 1;
+				entity.flags |= Entity_static;
+				if (t->kind == ';') {
+					++t;
+				} else {
+					print(Print_error, "Error while parsing \"{}\"'s static. Expected ';' at the end of line instead of {}.", t->string);
+					go_to_next_property(started_from, t, end);
+				}
+			} else if (t->string == u8"parent"s) {
+				t += 1;
+				f32 parent_file_index;
+				if (!parse_float(parent_file_index)) return 0;
+				if (parent_file_index < 0) {
+					print(Print_error, "Error while parsing \"{}\"'s parent. Expected non-negative entity index, but got {}.", entity.name, parent_file_index);
+					return 0;
+				}
+				parent_file_indices.back() = (u32)parent_file_index;
+				if (t->kind == ';') {
+					++t;
+				} else {
+					print(Print_error, "Error while parsing \"{}\"'s parent. Expected ';' at the end of line instead of {}.", t->string);
+					go_to_next_property(started_from, t, end);
+				}
 			} else {
 				ComponentInfo *found_info = 0;
 				Uid component_type_uid;
@@ -309,16 +392,16 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 						return 0;
 					}
 
-					// TODO: similar code is in `add_component(Entity &, u32, Uid)`
+					// TODO: similar code is in `add_component(Entity &, Uid)`
 					auto added = storage.add();
 
 					info.construct(added.pointer);
-					((Component *)added.pointer)->_entity = &entity;
+					link_component(added.pointer, entity);
 
 					entity.components.add(ComponentIndex{
 						.type_uid = component_type_uid,
 						.storage_index = added.index,
-						.entity_index = entity_index,
+						.entity = entity.handle,
 					});
 
 					if (!info.deserialize_text(t, end, added.pointer)) {
@@ -327,6 +410,7 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 					if (info.init) {
 						info.init(added.pointer);
 					}
+					scene->on_component_added(entity, component_type_uid);
 				} else {
 					print(Print_error, "Unexpected token '{}'. There is no component with this name.\n", t->string);
 					return 0;
@@ -342,6 +426,8 @@ Scene *deserialize_scene_text(Span<utf8> path) {
 		t += 1;
 	}
 
+	link_parents(added_entities, parent_file_indices);
+
 	success = true;
 
 	//for (auto &token : tokens) {
@@ -415,9 +501,14 @@ Scene *deserialize_scene_binary(Span<u8> data) {
 	auto cursor = data.data;
 	auto end = data.end();
 
+	List<Entity *> added_entities;
+	added_entities.allocator = temporary_allocator;
+	List<u32> parent_file_indices;
+	parent_file_indices.allocator = temporary_allocator;
+
 	while(cursor != end) {
 		auto &entity = scene->create_entity();
-		auto entity_index = (u32)index_of(scene->entities, &entity).value();
+		added_entities.add(&entity);
 
 		u32 name_size;
 		if (cursor + sizeof(name_size) > end) {
@@ -460,6 +551,24 @@ Scene *deserialize_scene_binary(Span<u8> data) {
 		cursor += sizeof(entity.scale);
 
 
+		if (cursor + sizeof(entity.flags) > end) {
+			print(Print_error, "Failed to deserialize scene: reached data end too soon (entity.flags)\n");
+			return 0;
+		}
+		entity.flags = *(EntityFlags *)cursor;
+		cursor += sizeof(entity.flags);
+
+
+		u32 parent_file_index;
+		if (cursor + sizeof(parent_file_index) > end) {
+			print(Print_error, "Failed to deserialize scene: reached data end too soon (parent_file_index)\n");
+			return 0;
+		}
+		parent_file_index = *(u32 *)cursor;
+		cursor += sizeof(parent_file_index);
+		parent_file_indices.add(parent_file_index);
+
+
 		u32 component_count;
 		if (cursor + sizeof(component_count) > end) {
 			print(Print_error, "Failed to deserialize scene: reached data end too soon (component_count)\n");
@@ -487,15 +596,15 @@ Scene *deserialize_scene_binary(Span<u8> data) {
 
 			auto added = storage.add();
 
-			// TODO: similar code is in `add_component(Entity &, u32, Uid)`
+			// TODO: similar code is in `add_component(Entity &, Uid)`
 
 			info.construct(added.pointer);
-			((Component *)added.pointer)->_entity = &entity;
+			link_component(added.pointer, entity);
 
 			entity.components.add(ComponentIndex{
 				.type_uid = component_type_uid,
 				.storage_index = added.index,
-				.entity_index = entity_index,
+				.entity = entity.handle,
 			});
 
 			if (!info.deserialize_binary(cursor, end, added.pointer)) {
@@ -503,9 +612,12 @@ Scene *deserialize_scene_binary(Span<u8> data) {
 			}
 			if (info.init)
 				info.init(added.pointer);
+			scene->on_component_added(entity, component_type_uid);
 		}
 	}
 
+	link_parents(added_entities, parent_file_indices);
+
 	return scene;
 }
 bool deserialize_binary(f32 &value, u8 *&from, u8 *end) {
@@ -9,6 +9,8 @@ struct DataHeader {
 	u64 asset_size;
 	u64 scene_offset;
 	u64 scene_size;
+	u64 mesh_lod_offset;
+	u64 mesh_lod_size;
 };
 
 void serialize_binary(StringBuilder &builder, f32 value);
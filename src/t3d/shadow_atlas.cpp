@@ -0,0 +1,193 @@
+#include "shadow_atlas.h"
+#include <t3d/app.h>
+#include <tl/profiler.h>
+#include <algorithm>
+
+void free(ShadowAtlas &atlas) {
+	free(atlas.tiles);
+	free(atlas.requested_sizes);
+}
+
+static u32 get_desired_size(ShadowAtlas &atlas, f32 importance) {
+	if (importance <= 0)
+		return 0;
+
+	auto max_size = atlas.size / 2;
+	auto size = ShadowAtlas::min_tile_size;
+	while (size < max_size && size < importance * max_size) {
+		size *= 2;
+	}
+	return size;
+}
+
+// Even bits of `x`
+static u32 compact_bits(u64 x) {
+	x &= 0x5555555555555555;
+	x = (x | (x >>  1)) & 0x3333333333333333;
+	x = (x | (x >>  2)) & 0x0f0f0f0f0f0f0f0f;
+	x = (x | (x >>  4)) & 0x00ff00ff00ff00ff;
+	x = (x | (x >>  8)) & 0x0000ffff0000ffff;
+	x = (x | (x >> 16)) & 0x00000000ffffffff;
+	return (u32)x;
+}
+
+void update(ShadowAtlas &atlas, Span<ShadowAtlasRequest> requests) {
+	timed_function();
+
+	assert(atlas.size >= ShadowAtlas::min_tile_size * 2 && (atlas.size & (atlas.size - 1)) == 0);
+
+	atlas.repacked = false;
+	bool needs_repack = false;
+
+	if (atlas.created_size != atlas.size) {
+		atlas.target        = app->tg->create_render_target(0, app->tg->create_texture_2d(atlas.size, atlas.size, 0, tg::Format_depth));
+		atlas.static_target = app->tg->create_render_target(0, app->tg->create_texture_2d(atlas.size, atlas.size, 0, tg::Format_depth));
+		atlas.created_size = atlas.size;
+		needs_repack = true;
+	}
+
+	struct Wanted {
+		u64 light;
+		f32 importance;
+		u32 size;
+		ShadowTile tile;
+	};
+
+	List<Wanted> wanted;
+	wanted.allocator = temporary_allocator;
+
+	List<u32> requested_sizes;
+	requested_sizes.allocator = temporary_allocator;
+	requested_sizes.reserve(requests.count);
+
+	u32 old_request_count = 0;
+	for_each(atlas.requested_sizes, [&](u64 light, u32 size) {
+		old_request_count += 1;
+	});
+
+	//
+	// Sizes are compared with what lights asked for last time, not with their tiles. Tiles may have been shrunk to fit,
+	// and comparing with them would make every light that didn't get its size ask for it again each frame.
+	//
+	bool requests_changed = needs_repack;
+	u32 kept_request_count = 0;
+	for (auto request : requests) {
+		u32 requested = 0;
+		if (auto found = atlas.requested_sizes.find(request.light)) {
+			requested = *found;
+			kept_request_count += 1;
+		}
+
+		// Grow right away, but shrink only when a much smaller tile is enough
+		auto desired = get_desired_size(atlas, request.importance);
+		auto size = requested;
+		if (desired > requested || desired * 4 <= requested) {
+			size = desired;
+		}
+
+		if (size != requested) {
+			requests_changed = true;
+		}
+		requested_sizes.add(size);
+
+		if (size) {
+			wanted.add({
+				.light = request.light,
+				.importance = request.importance,
+				.size = size,
+				.tile = get_tile(atlas, request.light),
+			});
+		}
+	}
+	if (kept_request_count != old_request_count) {
+		requests_changed = true;
+	}
+
+	if (requests_changed) {
+		std::sort(wanted.begin(), wanted.end(), [](Wanted const &a, Wanted const &b) { return a.importance > b.importance; });
+
+		u64 capacity = (u64)atlas.size * atlas.size;
+		u64 total_area = 0;
+		for (auto &w : wanted) {
+			total_area += (u64)w.size * w.size;
+		}
+
+		// Halve the least important tile that can be halved. If all are at minimum, drop the least important one.
+		while (total_area > capacity) {
+			bool halved = false;
+			for (umm i = wanted.count; i-- > 0;) {
+				auto &w = wanted[i];
+				if (w.size > ShadowAtlas::min_tile_size) {
+					total_area -= (u64)w.size * w.size;
+					w.size /= 2;
+					total_area += (u64)w.size * w.size;
+					halved = true;
+					break;
+				}
+			}
+			if (!halved) {
+				total_area -= (u64)wanted.back().size * wanted.back().size;
+				wanted.pop();
+			}
+		}
+
+		// Tiles move only if a size that fits is different from the current one. Lights that lost their tiles just free space.
+		for (auto &w : wanted) {
+			if (w.size != w.tile.size) {
+				needs_repack = true;
+			}
+		}
+	}
+
+	if (needs_repack) {
+		// Largest first, so every tile starts at a multiple of its own area along the curve
+		std::stable_sort(wanted.begin(), wanted.end(), [](Wanted const &a, Wanted const &b) { return a.size > b.size; });
+
+		u64 offset = 0;
+		for (auto &w : wanted) {
+			auto cells = w.size / ShadowAtlas::min_tile_size;
+			w.tile = {
+				.position = v2u{compact_bits(offset), compact_bits(offset >> 1)} * ShadowAtlas::min_tile_size,
+				.size = w.size,
+			};
+			offset += (u64)cells * cells;
+		}
+
+		atlas.repacked = true;
+		atlas.repack_count += 1;
+	}
+
+	// Also drops tiles of lights that were not requested or didn't fit
+	atlas.tiles.clear();
+	for (auto &w : wanted) {
+		if (w.tile.size) {
+			atlas.tiles.get_or_insert(w.light) = w.tile;
+		}
+	}
+
+	atlas.requested_sizes.clear();
+	for (umm i = 0; i < requests.count; ++i) {
+		atlas.requested_sizes.get_or_insert(requests[i].light) = requested_sizes[i];
+	}
+}
+
+ShadowTile get_tile(ShadowAtlas &atlas, u64 light) {
+	if (auto found = atlas.tiles.find(light)) {
+		return *found;
+	}
+	return {};
+}
+
+v4f get_uv_rect(ShadowAtlas &atlas, ShadowTile tile) {
+	auto scale = 1.0f / atlas.size;
+	return {
+		tile.position.x * scale,
+		tile.position.y * scale,
+		tile.size * scale,
+		tile.size * scale,
+	};
+}
+
+tg::Rect get_viewport(ShadowTile tile) {
+	return aabb_min_max((v2s)tile.position, (v2s)(tile.position + v2u{tile.size, tile.size}));
+}
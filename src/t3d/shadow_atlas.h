@@ -0,0 +1,67 @@
+#pragma once
+#include <t3d/common.h>
+
+//
+// Shadow maps of all lights are square tiles of one depth texture.
+//
+// Every frame each light asks for a tile size by its importance: a power of two between `min_tile_size` and
+// half of the atlas, proportional to how much of a camera's view the light can reach. Lights that no camera can see get no tile.
+// A light keeps its tile until the size it asks for grows, or shrinks to a quarter, so tiles don't move every frame.
+//
+// When sizes that fit change everything is repacked. If requested tiles don't fit, tiles of least important lights are halved until they do,
+// and lights that don't fit even with `min_tile_size` get no tile. Power-of-two squares placed from largest to smallest along
+// a Z-order curve leave no gaps, so packing always succeeds when the total area fits.
+//
+// `size` is the only setting: memory of the atlas and the static layer (see shadow_cache.h) is `2 * size * size * 4` bytes.
+//
+
+struct ShadowTile {
+	v2u position; // In texels
+	u32 size;     // Zero if light has no tile
+
+	bool operator==(ShadowTile const &that) const {
+		return position.x == that.position.x && position.y == that.position.y && size == that.size;
+	}
+};
+
+struct ShadowAtlasRequest {
+	u64 light;        // Key of light's entity handle, see `to_u64`
+	f32 importance;   // Zero if light is not visible, one if it covers the whole view
+};
+
+struct ShadowAtlas {
+	static constexpr u32 min_tile_size = 64;
+
+	// Textures are recreated when this changes
+	u32 size = 2048;
+
+	tg::RenderTarget *target;
+	tg::RenderTarget *static_target;
+	u32 created_size;
+
+	HashMap<u64, ShadowTile> tiles;
+
+	// Size each light asked for last frame, before tiles were shrunk to fit. Hysteresis is applied to these.
+	HashMap<u64, u32> requested_sizes;
+
+	// Set by `update` when tiles were repacked this frame
+	bool repacked;
+	u32 repack_count;
+
+	ShadowAtlas() {
+		tiles.allocator = default_allocator;
+		requested_sizes.allocator = default_allocator;
+	}
+};
+
+void free(ShadowAtlas &atlas);
+
+// Call once per frame with every light that casts shadows. Lights that are not in `requests` lose their tiles.
+void update(ShadowAtlas &atlas, Span<ShadowAtlasRequest> requests);
+
+ShadowTile get_tile(ShadowAtlas &atlas, u64 light);
+
+// Offset in xy and scale in zw, to go from light's [0, 1] shadow map coordinates to atlas coordinates
+v4f get_uv_rect(ShadowAtlas &atlas, ShadowTile tile);
+
+tg::Rect get_viewport(ShadowTile tile);
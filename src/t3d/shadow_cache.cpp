@@ -0,0 +1,39 @@
+#include "shadow_cache.h"
+#include <t3d/culling.h>
+#include <t3d/components/mesh_renderer.h>
+
+void free(ShadowCache &cache) {
+	free(cache.entries);
+}
+
+void remove_unused_entries(ShadowCache &cache, u32 frame_index) {
+	List<u64> unused;
+	unused.allocator = temporary_allocator;
+	for_each(cache.entries, [&](u64 key, ShadowCacheEntry &entry) {
+		if (entry.last_used_frame != frame_index) {
+			unused.add(key);
+		}
+	});
+	for (auto key : unused) {
+		cache.entries.erase(key);
+	}
+}
+
+bool update_casters_hash(u64 &hash, SceneBounds &bounds, Span<u32> renderer_indices) {
+	bool any_changed = false;
+
+	// FNV-1a over renderers, their entity slots and levels of detail. A box at the same index with a different renderer is marked as changed anyway.
+	u64 new_hash = 0xcbf29ce484222325;
+	for (auto renderer_index : renderer_indices) {
+		any_changed |= bounds.changed[renderer_index] != 0;
+
+		new_hash = (new_hash ^ renderer_index) * 0x100000001b3;
+		new_hash = (new_hash ^ bounds.entity_indices[renderer_index]) * 0x100000001b3;
+		new_hash = (new_hash ^ bounds.renderers[renderer_index]->lod) * 0x100000001b3;
+	}
+	new_hash = (new_hash ^ renderer_indices.count) * 0x100000001b3;
+
+	bool result = any_changed || new_hash != hash;
+	hash = new_hash;
+	return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <t3d/common.h>
+#include <t3d/shadow_atlas.h>
+
+struct SceneBounds;
+
+//
+// Keeps shadow maps from being re-rendered when nothing they depend on changed.
+//
+// Every light remembers its atlas tile, light matrix and a hash of the casters its shadow map was rendered with. The pass is skipped
+// if the tile and the matrix are the same and the hash of visible casters is the same, and none of them moved.
+//
+// Lights of `Entity_static` entities also keep a layer with only static casters, in the same tile of `ShadowAtlas::static_target`.
+// When only dynamic casters change, the layer is copied into the shadow map and dynamic casters are drawn over it.
+//
+// Entries are keyed by light's entity handle and live outside of the component, because component data can be restored
+// from a snapshot while the atlas keeps what was rendered later.
+//
+
+struct ShadowCacheEntry {
+	m4 world_to_light_matrix;
+	u64 static_casters_hash;
+	u64 dynamic_casters_hash;
+	ShadowTile tile;
+
+	// Static layer of this tile is valid
+	bool has_static_layer;
+
+	u32 last_used_frame;
+};
+
+struct ShadowCache {
+	HashMap<u64, ShadowCacheEntry> entries; // Keys are from `to_u64(EntityHandle)`
+
+	// Reset every frame by `runtime_render`
+	u32 skipped_pass_count;
+	u32 static_layer_update_count;
+
+	ShadowCache() {
+		entries.allocator = default_allocator;
+	}
+};
+
+void free(ShadowCache &cache);
+
+// Removes entries of lights that were not rendered in `frame_index`
+void remove_unused_entries(ShadowCache &cache, u32 frame_index);
+
+//
+// Updates `hash` with casters in `renderer_indices`, which point into `bounds.renderers`.
+// Returns true if the set of casters is different from the one `hash` was computed for, or if any of them changed this frame.
+//
+bool update_casters_hash(u64 &hash, SceneBounds &bounds, Span<u32> renderer_indices);
@@ -0,0 +1,425 @@
+#include "snapshot.h"
+#include <t3d/app.h>
+#include <tl/profiler.h>
+
+using Block = ComponentStorage::Block;
+using Mask = ComponentStorage::Mask;
+
+static umm get_block_data_size(u32 bytes_per_entry) {
+	return sizeof(Block) + bytes_per_entry * ComponentStorage::values_per_block;
+}
+
+static bool is_set(Mask const *masks, u32 value_index) {
+	return (masks[value_index / ComponentStorage::bits_in_mask] >> (value_index % ComponentStorage::bits_in_mask)) & 1;
+}
+
+// Calls `fn(storage_index)` for every value that has a bit set in block masks
+template <class Fn>
+static void for_each_index(Block const &block, u32 block_index, Fn &&fn) {
+	for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+		auto mask = block.masks[mask_index];
+		while (mask) {
+			auto bit_index = find_lowest_one_bit(mask);
+			mask &= mask - 1;
+			fn(block_index * ComponentStorage::values_per_block + mask_index * ComponentStorage::bits_in_mask + bit_index);
+		}
+	}
+}
+
+static SceneSnapshot::StorageState *find_storage_state(SceneSnapshot &snapshot, Uid type_uid) {
+	for (auto &state : snapshot.storages) {
+		if (state.type_uid == type_uid) {
+			return &state;
+		}
+	}
+	return 0;
+}
+
+// Pointers to a block of a stored storage
+struct StoredBlock {
+	Block header;
+	u8 *values;
+};
+
+static StoredBlock get_stored_block(SceneSnapshot &snapshot, SceneSnapshot::StorageState &state, u32 block_index) {
+	auto cursor = snapshot.data.data + state.blocks_offset + block_index * get_block_data_size(state.bytes_per_entry);
+
+	StoredBlock result;
+	memcpy(&result.header, cursor, sizeof(Block));
+	result.values = cursor + sizeof(Block);
+	return result;
+}
+
+void take_snapshot(SceneSnapshot &snapshot, Scene &scene) {
+	timed_function();
+
+	snapshot.entities.clear();
+	snapshot.names.clear();
+	snapshot.storages.clear();
+	snapshot.unfull_block_indices.clear();
+
+	for_each(scene.entities, [&](Entity &entity) {
+		snapshot.entities.add({
+			.handle = entity.handle,
+			.parent = entity.parent,
+			.position = entity.position,
+			.rotation = entity.rotation,
+			.scale = entity.scale,
+			.flags = entity.flags,
+			.components = entity.components,
+			.name_offset = (u32)snapshot.names.count,
+			.name_count = (u32)entity.name.count,
+		});
+		for (auto c : entity.name) {
+			snapshot.names.add(c);
+		}
+	});
+
+	// Allocate all block data at once
+	umm data_size = 0;
+	for_each(scene.component_storages, [&](Uid type_uid, ComponentStorage &storage) {
+		data_size += storage.blocks.count * get_block_data_size(storage.bytes_per_entry);
+	});
+	snapshot.data.resize(data_size);
+
+	umm offset = 0;
+	for_each(scene.component_storages, [&](Uid type_uid, ComponentStorage &storage) {
+		snapshot.storages.add({
+			.type_uid = type_uid,
+			.bytes_per_entry = storage.bytes_per_entry,
+			.block_count = (u32)storage.blocks.count,
+			.blocks_offset = offset,
+			.unfull_block_offset = (u32)snapshot.unfull_block_indices.count,
+			.unfull_block_count = (u32)storage.unfull_block_indices.count,
+		});
+		for (auto block_index : storage.unfull_block_indices) {
+			snapshot.unfull_block_indices.add(block_index);
+		}
+
+		auto values_size = storage.bytes_per_entry * ComponentStorage::values_per_block;
+		for (auto block : storage.blocks) {
+			memcpy(snapshot.data.data + offset, block, sizeof(Block));
+			offset += sizeof(Block);
+			memcpy(snapshot.data.data + offset, block->values, values_size);
+			offset += values_size;
+		}
+	});
+
+	for (u32 slot_index = 0; slot_index < TickScheduler::slot_count; slot_index += 1) {
+		snapshot.timers[slot_index].set(scene.scheduler.slots[slot_index]);
+	}
+	snapshot.scheduler_next_slot = scene.scheduler.next_slot;
+	snapshot.scheduler_time = scene.scheduler.time;
+	snapshot.scheduler_spread_phase = scene.scheduler.spread_phase;
+}
+
+void restore_snapshot(SceneSnapshot &snapshot, Scene &scene) {
+	timed_function();
+
+	struct RevivedComponent {
+		Uid type_uid;
+		u32 storage_index;
+	};
+
+	List<RevivedComponent> revived_components;
+	revived_components.allocator = temporary_allocator;
+
+	List<Uid> skipped_storages;
+	skipped_storages.allocator = temporary_allocator;
+
+	//
+	// Free components that were created in play mode, remember the ones that were destroyed
+	//
+	for_each(scene.component_storages, [&](Uid type_uid, ComponentStorage &storage) {
+		auto &info = get_component_info(type_uid);
+		auto state = find_storage_state(snapshot, type_uid);
+
+		if (state && state->bytes_per_entry != storage.bytes_per_entry) {
+			print(Print_error, "Layout of {} changed in play mode, its state can't be restored\n", info.name);
+			skipped_storages.add(type_uid);
+			return;
+		}
+
+		// Same slot is not enough: a component that was removed and added again in play mode has new resources,
+		// and the stored bytes refer to the freed ones. Generations tell them apart.
+		auto is_in_snapshot = [&](u32 storage_index, u32 generation) {
+			auto block_index = storage_index / ComponentStorage::values_per_block;
+			if (!state || block_index >= state->block_count)
+				return false;
+
+			auto stored = get_stored_block(snapshot, *state, block_index);
+			auto value_index = storage_index % ComponentStorage::values_per_block;
+			return is_set(stored.header.masks, value_index) && stored.header.generations[value_index] == generation;
+		};
+
+		for (u32 block_index = 0; block_index < storage.blocks.count; block_index += 1) {
+			auto block = storage.blocks[block_index];
+			for_each_index(*block, block_index, [&](u32 storage_index) {
+				if (!is_in_snapshot(storage_index, block->generations[storage_index % ComponentStorage::values_per_block]) && info.free) {
+					info.free(storage.get(storage_index));
+				}
+			});
+		}
+
+		if (!state)
+			return;
+
+		auto is_alive = [&](u32 storage_index, u32 generation) {
+			auto block_index = storage_index / ComponentStorage::values_per_block;
+			if (block_index >= storage.blocks.count)
+				return false;
+
+			auto block = storage.blocks[block_index];
+			auto value_index = storage_index % ComponentStorage::values_per_block;
+			return is_set(block->masks, value_index) && block->generations[value_index] == generation;
+		};
+
+		for (u32 block_index = 0; block_index < state->block_count; block_index += 1) {
+			auto stored = get_stored_block(snapshot, *state, block_index);
+			for_each_index(stored.header, block_index, [&](u32 storage_index) {
+				if (!is_alive(storage_index, stored.header.generations[storage_index % ComponentStorage::values_per_block])) {
+					revived_components.add({type_uid, storage_index});
+				}
+			});
+		}
+	});
+
+	//
+	// Remove entities that were created in play mode. Their components are overwritten below, so don't touch storages.
+	//
+	List<u32> snapshot_generations;
+	snapshot_generations.allocator = temporary_allocator;
+	snapshot_generations.resize(scene.entity_generations.count);
+	for (auto &generation : snapshot_generations) {
+		generation = 0;
+	}
+	for (auto &state : snapshot.entities) {
+		snapshot_generations[state.handle.index] = state.handle.generation;
+	}
+
+	List<Entity *> created_entities;
+	created_entities.allocator = temporary_allocator;
+	for_each(scene.entities, [&](Entity &entity) {
+		if (snapshot_generations[entity.handle.index] != entity.handle.generation) {
+			created_entities.add(&entity);
+		}
+	});
+	for (auto entity : created_entities) {
+		// Components of skipped storages are not overwritten, so remove them here
+		for (auto component : entity->components) {
+			if (!find(skipped_storages, component.type_uid))
+				continue;
+
+			auto &info = get_component_info(component.type_uid);
+			auto &storage = scene.component_storages.find(component.type_uid).get();
+			if (info.free) {
+				info.free(storage.get(component.storage_index));
+			}
+			storage.remove_at(component.storage_index);
+		}
+
+		free(entity->name);
+		scene.entity_generations[entity->handle.index] += 1;
+		scene.entities.remove(entity);
+	}
+
+	//
+	// Restore entities. Ones that were destroyed in play mode are recreated, possibly in a different slot.
+	//
+	HashMap<u64, EntityHandle> recreated_handles;
+	recreated_handles.allocator = temporary_allocator;
+
+	List<Entity *> recreated_entities;
+	recreated_entities.allocator = temporary_allocator;
+
+	for (auto &state : snapshot.entities) {
+		auto entity = scene.get_entity(state.handle);
+		bool recreated = !entity;
+		if (recreated) {
+			entity = &scene.create_entity();
+			recreated_handles.get_or_insert(to_u64(state.handle)) = entity->handle;
+			recreated_entities.add(entity);
+		}
+
+		// Storages of skipped types keep their play mode state, so indices into them are taken from the entity,
+		// not from the snapshot. Recreated entities lose components of these types.
+		StaticList<ComponentIndex, 16> components;
+		for (auto component : state.components) {
+			if (!find(skipped_storages, component.type_uid)) {
+				components.add(component);
+			}
+		}
+		if (!recreated) {
+			for (auto component : entity->components) {
+				if (find(skipped_storages, component.type_uid)) {
+					components.add(component);
+				}
+			}
+		}
+
+		entity->parent     = state.parent;
+		entity->position   = state.position;
+		entity->rotation   = state.rotation;
+		entity->scale      = state.scale;
+		entity->flags      = state.flags;
+		entity->components = components;
+		entity->name.set(Span(snapshot.names.data + state.name_offset, state.name_count));
+	}
+
+	//
+	// Restore storages
+	//
+	for (auto &state : snapshot.storages) {
+		if (find(skipped_storages, state.type_uid))
+			continue;
+
+		auto &storage = scene.find_or_create_component_storage(state.type_uid, get_component_info(state.type_uid));
+
+		while (storage.blocks.count > state.block_count) {
+			auto block = storage.blocks.pop();
+			storage.allocator.free(block->values);
+			storage.allocator.free(block);
+		}
+		while (storage.blocks.count < state.block_count) {
+			auto block = storage.allocator.allocate<Block>();
+			block->values = storage.allocator.allocate_uninitialized(storage.bytes_per_entry * ComponentStorage::values_per_block, storage.entry_alignment);
+			storage.blocks.add(block);
+		}
+
+		auto cursor = snapshot.data.data + state.blocks_offset;
+		auto values_size = storage.bytes_per_entry * ComponentStorage::values_per_block;
+		for (auto block : storage.blocks) {
+			auto values = block->values;
+			memcpy(block, cursor, sizeof(Block));
+			block->values = values;
+			cursor += sizeof(Block);
+
+			memcpy(values, cursor, values_size);
+			cursor += values_size;
+		}
+
+		storage.unfull_block_indices.set(Span(snapshot.unfull_block_indices.data + state.unfull_block_offset, state.unfull_block_count));
+	}
+
+	// Storages that were created in play mode. Their components were freed above.
+	for_each(scene.component_storages, [&](Uid type_uid, ComponentStorage &storage) {
+		if (find_storage_state(snapshot, type_uid))
+			return;
+
+		for (auto block : storage.blocks) {
+			storage.allocator.free(block->values);
+			storage.allocator.free(block);
+		}
+		storage.blocks.clear();
+		storage.unfull_block_indices.clear();
+	});
+
+	//
+	// Fix up references to recreated entities
+	//
+	auto fix_up = [&](EntityHandle &handle) {
+		if (auto found = recreated_handles.find(to_u64(handle))) {
+			handle = found.get();
+		}
+	};
+
+	if (recreated_entities.count) {
+		for_each(scene.entities, [&](Entity &entity) {
+			fix_up(entity.parent);
+		});
+		for (auto entity : recreated_entities) {
+			for (auto &component : entity->components) {
+				component.entity = entity->handle;
+				link_component(scene.get_component_data(component), *entity);
+			}
+		}
+	}
+
+	//
+	// Scheduler. Timers refer to storage indices, which are restored too, except for skipped storages.
+	//
+	List<TickTimer> skipped_timers;
+	skipped_timers.allocator = temporary_allocator;
+	for (u32 slot_index = 0; slot_index < TickScheduler::slot_count; slot_index += 1) {
+		auto &timers = scene.scheduler.slots[slot_index];
+
+		skipped_timers.clear();
+		for (auto &timer : timers) {
+			if (find(skipped_storages, timer.type_uid)) {
+				skipped_timers.add(timer);
+			}
+		}
+
+		timers.set(snapshot.timers[slot_index]);
+		if (skipped_storages.count) {
+			for (umm i = 0; i < timers.count;) {
+				if (find(skipped_storages, timers[i].type_uid)) {
+					timers.erase_at(i);
+				} else {
+					i += 1;
+				}
+			}
+			for (auto &timer : skipped_timers) {
+				timers.add(timer);
+			}
+		}
+
+		if (recreated_entities.count) {
+			for (auto &timer : timers) {
+				fix_up(timer.entity);
+			}
+		}
+	}
+	scene.scheduler.next_slot = snapshot.scheduler_next_slot;
+	scene.scheduler.time = snapshot.scheduler_time;
+	scene.scheduler.spread_phase = snapshot.scheduler_spread_phase;
+
+	//
+	// Components that were destroyed in play mode have their data back, but their resources were freed
+	//
+	for (auto revived : revived_components) {
+		auto &info = get_component_info(revived.type_uid);
+		if (info.init) {
+			info.init(scene.component_storages.find(revived.type_uid)->get(revived.storage_index));
+		}
+	}
+
+	//
+	// Derived state
+	//
+	for (auto &buffer : scene.command_buffers) {
+		clear(buffer);
+	}
+	scene.transforms.order_is_dirty = true;
+	scene.rebuild_queries();
+
+	// Renderer pointers may be stale until next `update_world_bounds`
+	scene.bounds.renderers.clear();
+	scene.bounds.meshes.clear();
+	scene.bounds.entity_indices.clear();
+	scene.bounds.changed.clear();
+}
+
+umm get_size(SceneSnapshot &snapshot) {
+	umm result =
+		snapshot.entities.count * sizeof(SceneSnapshot::EntityState) +
+		snapshot.names.count +
+		snapshot.storages.count * sizeof(SceneSnapshot::StorageState) +
+		snapshot.unfull_block_indices.count * sizeof(u32) +
+		snapshot.data.count;
+	for (auto &timers : snapshot.timers) {
+		result += timers.count * sizeof(TickTimer);
+	}
+	return result;
+}
+
+void free(SceneSnapshot &snapshot) {
+	free(snapshot.entities);
+	free(snapshot.names);
+	free(snapshot.storages);
+	free(snapshot.unfull_block_indices);
+	free(snapshot.data);
+	for (auto &timers : snapshot.timers) {
+		free(timers);
+	}
+}
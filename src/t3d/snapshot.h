@@ -0,0 +1,68 @@
+#pragma once
+#include <t3d/scene.h>
+
+//
+// Memory image of a scene, used to restore the editor state after play mode.
+//
+// Component storage blocks are copied as is. Restoring is a memcpy per block plus fix-ups
+// for entities that were destroyed in play mode and had to be recreated in a different slot.
+//
+// Components that survived play mode get their bytes back without calling `free`/`init`, so owned resources
+// created in `init` are reused. Components that did not survive are revived with `init` after their bytes are restored.
+// A component that was removed and added again in the same slot did not survive, block generations tell it apart.
+// Components created in play mode are freed.
+//
+
+struct SceneSnapshot {
+	struct EntityState {
+		EntityHandle handle;
+		EntityHandle parent;
+		v3f position;
+		quaternion rotation;
+		v3f scale;
+		EntityFlags flags;
+		StaticList<ComponentIndex, 16> components;
+		u32 name_offset;
+		u32 name_count;
+	};
+
+	struct StorageState {
+		Uid type_uid;
+		u32 bytes_per_entry;
+		u32 block_count;
+		umm blocks_offset;       // Into `data`. Every block is `Block` header followed by its values.
+		u32 unfull_block_offset; // Into `unfull_block_indices`
+		u32 unfull_block_count;
+	};
+
+	List<EntityState> entities;
+	List<utf8> names;
+
+	List<StorageState> storages;
+	List<u32> unfull_block_indices;
+	List<u8> data;
+
+	List<TickTimer> timers[TickScheduler::slot_count];
+	u64 scheduler_next_slot;
+	f64 scheduler_time;
+	f32 scheduler_spread_phase;
+
+	SceneSnapshot() {
+		entities.allocator = default_allocator;
+		names.allocator = default_allocator;
+		storages.allocator = default_allocator;
+		unfull_block_indices.allocator = default_allocator;
+		data.allocator = default_allocator;
+		for (auto &slot : timers) {
+			slot.allocator = default_allocator;
+		}
+	}
+};
+
+// Memory is reused if `snapshot` was taken before
+void take_snapshot(SceneSnapshot &snapshot, Scene &scene);
+void restore_snapshot(SceneSnapshot &snapshot, Scene &scene);
+
+umm get_size(SceneSnapshot &snapshot);
+
+void free(SceneSnapshot &snapshot);
@@ -0,0 +1,137 @@
+#include "tick_scheduler.h"
+#include <t3d/scene.h>
+#include <tl/profiler.h>
+
+void free(TickScheduler &scheduler) {
+	for (auto &slot : scheduler.slots) {
+		free(slot);
+	}
+}
+
+static u64 get_slot(TickScheduler &scheduler, f64 time) {
+	return (u64)(time / TickScheduler::slot_duration);
+}
+
+// Must be called with `scheduler.mutex` locked
+static void add_timer(TickScheduler &scheduler, Uid type_uid, EntityHandle entity, u32 storage_index, f32 seconds) {
+	// Timer can't fire on a slot that was already processed
+	auto slot = max(get_slot(scheduler, scheduler.time + seconds), scheduler.next_slot);
+	auto slots_ahead = slot - scheduler.next_slot;
+
+	scheduler.slots[slot % TickScheduler::slot_count].add({
+		.type_uid = type_uid,
+		.entity = entity,
+		.storage_index = storage_index,
+		.rounds = (u32)(slots_ahead / TickScheduler::slot_count),
+	});
+}
+
+void advance(TickScheduler &scheduler, Scene &scene, f32 delta_time) {
+	timed_function();
+
+	scheduler.time += delta_time;
+
+	std::lock_guard lock(scheduler.mutex);
+
+	auto last_slot = get_slot(scheduler, scheduler.time);
+	for (; scheduler.next_slot <= last_slot; scheduler.next_slot += 1) {
+		auto &timers = scheduler.slots[scheduler.next_slot % TickScheduler::slot_count];
+
+		// Keep timers that have more turns to wait, wake the rest
+		umm kept_count = 0;
+		for (auto timer : timers) {
+			if (timer.rounds) {
+				timer.rounds -= 1;
+				timers[kept_count++] = timer;
+				continue;
+			}
+
+			auto found_storage = scene.component_storages.find(timer.type_uid);
+			if (!found_storage)
+				continue;
+
+			auto &storage = found_storage.get();
+			auto block_index = timer.storage_index / ComponentStorage::values_per_block;
+			auto value_index = timer.storage_index % ComponentStorage::values_per_block;
+			if (block_index >= storage.blocks.count)
+				continue;
+			if (!((storage.blocks[block_index]->masks[value_index / ComponentStorage::bits_in_mask] >> (value_index % ComponentStorage::bits_in_mask)) & 1))
+				continue;
+			if (((Component *)storage.get(timer.storage_index))->_entity != timer.entity)
+				continue;
+
+			storage.set_sleeping(timer.storage_index, false);
+		}
+		timers.resize(kept_count);
+	}
+}
+
+void sleep_component(Scene &scene, Uid type_uid, u32 storage_index, f32 seconds) {
+	auto &storage = scene.component_storages.find(type_uid).get();
+	storage.set_sleeping(storage_index, true);
+
+	if (seconds == sleep_forever)
+		return;
+
+	auto &scheduler = scene.scheduler;
+	std::lock_guard lock(scheduler.mutex);
+	add_timer(scheduler, type_uid, ((Component *)storage.get(storage_index))->_entity, storage_index, seconds);
+}
+
+void wake_component(Scene &scene, Uid type_uid, u32 storage_index) {
+	scene.component_storages.find(type_uid).get().set_sleeping(storage_index, false);
+}
+
+void sleep_components_in_block(Scene &scene, Uid type_uid, ComponentStorage &storage, u32 block_index, ComponentStorage::Mask const *masks, f32 seconds) {
+	auto &scheduler = scene.scheduler;
+
+	// One lock per block instead of one per component
+	std::lock_guard lock(scheduler.mutex);
+	for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+		auto mask = masks[mask_index];
+		while (mask) {
+			auto bit_index = find_lowest_one_bit(mask);
+			mask &= mask - 1;
+
+			u32 storage_index = block_index * ComponentStorage::values_per_block + mask_index * ComponentStorage::bits_in_mask + bit_index;
+			storage.set_sleeping(storage_index, true);
+			add_timer(scheduler, type_uid, ((Component *)storage.get(storage_index))->_entity, storage_index, seconds);
+		}
+	}
+}
+
+void schedule_first_tick(TickScheduler &scheduler, Scene &scene, Uid type_uid, u32 storage_index) {
+	auto &info = get_component_info(type_uid);
+	if (info.tick_interval <= 0)
+		return;
+
+	// Golden ratio sequence spreads phases evenly no matter how many components are added
+	scheduler.spread_phase += 0.6180339887f;
+	if (scheduler.spread_phase >= 1) {
+		scheduler.spread_phase -= 1;
+	}
+	sleep_component(scene, type_uid, storage_index, info.tick_interval * scheduler.spread_phase);
+}
+
+void on_storage_compacted(TickScheduler &scheduler, Uid type_uid, Span<ComponentStorage::Move> moves) {
+	if (!moves.count)
+		return;
+
+	HashMap<u32, u32> new_indices;
+	new_indices.allocator = temporary_allocator;
+	for (auto move : moves) {
+		new_indices.get_or_insert(move.from) = move.to;
+	}
+
+	std::lock_guard lock(scheduler.mutex);
+	for (auto &timers : scheduler.slots) {
+		for (auto &timer : timers) {
+			if (timer.type_uid != type_uid)
+				continue;
+
+			if (auto found = new_indices.find(timer.storage_index)) {
+				timer.storage_index = found.get();
+			}
+		}
+	}
+}
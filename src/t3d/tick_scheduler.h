@@ -0,0 +1,70 @@
+#pragma once
+#include <t3d/component.h>
+#include <mutex>
+
+//
+// Lets components skip updates.
+//
+// A sleeping component has its bit set in `ComponentStorage::Block::sleeping_masks` and is not visited by update at all.
+// Timed sleeps are stored in a hashed timer wheel: `slot_count` buckets of `slot_duration` seconds each,
+// timers further than one turn away wait for `rounds` more turns.
+//
+// Components that declare `static constexpr f32 tick_interval` are put to sleep for that long after every update.
+// Their first sleep gets a fraction of the interval, so components with equal rate don't all tick on the same frame.
+//
+
+struct TickTimer {
+	Uid type_uid;
+	EntityHandle entity; // To detect that the component was removed and its slot reused
+	u32 storage_index;
+	u32 rounds;
+};
+
+struct TickScheduler {
+	static constexpr u32 slot_count = 256;
+	static constexpr f64 slot_duration = 1.0 / 60;
+
+	List<TickTimer> slots[slot_count];
+
+	// Absolute index of the next slot to process
+	u64 next_slot = 0;
+
+	// Scheduler's own clock. Advanced by `advance`, starts at zero with the scene.
+	// f32 would run out of precision for 1/60 second slots after a few hours.
+	f64 time = 0;
+
+	// Phase of the next component with `tick_interval`, in [0, 1)
+	f32 spread_phase = 0;
+
+	// Components can go to sleep from parallel updates
+	std::mutex mutex;
+
+	TickScheduler() {
+		for (auto &slot : slots) {
+			slot.allocator = default_allocator;
+		}
+	}
+};
+
+inline constexpr f32 sleep_forever = max_value<f32>;
+
+void free(TickScheduler &scheduler);
+
+// Wakes up everything whose timer expired during `delta_time`
+void advance(TickScheduler &scheduler, struct Scene &scene, f32 delta_time);
+
+//
+// Puts the component to sleep for `seconds`. `sleep_forever` means until `wake_component`.
+// Waking a component does not cancel its timer, so it may be woken early by a previous sleep.
+// From parallel updates only call this for the component being updated.
+//
+void sleep_component(struct Scene &scene, Uid type_uid, u32 storage_index, f32 seconds);
+void wake_component(struct Scene &scene, Uid type_uid, u32 storage_index);
+
+// Puts every value of `block` that has a bit set in `masks` to sleep for `seconds`. Used for `tick_interval`.
+void sleep_components_in_block(struct Scene &scene, Uid type_uid, ComponentStorage &storage, u32 block_index, ComponentStorage::Mask const *masks, f32 seconds);
+
+// Staggers the first update of a component with `tick_interval`
+void schedule_first_tick(TickScheduler &scheduler, struct Scene &scene, Uid type_uid, u32 storage_index);
+
+void on_storage_compacted(TickScheduler &scheduler, Uid type_uid, Span<ComponentStorage::Move> moves);
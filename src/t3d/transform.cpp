@@ -0,0 +1,415 @@
+#include "transform.h"
+#include <t3d/scene.h>
+#include <tl/profiler.h>
+#include <immintrin.h>
+
+void free(SceneTransforms &transforms) {
+	free(transforms.local_positions);
+	free(transforms.local_rotations);
+	free(transforms.local_scales);
+	free(transforms.parent_indices);
+	free(transforms.local_to_world);
+	free(transforms.local_to_world_normal);
+	free(transforms.world_rotations);
+	free(transforms.changed);
+	free(transforms.order);
+	free(transforms.previous_positions);
+	free(transforms.previous_rotations);
+	free(transforms.previous_scales);
+	free(transforms.previous_generations);
+}
+
+static quaternion nlerp(quaternion a, quaternion b, f32 t) {
+	// Take the shorter arc
+	if (a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w < 0) {
+		b = -b;
+	}
+	quaternion result;
+	result.x = a.x + (b.x - a.x) * t;
+	result.y = a.y + (b.y - a.y) * t;
+	result.z = a.z + (b.z - a.z) * t;
+	result.w = a.w + (b.w - a.w) * t;
+	return normalize(result);
+}
+
+void save_previous_transforms(Scene &scene) {
+	timed_function();
+
+	auto &transforms = scene.transforms;
+	auto slot_count = scene.entity_generations.count;
+	if (transforms.previous_generations.count < slot_count) {
+		auto old_count = transforms.previous_generations.count;
+
+		transforms.previous_positions  .resize(slot_count);
+		transforms.previous_rotations  .resize(slot_count);
+		transforms.previous_scales     .resize(slot_count);
+		transforms.previous_generations.resize(slot_count);
+
+		// Generation 0 is never used, so these won't be interpolated
+		for (umm i = old_count; i < slot_count; ++i) {
+			transforms.previous_generations[i] = 0;
+		}
+	}
+
+	for_each(scene.entities, [&](Entity &entity) {
+		auto slot = entity.handle.index;
+		transforms.previous_positions  [slot] = entity.position;
+		transforms.previous_rotations  [slot] = entity.rotation;
+		transforms.previous_scales     [slot] = entity.scale;
+		transforms.previous_generations[slot] = entity.handle.generation;
+	});
+}
+
+// Matrices are column-major
+static forceinline void multiply(m4 &result, m4 const &a, m4 const &b) {
+	auto A = (f32 const *)&a;
+	auto B = (f32 const *)&b;
+	auto R = (f32 *)&result;
+
+	__m128 a0 = _mm_loadu_ps(A + 0);
+	__m128 a1 = _mm_loadu_ps(A + 4);
+	__m128 a2 = _mm_loadu_ps(A + 8);
+	__m128 a3 = _mm_loadu_ps(A + 12);
+
+	for (u32 column = 0; column < 4; ++column) {
+		auto b = B + column * 4;
+		__m128 r =        _mm_mul_ps(a0, _mm_set1_ps(b[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+		_mm_storeu_ps(R + column * 4, r);
+	}
+}
+
+//
+// Stores `translation * rotation * scale` and `rotation * scale(1 / scale)` of local transforms of four slots.
+// Lanes hold slots, so every matrix element is computed for all four at once, then columns are transposed back.
+//
+static void compose_x4(SceneTransforms &transforms, u32 const (&slots)[4], m4 *const (&matrices)[4], m4 *const (&normal_matrices)[4]) {
+	alignas(16) f32 inputs[10][4];
+	for (u32 lane = 0; lane < 4; ++lane) {
+		auto position = transforms.local_positions[slots[lane]];
+		auto rotation = transforms.local_rotations[slots[lane]];
+		auto scale    = transforms.local_scales   [slots[lane]];
+		inputs[0][lane] = position.x;
+		inputs[1][lane] = position.y;
+		inputs[2][lane] = position.z;
+		inputs[3][lane] = rotation.x;
+		inputs[4][lane] = rotation.y;
+		inputs[5][lane] = rotation.z;
+		inputs[6][lane] = rotation.w;
+		inputs[7][lane] = scale.x;
+		inputs[8][lane] = scale.y;
+		inputs[9][lane] = scale.z;
+	}
+
+	__m128 px = _mm_load_ps(inputs[0]);
+	__m128 py = _mm_load_ps(inputs[1]);
+	__m128 pz = _mm_load_ps(inputs[2]);
+	__m128 qx = _mm_load_ps(inputs[3]);
+	__m128 qy = _mm_load_ps(inputs[4]);
+	__m128 qz = _mm_load_ps(inputs[5]);
+	__m128 qw = _mm_load_ps(inputs[6]);
+	__m128 sx = _mm_load_ps(inputs[7]);
+	__m128 sy = _mm_load_ps(inputs[8]);
+	__m128 sz = _mm_load_ps(inputs[9]);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1);
+
+	// Rotation matrix of a unit quaternion
+	__m128 x2 = _mm_add_ps(qx, qx);
+	__m128 y2 = _mm_add_ps(qy, qy);
+	__m128 z2 = _mm_add_ps(qz, qz);
+	__m128 xx = _mm_mul_ps(qx, x2);
+	__m128 yy = _mm_mul_ps(qy, y2);
+	__m128 zz = _mm_mul_ps(qz, z2);
+	__m128 xy = _mm_mul_ps(qx, y2);
+	__m128 xz = _mm_mul_ps(qx, z2);
+	__m128 yz = _mm_mul_ps(qy, z2);
+	__m128 wx = _mm_mul_ps(qw, x2);
+	__m128 wy = _mm_mul_ps(qw, y2);
+	__m128 wz = _mm_mul_ps(qw, z2);
+
+	// r<row><column>
+	__m128 r00 = _mm_sub_ps(one, _mm_add_ps(yy, zz));
+	__m128 r10 = _mm_add_ps(xy, wz);
+	__m128 r20 = _mm_sub_ps(xz, wy);
+	__m128 r01 = _mm_sub_ps(xy, wz);
+	__m128 r11 = _mm_sub_ps(one, _mm_add_ps(xx, zz));
+	__m128 r21 = _mm_add_ps(yz, wx);
+	__m128 r02 = _mm_add_ps(xz, wy);
+	__m128 r12 = _mm_sub_ps(yz, wx);
+	__m128 r22 = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+
+	__m128 ix = _mm_div_ps(one, sx);
+	__m128 iy = _mm_div_ps(one, sy);
+	__m128 iz = _mm_div_ps(one, sz);
+
+	auto store_column = [&](m4 *const (&targets)[4], u32 column, __m128 e0, __m128 e1, __m128 e2, __m128 e3) {
+		_MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+		_mm_storeu_ps((f32 *)targets[0] + column * 4, e0);
+		_mm_storeu_ps((f32 *)targets[1] + column * 4, e1);
+		_mm_storeu_ps((f32 *)targets[2] + column * 4, e2);
+		_mm_storeu_ps((f32 *)targets[3] + column * 4, e3);
+	};
+
+	store_column(matrices, 0, _mm_mul_ps(r00, sx), _mm_mul_ps(r10, sx), _mm_mul_ps(r20, sx), zero);
+	store_column(matrices, 1, _mm_mul_ps(r01, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r21, sy), zero);
+	store_column(matrices, 2, _mm_mul_ps(r02, sz), _mm_mul_ps(r12, sz), _mm_mul_ps(r22, sz), zero);
+	store_column(matrices, 3, px, py, pz, one);
+
+	store_column(normal_matrices, 0, _mm_mul_ps(r00, ix), _mm_mul_ps(r10, ix), _mm_mul_ps(r20, ix), zero);
+	store_column(normal_matrices, 1, _mm_mul_ps(r01, iy), _mm_mul_ps(r11, iy), _mm_mul_ps(r21, iy), zero);
+	store_column(normal_matrices, 2, _mm_mul_ps(r02, iz), _mm_mul_ps(r12, iz), _mm_mul_ps(r22, iz), zero);
+	store_column(normal_matrices, 3, zero, zero, zero, one);
+}
+
+static u32 get_parent_index(Scene &scene, Entity &entity) {
+	auto parent = scene.get_entity(entity.parent);
+	return parent ? parent->handle.index : SceneTransforms::no_parent;
+}
+
+static void rebuild_order(Scene &scene) {
+	auto &transforms = scene.transforms;
+	scoped_allocator(temporary_allocator);
+
+	u32 slot_count = (u32)scene.entity_generations.count;
+
+	List<u32> depths;
+	depths.resize(slot_count);
+	for (auto &depth : depths) {
+		depth = ~0u;
+	}
+
+	List<u32> alive_slots;
+	for_each(scene.entities, [&](Entity &entity) {
+		alive_slots.add(entity.handle.index);
+	});
+
+	u32 max_depth = 0;
+	List<u32> chain;
+	for (auto slot : alive_slots) {
+		// Walk up until an entity with known depth or a root
+		chain.clear();
+		u32 current = slot;
+		u32 depth = 0;
+		while (1) {
+			if (depths[current] != ~0u) {
+				depth = depths[current] + 1;
+				break;
+			}
+			chain.add(current);
+			auto parent_index = get_parent_index(scene, scene.entities.at(current));
+			if (parent_index == SceneTransforms::no_parent) {
+				depth = 0;
+				break;
+			}
+			current = parent_index;
+		}
+		for (umm i = chain.count; i--;) {
+			depths[chain[i]] = depth++;
+		}
+		max_depth = max(max_depth, depths[slot]);
+	}
+
+	// Counting sort by depth
+	List<u32> offsets;
+	offsets.resize(max_depth + 2);
+	for (auto &offset : offsets) {
+		offset = 0;
+	}
+	for (auto slot : alive_slots) {
+		offsets[depths[slot] + 1] += 1;
+	}
+	for (u32 i = 1; i < offsets.count; ++i) {
+		offsets[i] += offsets[i - 1];
+	}
+
+	transforms.order.resize(alive_slots.count);
+	for (auto slot : alive_slots) {
+		transforms.order[offsets[depths[slot]]++] = slot;
+	}
+
+	// Slots could have been reused by different entities, recompute everything
+	for (auto &parent_index : transforms.parent_indices) {
+		parent_index = SceneTransforms::unknown_parent;
+	}
+
+	transforms.order_is_dirty = false;
+}
+
+void update_transforms(Scene &scene, f32 interpolation_alpha) {
+	timed_function();
+
+	auto &transforms = scene.transforms;
+
+	u32 slot_count = (u32)scene.entity_generations.count;
+	if (transforms.parent_indices.count < slot_count) {
+		auto old_count = transforms.parent_indices.count;
+
+		transforms.local_positions      .resize(slot_count);
+		transforms.local_rotations      .resize(slot_count);
+		transforms.local_scales         .resize(slot_count);
+		transforms.parent_indices       .resize(slot_count);
+		transforms.local_to_world       .resize(slot_count);
+		transforms.local_to_world_normal.resize(slot_count);
+		transforms.world_rotations      .resize(slot_count);
+		transforms.changed              .resize(slot_count);
+
+		for (umm i = old_count; i < slot_count; ++i) {
+			transforms.parent_indices[i] = SceneTransforms::unknown_parent;
+		}
+		transforms.order_is_dirty = true;
+	}
+
+	if (transforms.order_is_dirty) {
+		rebuild_order(scene);
+	}
+
+	//
+	// Detect changed local transforms
+	//
+	bool interpolate = interpolation_alpha < 1;
+	transforms.interpolated = interpolate;
+
+	for (auto slot : transforms.order) {
+		auto &entity = scene.entities.at(slot);
+		auto parent_index = get_parent_index(scene, entity);
+
+		auto position = entity.position;
+		auto rotation = entity.rotation;
+		auto scale    = entity.scale;
+		if (interpolate && slot < transforms.previous_generations.count && transforms.previous_generations[slot] == entity.handle.generation) {
+			position = lerp(transforms.previous_positions[slot], position, interpolation_alpha);
+			rotation = nlerp(transforms.previous_rotations[slot], rotation, interpolation_alpha);
+			scale    = lerp(transforms.previous_scales[slot], scale, interpolation_alpha);
+		}
+
+		bool changed =
+			parent_index != transforms.parent_indices[slot] ||
+			memcmp(&position, &transforms.local_positions[slot], sizeof(v3f)) != 0 ||
+			memcmp(&rotation, &transforms.local_rotations[slot], sizeof(quaternion)) != 0 ||
+			memcmp(&scale,    &transforms.local_scales[slot],    sizeof(v3f)) != 0;
+
+		transforms.changed[slot] = changed;
+		if (changed) {
+			transforms.parent_indices [slot] = parent_index;
+			transforms.local_positions[slot] = position;
+			transforms.local_rotations[slot] = rotation;
+			transforms.local_scales   [slot] = scale;
+		}
+	}
+
+	//
+	// Propagate changes down the hierarchy. Parents come first, so their flag is final when children read it.
+	//
+	List<u32> dirty_slots;
+	dirty_slots.allocator = temporary_allocator;
+	for (auto slot : transforms.order) {
+		auto parent_index = transforms.parent_indices[slot];
+		if (parent_index != SceneTransforms::no_parent && transforms.changed[parent_index]) {
+			transforms.changed[slot] = true;
+		}
+		if (transforms.changed[slot]) {
+			dirty_slots.add(slot);
+		}
+	}
+
+	//
+	// Local matrices, four entities at a time. Roots' are their world matrices, children's are combined with parents below.
+	//
+	List<m4> local_to_parent;
+	List<m4> local_to_parent_normal;
+	local_to_parent.allocator = temporary_allocator;
+	local_to_parent_normal.allocator = temporary_allocator;
+	local_to_parent.resize(dirty_slots.count);
+	local_to_parent_normal.resize(dirty_slots.count);
+
+	for (umm first = 0; first < dirty_slots.count; first += 4) {
+		u32 slots[4];
+		m4 *matrices[4];
+		m4 *normal_matrices[4];
+		for (u32 lane = 0; lane < 4; ++lane) {
+			// Last batch repeats its last entity
+			auto index = min(first + lane, dirty_slots.count - 1);
+			auto slot = dirty_slots[index];
+			slots[lane] = slot;
+			if (transforms.parent_indices[slot] == SceneTransforms::no_parent) {
+				matrices       [lane] = &transforms.local_to_world       [slot];
+				normal_matrices[lane] = &transforms.local_to_world_normal[slot];
+			} else {
+				matrices       [lane] = &local_to_parent       [index];
+				normal_matrices[lane] = &local_to_parent_normal[index];
+			}
+		}
+		compose_x4(transforms, slots, matrices, normal_matrices);
+	}
+
+	//
+	// World matrices of children. Parents come first, so their result is ready when children need it.
+	//
+	for (umm index = 0; index < dirty_slots.count; ++index) {
+		auto slot = dirty_slots[index];
+		auto parent_index = transforms.parent_indices[slot];
+		if (parent_index == SceneTransforms::no_parent) {
+			transforms.world_rotations[slot] = transforms.local_rotations[slot];
+		} else {
+			multiply(transforms.local_to_world       [slot], transforms.local_to_world       [parent_index], local_to_parent       [index]);
+			multiply(transforms.local_to_world_normal[slot], transforms.local_to_world_normal[parent_index], local_to_parent_normal[index]);
+			transforms.world_rotations[slot] = transforms.world_rotations[parent_index] * transforms.local_rotations[slot];
+		}
+	}
+}
+
+Entity *get_parent(Entity &entity) {
+	return entity.scene->get_entity(entity.parent);
+}
+
+bool set_parent(Entity &entity, Entity *parent) {
+	if (parent) {
+		assert(parent->scene == entity.scene, "parent must be in the same scene");
+		for (auto ancestor = parent; ancestor; ancestor = get_parent(*ancestor)) {
+			if (ancestor == &entity) {
+				return false;
+			}
+		}
+		entity.parent = parent->handle;
+	} else {
+		entity.parent = {};
+	}
+	entity.scene->transforms.order_is_dirty = true;
+	return true;
+}
+
+m4 const &get_local_to_world(Entity &entity) {
+	return entity.scene->transforms.local_to_world[entity.handle.index];
+}
+
+m4 const &get_local_to_world_normal(Entity &entity) {
+	return entity.scene->transforms.local_to_world_normal[entity.handle.index];
+}
+
+static bool is_cached(Entity &entity) {
+	return entity.handle.index < entity.scene->transforms.parent_indices.count;
+}
+
+v3f get_world_position(Entity &entity) {
+	if (!get_parent(entity)) {
+		if (entity.scene->transforms.interpolated && is_cached(entity))
+			return entity.scene->transforms.local_positions[entity.handle.index];
+		return entity.position;
+	}
+
+	return (get_local_to_world(entity) * v4f{0, 0, 0, 1}).xyz;
+}
+
+quaternion get_world_rotation(Entity &entity) {
+	if (!get_parent(entity)) {
+		if (entity.scene->transforms.interpolated && is_cached(entity))
+			return entity.scene->transforms.local_rotations[entity.handle.index];
+		return entity.rotation;
+	}
+
+	return entity.scene->transforms.world_rotations[entity.handle.index];
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <t3d/common.h>
+#include <tl/quaternion.h>
+
+struct Entity;
+struct Scene;
+
+//
+// Cached world transforms of scene entities.
+// Every array is indexed by entity slot index (`EntityHandle::index`).
+// `update_transforms` recomputes only entities whose local transform or parent changed, and their descendants.
+//
+struct SceneTransforms {
+	// Local transform as of last update. Used to detect changes, because scripts write to entity fields directly.
+	List<v3f> local_positions;
+	List<quaternion> local_rotations;
+	List<v3f> local_scales;
+	List<u32> parent_indices; // `no_parent` for roots
+
+	List<m4> local_to_world;
+	List<m4> local_to_world_normal;
+	List<quaternion> world_rotations;
+
+	// Non-zero for entities whose world transform changed during last update
+	List<u8> changed;
+
+	// Slots of alive entities, parents before children
+	List<u32> order;
+	bool order_is_dirty = true;
+
+	// Local transforms before last simulation step, for interpolation. Generation tells if the slot was reused since.
+	List<v3f> previous_positions;
+	List<quaternion> previous_rotations;
+	List<v3f> previous_scales;
+	List<u32> previous_generations;
+
+	// Last update used interpolated local transforms, so they are different from entity's fields
+	bool interpolated = false;
+
+	static constexpr u32 no_parent = ~0u;
+	static constexpr u32 unknown_parent = ~1u;
+
+	SceneTransforms() {
+		local_positions      .allocator = default_allocator;
+		local_rotations      .allocator = default_allocator;
+		local_scales         .allocator = default_allocator;
+		parent_indices       .allocator = default_allocator;
+		local_to_world       .allocator = default_allocator;
+		local_to_world_normal.allocator = default_allocator;
+		world_rotations      .allocator = default_allocator;
+		changed              .allocator = default_allocator;
+		order                .allocator = default_allocator;
+		previous_positions   .allocator = default_allocator;
+		previous_rotations   .allocator = default_allocator;
+		previous_scales      .allocator = default_allocator;
+		previous_generations .allocator = default_allocator;
+	}
+};
+
+void free(SceneTransforms &transforms);
+
+// Called once per frame, after scripts have moved things and before anything is rendered.
+// With `interpolation_alpha` < 1 local transforms are blended from the ones saved by `save_previous_transforms`.
+void update_transforms(Scene &scene, f32 interpolation_alpha = 1);
+
+// Called before every fixed simulation step
+void save_previous_transforms(Scene &scene);
+
+Entity *get_parent(Entity &entity);
+
+// Returns false if that would create a cycle. Local transform is kept as is.
+bool set_parent(Entity &entity, Entity *parent);
+
+m4 const &get_local_to_world(Entity &entity);
+m4 const &get_local_to_world_normal(Entity &entity);
+
+// These don't need the cache to be up to date for root entities, unless it is interpolated
+v3f get_world_position(Entity &entity);
+quaternion get_world_rotation(Entity &entity);
@@ -0,0 +1,85 @@
+#include "uniform_ring.h"
+#include <t3d/app.h>
+
+void init(UniformRing &ring, umm value_size, u32 slot) {
+	assert(app->tg->api == tg::GraphicsApi_opengl, "uniform rings bind buffer ranges with GL directly");
+
+	GLint offset_alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+	auto alignment = (u32)max(offset_alignment, 1);
+
+	ring.value_size = (u32)value_size;
+	ring.value_stride = (ring.value_size + alignment - 1) / alignment * alignment;
+	ring.slot = slot;
+	assert(ring.value_stride <= UniformRing::chunk_size);
+}
+
+void free(UniformRing &ring) {
+	for (auto &frame : ring.frames) {
+		if (frame.fence) {
+			glDeleteSync(frame.fence);
+			frame.fence = 0;
+		}
+		for (auto chunk : frame.chunks) {
+			glDeleteBuffers(1, &chunk);
+		}
+		free(frame.chunks);
+	}
+	for (auto chunk : ring.free_chunks) {
+		glDeleteBuffers(1, &chunk);
+	}
+	free(ring.free_chunks);
+	ring.chunk = 0;
+	ring.offset = 0;
+}
+
+void begin_frame(UniformRing &ring) {
+	// Chunks written during the frame that just ended are in use until the GPU passes this
+	auto &previous = ring.frames[ring.frame_index];
+	if (previous.chunks.count) {
+		previous.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	ring.frame_index = (ring.frame_index + 1) % UniformRing::frames_in_flight;
+
+	auto &frame = ring.frames[ring.frame_index];
+	if (frame.fence) {
+		while (glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+		}
+		glDeleteSync(frame.fence);
+		frame.fence = 0;
+	}
+	for (auto chunk : frame.chunks) {
+		ring.free_chunks.add(chunk);
+	}
+	frame.chunks.clear();
+
+	ring.chunk = 0;
+	ring.offset = 0;
+}
+
+void push(UniformRing &ring, void const *value) {
+	if (!ring.chunk || ring.offset + ring.value_stride > UniformRing::chunk_size) {
+		if (ring.free_chunks.count) {
+			ring.chunk = ring.free_chunks.pop();
+			glBindBuffer(GL_UNIFORM_BUFFER, ring.chunk);
+		} else {
+			glGenBuffers(1, &ring.chunk);
+			glBindBuffer(GL_UNIFORM_BUFFER, ring.chunk);
+			glBufferData(GL_UNIFORM_BUFFER, UniformRing::chunk_size, 0, GL_DYNAMIC_DRAW);
+		}
+		ring.frames[ring.frame_index].chunks.add(ring.chunk);
+		ring.offset = 0;
+	} else {
+		glBindBuffer(GL_UNIFORM_BUFFER, ring.chunk);
+	}
+
+	glBufferSubData(GL_UNIFORM_BUFFER, ring.offset, ring.value_size, value);
+	glBindBufferRange(GL_UNIFORM_BUFFER, ring.slot, ring.chunk, ring.offset, ring.value_size);
+	ring.offset += ring.value_stride;
+
+	// Slot no longer has what the tracker thinks, so the next `set_shader_constants` for it must not be skipped
+	app->render_state.constants[ring.slot] = 0;
+
+	app->uploaded_uniform_bytes += ring.value_size;
+}
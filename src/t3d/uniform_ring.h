@@ -0,0 +1,61 @@
+#pragma once
+#include <t3d/common.h>
+#include <tl/opengl.h>
+
+//
+// Constant buffers for values that change many times per frame, like entity and light constants.
+//
+// Updating one buffer before every draw makes the driver either wait for previous draws or rename the buffer.
+// Instead values are written one after another into big chunks, and the range of every value is bound to `slot`.
+// A fence is put after every frame. Chunks of a frame are reused `frames_in_flight` frames later, after its fence
+// was passed, so writes never touch memory the GPU may still read.
+// Chunks are created on demand and kept, so after a few frames nothing is created anymore.
+//
+// tg can only bind whole constant buffers, so rings talk to GL directly.
+//
+struct UniformRing {
+	static constexpr u32 frames_in_flight = 3;
+	static constexpr u32 chunk_size = 1024 * 1024;
+
+	struct Frame {
+		List<GLuint> chunks;
+		GLsync fence = 0;
+	};
+
+	Frame frames[frames_in_flight];
+	u32 frame_index = 0;
+
+	// Chunks that the GPU is done with
+	List<GLuint> free_chunks;
+
+	GLuint chunk = 0; // Last chunk of the current frame, 0 if there is none yet
+	u32 offset = 0;   // Into `chunk`
+
+	u32 value_size = 0;
+	u32 value_stride = 0; // `value_size` rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	u32 slot = 0;
+
+	UniformRing() {
+		for (auto &frame : frames) {
+			frame.chunks.allocator = default_allocator;
+		}
+		free_chunks.allocator = default_allocator;
+	}
+};
+
+void init(UniformRing &ring, umm value_size, u32 slot);
+
+// Frees all chunks. Call while the graphics context is alive.
+void free(UniformRing &ring);
+
+// Call once per frame before anything is pushed. Waits for the GPU if it is `frames_in_flight` frames behind.
+void begin_frame(UniformRing &ring);
+
+// Writes `value` of `ring.value_size` bytes after the previous one and binds its range to `ring.slot`
+void push(UniformRing &ring, void const *value);
+
+template <class T>
+void push(UniformRing &ring, T const &value) {
+	assert(sizeof(T) == ring.value_size);
+	push(ring, (void const *)&value);
+}
@@ -0,0 +1,241 @@
+#include "test.h"
+#include <t3d/component.h>
+
+//
+// Iteration over `ComponentStorage` compared to a plain array of the same values.
+// Every value is moved by its velocity, like a minimal `update`.
+// Iteration and `add` are also compared to the reference versions below.
+//
+
+struct BenchValue {
+	v3f position;
+	v3f velocity;
+};
+
+//
+// How `ComponentStorage` used to do it: `for_each` tested every bit of every mask and `add` scanned all blocks
+// for free space. Bugs that made the old `for_each` skip values are fixed, so both visit the same values.
+// Kept to see what the current versions gain.
+//
+
+template <class Fn>
+static void reference_for_each(ComponentStorage &storage, Fn &&fn) {
+	for (auto block : storage.blocks) {
+		for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+			auto mask = block->masks[mask_index];
+			if (mask == 0)
+				continue;
+			for (u32 bit_index = 0; bit_index != ComponentStorage::bits_in_mask; bit_index += 1) {
+				if (mask & ((ComponentStorage::Mask)1 << bit_index)) {
+					fn((u8 *)block->values + storage.bytes_per_entry * (mask_index * ComponentStorage::bits_in_mask + bit_index));
+				}
+			}
+		}
+	}
+}
+
+// Doesn't maintain `unfull_block_indices`, don't mix with `ComponentStorage::add`
+static void *reference_add(ComponentStorage &storage) {
+	for (auto block : storage.blocks) {
+		if (block->unfull_mask_count == 0)
+			continue;
+
+		for (u32 mask_index = 0; mask_index < ComponentStorage::masks_per_block; mask_index += 1) {
+			auto &mask = block->masks[mask_index];
+			if (mask == ~0)
+				continue;
+
+			auto bit_index = find_lowest_zero_bit(mask);
+			auto value_index = (mask_index * ComponentStorage::bits_in_mask) + bit_index;
+
+			mask |= (ComponentStorage::Mask)1 << bit_index;
+			block->value_count += 1;
+			block->generations[value_index] = storage.next_generation++;
+			if (mask == ~0)
+				block->unfull_mask_count -= 1;
+
+			return (u8 *)block->values + value_index * storage.bytes_per_entry;
+		}
+	}
+
+	auto block = storage.allocator.allocate<ComponentStorage::Block>();
+	block->values = storage.allocator.allocate_uninitialized(storage.bytes_per_entry * ComponentStorage::values_per_block, storage.entry_alignment);
+	block->masks[0] = 1;
+	block->value_count = 1;
+	block->generations[0] = storage.next_generation++;
+	storage.blocks.add(block);
+	return block->values;
+}
+
+static ComponentStorage create_empty_bench_storage() {
+	ComponentStorage storage;
+	storage.bytes_per_entry = sizeof(BenchValue);
+	storage.entry_alignment = alignof(BenchValue);
+	return storage;
+}
+
+static ComponentStorage create_bench_storage(u32 count) {
+	auto storage = create_empty_bench_storage();
+	for (u32 i = 0; i < count; ++i) {
+		auto added = storage.add();
+		*(BenchValue *)added.pointer = {
+			.position = {(f32)i, 0, 0},
+			.velocity = {0, 1, 0},
+		};
+	}
+	return storage;
+}
+
+// Runs `iterate` until about ten million values were touched, returns nanoseconds per value
+template <class Iterate>
+static f64 measure(u32 value_count, Iterate &&iterate) {
+	auto repeat_count = max(1u, 10'000'000u / max(value_count, 1u));
+
+	auto timer = create_precise_timer();
+	for (u32 i = 0; i < repeat_count; ++i) {
+		iterate();
+	}
+	return get_time(timer) * 1e9 / ((f64)repeat_count * value_count);
+}
+
+// Fills empty storages with `value_count` values using `add` until about a million values were added,
+// returns nanoseconds per value. Freeing is not timed.
+template <class Add>
+static f64 measure_insert(u32 value_count, Add &&add) {
+	auto repeat_count = max(1u, 1'000'000u / max(value_count, 1u));
+
+	f64 time = 0;
+	for (u32 i = 0; i < repeat_count; ++i) {
+		auto storage = create_empty_bench_storage();
+		defer { free(storage); };
+
+		auto timer = create_precise_timer();
+		for (u32 j = 0; j < value_count; ++j) {
+			*(BenchValue *)add(storage) = {};
+		}
+		time += get_time(timer);
+	}
+	return time * 1e9 / ((f64)repeat_count * value_count);
+}
+
+void bench_component_storage() {
+	static constexpr f32 dt = 1.0f / 60;
+
+	u32 counts[] = {1'000, 100'000, 1'000'000};
+	for (auto count : counts) {
+		auto storage = create_bench_storage(count);
+		defer { free(storage); };
+
+		List<BenchValue> array;
+		array.allocator = default_allocator;
+		defer { free(array); };
+		storage.for_each([&](void *value) {
+			array.add(*(BenchValue *)value);
+		});
+
+		auto move_value = [&](void *pointer) {
+			auto &value = *(BenchValue *)pointer;
+			value.position += value.velocity * dt;
+		};
+		auto iterate_storage = [&] { storage.for_each(move_value); };
+		auto iterate_storage_reference = [&] { reference_for_each(storage, move_value); };
+
+		auto insert_time = measure_insert(count, [](ComponentStorage &storage) { return storage.add().pointer; });
+		auto insert_reference_time = measure_insert(count, reference_add);
+
+		auto array_time = measure(count, [&] {
+			for (auto &value : array) {
+				value.position += value.velocity * dt;
+			}
+		});
+		auto dense_time = measure(count, iterate_storage);
+		auto dense_reference_time = measure(count, iterate_storage_reference);
+
+		// Every other value removed, like after a lot of entities were destroyed
+		for (u32 i = 0; i < count; i += 2) {
+			storage.remove_at(i);
+		}
+		auto sparse_time = measure(count / 2, iterate_storage);
+		auto sparse_reference_time = measure(count / 2, iterate_storage_reference);
+
+		with(temporary_allocator, storage.compact());
+		auto compacted_time = measure(count / 2, iterate_storage);
+
+		u32 visited_count = 0;
+		storage.for_each([&](void *) { visited_count += 1; });
+		check(visited_count == count / 2);
+
+		u32 reference_visited_count = 0;
+		reference_for_each(storage, [&](void *) { reference_visited_count += 1; });
+		check(reference_visited_count == count / 2);
+
+		print("{} values, ns per value: array {}, storage {}, half removed {}, compacted {}\n",
+			count,
+			FormatFloat{.value = array_time, .precision = 2},
+			FormatFloat{.value = dense_time, .precision = 2},
+			FormatFloat{.value = sparse_time, .precision = 2},
+			FormatFloat{.value = compacted_time, .precision = 2});
+		print("    reference: storage {}, half removed {}\n",
+			FormatFloat{.value = dense_reference_time, .precision = 2},
+			FormatFloat{.value = sparse_reference_time, .precision = 2});
+		print("    insert {}, reference insert {}\n",
+			FormatFloat{.value = insert_time, .precision = 2},
+			FormatFloat{.value = insert_reference_time, .precision = 2});
+	}
+}
+
+//
+// Per-value `update` compared to `update_batch` on runs of values, called through function pointers the same way
+// `update_component_block` calls them.
+//
+
+static void update_bench_value(void *pointer) {
+	auto &value = *(BenchValue *)pointer;
+	value.position += value.velocity * (1.0f / 60);
+}
+
+static void update_bench_values(void *pointer, u32 count) {
+	auto values = (BenchValue *)pointer;
+	for (u32 i = 0; i < count; ++i) {
+		values[i].position += values[i].velocity * (1.0f / 60);
+	}
+}
+
+void bench_component_update() {
+	ComponentUpdate update = update_bench_value;
+	ComponentUpdateBatch update_batch = update_bench_values;
+
+	u32 counts[] = {1'000, 100'000, 1'000'000};
+	for (auto count : counts) {
+		auto storage = create_bench_storage(count);
+		defer { free(storage); };
+
+		auto run = [&](u32 value_count) {
+			auto per_value_time = measure(value_count, [&] {
+				for (auto block : storage.blocks) {
+					storage.for_each_in_block(block, update, true);
+				}
+			});
+			auto batched_time = measure(value_count, [&] {
+				for (auto block : storage.blocks) {
+					storage.for_each_run_in_block(block, update_batch, true);
+				}
+			});
+			print("{} values, ns per value: update {}, update_batch {}\n",
+				value_count,
+				FormatFloat{.value = per_value_time, .precision = 2},
+				FormatFloat{.value = batched_time, .precision = 2});
+		};
+
+		run(count);
+
+		// Every fourth value removed, so runs are three values long
+		u32 removed_count = 0;
+		for (u32 i = 0; i < count; i += 4) {
+			storage.remove_at(i);
+			removed_count += 1;
+		}
+		print("with every fourth removed:\n");
+		run(count - removed_count);
+	}
+}
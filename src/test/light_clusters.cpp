@@ -0,0 +1,161 @@
+#include "test.h"
+#include <t3d/light_clusters.h>
+#include <t3d/jobs.h>
+
+//
+// Camera is at the origin looking at -z with 90 degree field of view.
+//
+
+static LightClusterView get_view() {
+	return {
+		.world_to_view = m4::identity(),
+		.projection_scale_x = 1,
+		.projection_scale_y = 1,
+		.near_plane = 0.1f,
+		.far_plane = 100,
+	};
+}
+
+// Same as `get_cluster_index` in shaders
+static u32 get_cluster_index(LightClusterConstants const &constants, v3f view_position) {
+	auto depth = -view_position.z;
+	auto x = clamp((s32)((view_position.x / depth * 0.5f + 0.5f) * CLUSTER_COUNT_X), 0, CLUSTER_COUNT_X - 1);
+	auto y = clamp((s32)((view_position.y / depth * 0.5f + 0.5f) * CLUSTER_COUNT_Y), 0, CLUSTER_COUNT_Y - 1);
+	auto z = clamp((s32)(logf(max(depth, constants.near_plane) / constants.near_plane) * constants.log_depth_scale), 0, CLUSTER_COUNT_Z - 1);
+	return (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+}
+
+static bool cluster_has_light(LightClusterConstants const &constants, u32 cluster, u32 light_index) {
+	auto range = constants.cluster_ranges[cluster];
+	auto offset = range & 0xffff;
+	auto count = range >> 16;
+	for (u32 i = 0; i < count; ++i) {
+		if (constants.light_indices[offset + i] == light_index)
+			return true;
+	}
+	return false;
+}
+
+static u32 get_light_index_count(LightClusterConstants const &constants) {
+	u32 total = 0;
+	for (auto range : constants.cluster_ranges) {
+		total += range >> 16;
+	}
+	return total;
+}
+
+void test_light_clusters() {
+	JobSystem jobs;
+	init(jobs, 4);
+	defer { free(jobs); };
+
+	LightClusterBinner binner;
+	defer { free(binner); };
+
+	// Too big for the stack
+	static LightClusterConstants constants;
+
+	{
+		ClusterLight lights[] = {
+			{.position = {0, 0, -10}, .range = 1, .index = 3},
+			{.position = {0, 0, 10}, .range = 1, .index = 4}, // Behind the camera
+			{.position = {0, 0, -0.05f}, .range = 0.5f, .index = 5}, // Crossing the near plane
+		};
+		check(bin_lights(constants, binner, array_as_span(lights), get_view(), jobs));
+
+		// Cluster of the light's center and clusters of points on its sphere
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, 0, -10}), 3));
+		check(cluster_has_light(constants, get_cluster_index(constants, {0.9f, 0, -10}), 3));
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, -0.9f, -10}), 3));
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, 0, -10.9f}), 3));
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, 0, -9.1f}), 3));
+
+		// Clusters away from the sphere
+		check(!cluster_has_light(constants, get_cluster_index(constants, {-8, 0, -10}), 3));
+		check(!cluster_has_light(constants, get_cluster_index(constants, {0, 0, -50}), 3));
+		check(!cluster_has_light(constants, get_cluster_index(constants, {0, 0, -2}), 3));
+
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, 0, -0.1f}), 5));
+
+		for (u32 cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+			check(!cluster_has_light(constants, cluster, 4));
+		}
+	}
+
+	// Moving the camera moves the clusters
+	{
+		auto view = get_view();
+		view.world_to_view = m4::translation({-100, 0, 0});
+
+		ClusterLight lights[] = {
+			{.position = {100, 0, -10}, .range = 1, .index = 7},
+		};
+		check(bin_lights(constants, binner, array_as_span(lights), view, jobs));
+		check(cluster_has_light(constants, get_cluster_index(constants, {0, 0, -10}), 7));
+	}
+
+	// Light that covers everything goes to every cluster
+	{
+		ClusterLight lights[] = {
+			{.position = {0, 0, -50}, .range = 1000, .index = 1},
+		};
+		check(bin_lights(constants, binner, array_as_span(lights), get_view(), jobs));
+		check(get_light_index_count(constants) == CLUSTER_COUNT);
+	}
+
+	// Indices that don't fit are dropped and reported
+	{
+		List<ClusterLight> lights;
+		lights.allocator = temporary_allocator;
+		for (u32 i = 0; i < MAX_CLUSTER_LIGHTS; ++i) {
+			lights.add({.position = {0, 0, -50}, .range = 1000, .index = i});
+		}
+		check(!bin_lights(constants, binner, lights, get_view(), jobs));
+		check(get_light_index_count(constants) == MAX_CLUSTER_LIGHT_INDICES);
+	}
+}
+
+void bench_light_clusters() {
+	static constexpr u32 iteration_count = 100;
+
+	JobSystem jobs;
+	init(jobs);
+	defer { free(jobs); };
+
+	LightClusterBinner binner;
+	defer { free(binner); };
+
+	static LightClusterConstants constants;
+
+	u64 seed = 0x9e3779b97f4a7c15;
+	auto random = [&](f32 from, f32 to) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		return from + (to - from) * ((seed >> 40) / (f32)(1 << 24));
+	};
+
+	for (u32 light_count : {100, 1000, 4000}) {
+		// Indices are stored in a byte, so they repeat past `MAX_CLUSTER_LIGHTS`. Binning cost doesn't depend on them.
+		List<ClusterLight> lights;
+		lights.allocator = temporary_allocator;
+		for (u32 i = 0; i < light_count; ++i) {
+			lights.add({
+				.position = {random(-60, 60), random(-10, 10), random(-100, 0)},
+				.range = random(1, 5),
+				.index = i % MAX_CLUSTER_LIGHTS,
+			});
+		}
+
+		bool all_fit = true;
+		auto timer = create_precise_timer();
+		for (u32 i = 0; i < iteration_count; ++i) {
+			all_fit &= bin_lights(constants, binner, lights, get_view(), jobs);
+		}
+		auto time = get_time(timer) / iteration_count;
+
+		print("{} lights: {} indices{}. Binned in {} ms\n",
+			light_count, get_light_index_count(constants), all_fit ? u8""s : u8" (some dropped)"s,
+			FormatFloat{.value = time * 1000, .precision = 3});
+	}
+}
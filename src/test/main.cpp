@@ -0,0 +1,82 @@
+#include "test.h"
+#define TL_IMPL
+#include <tl/common.h>
+#include <tl/console.h>
+#include <tl/main.h>
+#include <tl/mesh.h>
+#include <tl/file.h>
+
+// Tested code that uses these has to set them up itself
+AppData *app;
+EditorData *editor;
+
+u32 failed_check_count;
+
+void initialize_thread() {
+	init_allocator();
+	current_printer = console_printer;
+}
+
+void t3d_assert(char const *cause, char const *expression, char const *file, int line) {
+	print(Print_error, "{}: '{}' in {}:{}\n", cause, expression, file, line);
+	failed_check_count += 1;
+	debug_break();
+}
+
+struct NamedFunction {
+	Span<utf8> name;
+	void (*function)();
+};
+
+static NamedFunction tests[] = {
+	{u8"occlusion"s, test_occlusion},
+	{u8"light_clusters"s, test_light_clusters},
+	{u8"mesh_optimize"s, test_mesh_optimize},
+};
+
+static NamedFunction benchmarks[] = {
+	{u8"occlusion"s, bench_occlusion},
+	{u8"light_clusters"s, bench_light_clusters},
+	{u8"component_storage"s, bench_component_storage},
+	{u8"component_update"s, bench_component_update},
+};
+
+s32 tl_main(Span<Span<utf8>> arguments) {
+	current_printer = console_printer;
+
+	// `test optimize <file.glb>...` prints vertex cache stats of each mesh before and after optimization
+	if (arguments.count > 1 && arguments[1] == u8"optimize"s) {
+		bool ok = true;
+		for (umm i = 2; i < arguments.count; ++i) {
+			ok &= report_mesh_optimization(arguments[i]);
+		}
+		return ok ? 0 : 1;
+	}
+
+	bool run_benchmarks = false;
+	for (umm i = 1; i < arguments.count; ++i) {
+		auto argument = arguments[i];
+		if (argument == u8"bench"s) {
+			run_benchmarks = true;
+		}
+	}
+
+	for (auto test : tests) {
+		print("test {}\n", test.name);
+		test.function();
+	}
+
+	if (run_benchmarks) {
+		for (auto benchmark : benchmarks) {
+			print("bench {}\n", benchmark.name);
+			benchmark.function();
+		}
+	}
+
+	if (failed_check_count) {
+		print(Print_error, "{} checks failed\n", failed_check_count);
+		return 1;
+	}
+	print("all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include "test.h"
+#include <t3d/mesh_optimize.h>
+#include <tl/mesh.h>
+#include <tl/file.h>
+
+//
+// Grid of `size` x `size` quads with a vertex per triangle corner and triangles in random order,
+// the worst case for every pass.
+//
+struct GridVertex {
+	v3f position;
+	v2f uv;
+};
+
+static void create_shuffled_grid(List<GridVertex> &vertices, List<u32> &indices, u32 size) {
+	u64 seed = 0x2545F4914F6CDD1D;
+	auto next_random = [&] {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		return seed;
+	};
+
+	List<u32> quads;
+	quads.allocator = temporary_allocator;
+	for (u32 i = 0; i < size * size; ++i) {
+		quads.add(i);
+	}
+	for (umm i = quads.count - 1; i > 0; --i) {
+		auto j = next_random() % (i + 1);
+		auto temp = quads[i];
+		quads[i] = quads[j];
+		quads[j] = temp;
+	}
+
+	auto add_vertex = [&](u32 x, u32 y) {
+		indices.add((u32)vertices.count);
+		vertices.add({
+			.position = {(f32)x, 0, (f32)y},
+			.uv = {(f32)x / size, (f32)y / size},
+		});
+	};
+	for (auto quad : quads) {
+		auto x = quad % size;
+		auto y = quad / size;
+		add_vertex(x, y); add_vertex(x, y + 1); add_vertex(x + 1, y + 1);
+		add_vertex(x, y); add_vertex(x + 1, y + 1); add_vertex(x + 1, y);
+	}
+}
+
+// Sum of areas and of area weighted centroids, same for any order of the same triangles
+static v4f get_surface_moments(List<GridVertex> &vertices, Span<u32> indices) {
+	v4f result = {};
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		auto p0 = vertices[indices[i + 0]].position;
+		auto p1 = vertices[indices[i + 1]].position;
+		auto p2 = vertices[indices[i + 2]].position;
+		auto area = length(cross(p1 - p0, p2 - p0)) / 2;
+		result += V4f((p0 + p1 + p2) / 3 * area, area);
+	}
+	return result;
+}
+
+void test_mesh_optimize() {
+	static constexpr u32 size = 32;
+
+	List<GridVertex> vertices;
+	vertices.allocator = temporary_allocator;
+	List<u32> indices;
+	indices.allocator = temporary_allocator;
+	create_shuffled_grid(vertices, indices, size);
+
+	auto moments_before = get_surface_moments(vertices, indices);
+
+	auto report = optimize_mesh(vertices, indices);
+
+	// Every corner had its own vertex
+	check(report.before.acmr == 3);
+
+	// Best possible for a grid is a bit above 0.5
+	check(report.after.acmr < 1);
+	check(report.after.atvr < report.before.atvr);
+
+	// Identical vertices are merged
+	check(report.vertex_count_after == (size + 1) * (size + 1));
+	for (auto index : indices) {
+		check(index < vertices.count);
+	}
+
+	// Same triangles, facing the same way
+	auto moments_after = get_surface_moments(vertices, indices);
+	check(fabsf(moments_after.w - moments_before.w) < 0.01f);
+	check(length(moments_after.xyz - moments_before.xyz) < 1.0f);
+	for (umm i = 0; i + 2 < indices.count; i += 3) {
+		auto p0 = vertices[indices[i + 0]].position;
+		auto p1 = vertices[indices[i + 1]].position;
+		auto p2 = vertices[indices[i + 2]].position;
+		check(cross(p1 - p0, p2 - p0).y > 0);
+	}
+
+	print("grid {}x{}: {}\n", size, size, report);
+}
+
+// Prints what `Assets::create_mesh` would do to every mesh in a .glb file
+bool report_mesh_optimization(Span<utf8> path) {
+	auto data = with(temporary_allocator, read_entire_file(to_pathchars(path, true)));
+	if (!data.data) {
+		print(Print_error, "Could not read '{}'\n", path);
+		return false;
+	}
+
+	auto scene = parse_glb_from_memory(data);
+	defer { free(scene); };
+
+	print("{}: {} meshes\n", path, scene.meshes.count);
+	for (umm i = 0; i < scene.meshes.count; ++i) {
+		auto &mesh = scene.meshes[i];
+		auto vertices = with(temporary_allocator, copy(mesh.vertices));
+		auto indices = with(temporary_allocator, copy(mesh.indices));
+		auto report = optimize_mesh(vertices, indices);
+		print("\tmesh {}: {} triangles, {}\n", i, indices.count / 3, report);
+	}
+	return true;
+}
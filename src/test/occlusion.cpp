@@ -0,0 +1,114 @@
+#include "test.h"
+#include <t3d/occlusion.h>
+#include <t3d/jobs.h>
+
+//
+// Camera is at the origin looking at -z. Occluder is a 4x4 quad facing the camera at z = -5.
+//
+
+static v3f quad_positions[] = {
+	{-2, -2, 0},
+	{ 2, -2, 0},
+	{ 2,  2, 0},
+	{-2,  2, 0},
+};
+static u32 quad_indices[] = {0, 1, 2, 0, 2, 3};
+
+static m4 get_world_to_clip() {
+	return m4::perspective_right_handed(2, pi / 2, 0.1f, 100);
+}
+
+void test_occlusion() {
+	JobSystem jobs;
+	init(jobs, 4);
+	defer { free(jobs); };
+
+	OcclusionBuffer buffer;
+	defer { free(buffer); };
+
+	auto render = [&](m4 local_to_world) {
+		begin_occluders(buffer, get_world_to_clip());
+		add_occluder(buffer, array_as_span(quad_positions), array_as_span(quad_indices), local_to_world);
+		rasterize_occluders(buffer, jobs);
+	};
+
+	render(m4::translation({0, 0, -5}));
+
+	// Behind the occluder
+	check(is_occluded(buffer, {0, 0, -10}, {0.5f, 0.5f, 0.5f}));
+
+	// Beside the occluder
+	check(!is_occluded(buffer, {8, 0, -10}, {0.5f, 0.5f, 0.5f}));
+
+	// In front of the occluder
+	check(!is_occluded(buffer, {0, 0, -3}, {0.5f, 0.5f, 0.5f}));
+
+	// Crossing the near plane
+	check(!is_occluded(buffer, {0, 0, -0.3f}, {0.5f, 0.5f, 0.5f}));
+
+	// Mirrored occluder turns its front faces clockwise, it still has to occlude
+	render(m4::translation({0, 0, -5}) * m4::scale(v3f{-1, 1, 1}));
+	check(is_occluded(buffer, {0, 0, -10}, {0.5f, 0.5f, 0.5f}));
+
+	// Turned away from the camera, back faces are dropped
+	render(m4::translation({0, 0, -5}) * m4::scale(v3f{-1, 1, -1}));
+	check(!is_occluded(buffer, {0, 0, -10}, {0.5f, 0.5f, 0.5f}));
+}
+
+//
+// Generated city: rows of walls in front of the camera with boxes scattered between and behind them.
+//
+void bench_occlusion() {
+	static constexpr u32 wall_count = OcclusionBuffer::max_occluders;
+	static constexpr u32 box_count = 100000;
+
+	JobSystem jobs;
+	init(jobs);
+	defer { free(jobs); };
+
+	OcclusionBuffer buffer;
+	defer { free(buffer); };
+
+	u64 seed = 0x9e3779b97f4a7c15;
+	auto random = [&](f32 from, f32 to) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		return from + (to - from) * ((seed >> 40) / (f32)(1 << 24));
+	};
+
+	m4 walls[wall_count];
+	for (auto &wall : walls) {
+		wall = m4::translation({random(-40, 40), random(-2, 2), random(-60, -10)}) * m4::scale(v3f{random(2, 6), random(1, 3), 1});
+	}
+
+	List<v3f> box_centers;
+	box_centers.allocator = temporary_allocator;
+	for (u32 i = 0; i < box_count; ++i) {
+		box_centers.add({random(-80, 80), random(-4, 4), random(-100, -1)});
+	}
+
+	auto timer = create_precise_timer();
+
+	begin_occluders(buffer, get_world_to_clip());
+	for (auto &wall : walls) {
+		add_occluder(buffer, array_as_span(quad_positions), array_as_span(quad_indices), wall);
+	}
+	rasterize_occluders(buffer, jobs);
+
+	auto render_time = get_time(timer);
+	timer = create_precise_timer();
+
+	u32 culled_count = 0;
+	for (auto center : box_centers) {
+		culled_count += is_occluded(buffer, center, {0.5f, 0.5f, 0.5f});
+	}
+
+	auto test_time = get_time(timer);
+
+	print("{} walls, {} boxes: {}% culled. Rendered in {} ms, tested in {} ms on one thread\n",
+		wall_count, box_count,
+		FormatFloat{.value = culled_count * 100.0f / box_count, .precision = 1},
+		FormatFloat{.value = render_time * 1000, .precision = 3},
+		FormatFloat{.value = test_time * 1000, .precision = 3});
+}
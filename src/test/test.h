@@ -0,0 +1,30 @@
+#pragma once
+#include <t3d/common.h>
+
+//
+// Headless tests and benchmarks of engine code that doesn't need a window or graphics.
+// Tests run every time, benchmarks only when `bench` is passed on the command line.
+//
+
+extern u32 failed_check_count;
+
+// Failed check is reported and counted, the test keeps going
+#define check(condition) \
+	do { \
+		if (!(condition)) { \
+			print(Print_error, "{}:{}: check failed: {}\n", __FILE__, __LINE__, #condition); \
+			failed_check_count += 1; \
+		} \
+	} while (0)
+
+void test_occlusion();
+void bench_occlusion();
+
+void test_light_clusters();
+void bench_light_clusters();
+
+void bench_component_storage();
+void bench_component_update();
+
+void test_mesh_optimize();
+bool report_mesh_optimization(Span<utf8> path);